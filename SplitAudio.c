@@ -1,85 +1,560 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
-enum state {GAP, TRACK, ZEROS};
+#include "audio_input.h"
+#include "split_audio.h"
+#include "split_envelope.h"
+#include "split_index.h"
+#include "split_parallel.h"
+#include "split_scan.h"
+#include "split_sweep.h"
+#include "track_writer.h"
 
-int main()
+//Samples are decoded and fed to the detector this many at a time
+#define BLOCK_SAMPLES 65536
+
+//Where each track goes
+typedef struct
+{
+    double sample_rate;     //the length of a sample in seconds
+    track_writer *writer;   //writes each track to a file, with -o
+    const char *program;
+    bool failed;
+} track_output;
+
+/**
+ * Prints one track as "[start-end]" in seconds and, with -o, writes it
+ * to a file of its own.
+ *
+ * @param start the first frame of the track
+ * @param end the last frame of the track
+ * @param arg points to a track_output
+ */
+void print_track(int64_t start, int64_t end, void *arg);
+
+/**
+ * Reads the thresholds and gaps of a -s list: comma-separated entries of
+ * a threshold, or a threshold and gap as "threshold:gap".
+ *
+ * @param list the list
+ * @param min_gap the gap of entries without one, or 0 for the default
+ *        gap of each threshold
+ * @param configs an array that can hold SWEEP_MAX_CONFIGS entries
+ * @return the number of entries, or 0 if the list is not valid
+ */
+int parse_sweep(const char *list, int min_gap, split_config *configs);
+
+/**
+ * Prints the tracks each threshold and gap of a sweep found, after a line
+ * with the threshold, gap, number of tracks and their total length.
+ *
+ * @param sweep a finished sweep
+ * @param sample_rate the length of a sample in seconds
+ */
+void print_sweep(const sweep_state *sweep, double sample_rate);
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+int main(int argc, char **argv)
 {
+    //Usage: SplitAudio [-f text|wav|raw16|raw24|raw32] [-c channels] [-m max|mid|channel]
+    //                  [-r rate] [-T threshold] [-g gap] [-e rms|peak] [-w window] [-L off]
+    //                  [-k kernel] [-t threads] [-o prefix] [-x index | -i index]
+    //                  [-s list] [-v] [file]
+    //Reads text samples from standard input by default.  -c sets the
+    //channels interleaved in raw or text input (a WAV header gives its
+    //own), and -m what the detector hears of each frame: its loudest
+    //channel (the default), the mean of its channels, or the channel
+    //numbered from 1.  -r sets the samples per second (from a WAV
+    //header, or 44100), -T the largest
+    //quiet amplitude (5) and -g the quiet samples that end a track
+    //(threshold - 1, at least 2).  -e listens to the RMS or peak level of
+    //a window of samples (10 ms) instead of single samples: a track then
+    //starts above the threshold, goes on while the level stays above -L
+    //(half the threshold), and ends after a gap of a window by default.
+    //-k picks the scan kernel (scalar, sse2, avx2 or avx512), -t splits a
+    //binary file on that many threads (0 for one per processor), -o also
+    //writes each track of a binary file to prefix0001.wav (or .raw) and
+    //so on, and -v reports speed.  -x also writes an index of the
+    //extremes of each block of a binary file, at several resolutions, and
+    //-i splits the file again from such an index with a new threshold and
+    //gap, reading only the samples near the ends of tracks once the gap
+    //is longer than 510 samples.  -s tries each threshold (and gap) of a
+    //list like 5,10:100,20 in one pass, printing the tracks of each with
+    //their count and total length
+    audio_format format = AUDIO_TEXT;
+    int channels = 0;
+    audio_reduction reduction = AUDIO_MAX_ABS;
+    int channel = 0;
+    double rate = 0;
+    int threshold = 5;
+    int min_gap = 0;
+    bool envelope = false;
+    envelope_kind kind = ENVELOPE_RMS;
+    int window = 0;
+    int off = -1;
+    const char *prefix = NULL;
+    const char *index_out = NULL;
+    const char *index_in = NULL;
+    const char *sweep_list = NULL;
+    int threads = 1;
+    bool verbose = false;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-f") == 0)
+        {
+            if (i == argc - 1 || !audio_format_named(argv[i + 1], &format))
+            {
+                fprintf(stderr, "%s: -f must be followed by text, wav, raw16, raw24 or raw32\n", argv[0]);
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "-c") == 0)
+        {
+            if (i == argc - 1 || atoi(argv[i + 1]) < 1 || atoi(argv[i + 1]) > AUDIO_MAX_CHANNELS)
+            {
+                fprintf(stderr, "%s: -c must be followed by a number of channels from 1 to %d\n", argv[0],
+                        AUDIO_MAX_CHANNELS);
+                return 1;
+            }
+            channels = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-m") == 0)
+        {
+            if (i == argc - 1 || !audio_reduction_named(argv[i + 1], &reduction, &channel))
+            {
+                fprintf(stderr, "%s: -m must be followed by max, mid or a channel number\n", argv[0]);
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            if (i == argc - 1 || atof(argv[i + 1]) <= 0)
+            {
+                fprintf(stderr, "%s: -r must be followed by a number of samples per second\n", argv[0]);
+                return 1;
+            }
+            rate = atof(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-T") == 0)
+        {
+            if (i == argc - 1 || atoi(argv[i + 1]) < 0)
+            {
+                fprintf(stderr, "%s: -T must be followed by a nonnegative amplitude\n", argv[0]);
+                return 1;
+            }
+            threshold = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-g") == 0)
+        {
+            if (i == argc - 1 || atoi(argv[i + 1]) < 1)
+            {
+                fprintf(stderr, "%s: -g must be followed by a positive number of samples\n", argv[0]);
+                return 1;
+            }
+            min_gap = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-e") == 0)
+        {
+            if (i == argc - 1 || (strcmp(argv[i + 1], "rms") != 0 && strcmp(argv[i + 1], "peak") != 0))
+            {
+                fprintf(stderr, "%s: -e must be followed by rms or peak\n", argv[0]);
+                return 1;
+            }
+            envelope = true;
+            kind = strcmp(argv[i + 1], "rms") == 0 ? ENVELOPE_RMS : ENVELOPE_PEAK;
+            i++;
+        }
+        else if (strcmp(argv[i], "-w") == 0)
+        {
+            if (i == argc - 1 || atoi(argv[i + 1]) < 1)
+            {
+                fprintf(stderr, "%s: -w must be followed by a positive number of samples\n", argv[0]);
+                return 1;
+            }
+            window = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-L") == 0)
+        {
+            if (i == argc - 1 || atoi(argv[i + 1]) < 0)
+            {
+                fprintf(stderr, "%s: -L must be followed by a nonnegative amplitude\n", argv[0]);
+                return 1;
+            }
+            off = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-k") == 0)
+        {
+            if (i == argc - 1 || !scan_use_kernel(argv[i + 1]))
+            {
+                fprintf(stderr, "%s: -k must be followed by a kernel this processor supports\n", argv[0]);
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "-t") == 0)
+        {
+            if (i == argc - 1 || atoi(argv[i + 1]) < 0)
+            {
+                fprintf(stderr, "%s: -t must be followed by a number of threads\n", argv[0]);
+                return 1;
+            }
+            threads = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            if (i == argc - 1)
+            {
+                fprintf(stderr, "%s: -o must be followed by the start of a path\n", argv[0]);
+                return 1;
+            }
+            prefix = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-x") == 0 || strcmp(argv[i], "-i") == 0)
+        {
+            if (i == argc - 1)
+            {
+                fprintf(stderr, "%s: %s must be followed by the path of an index\n", argv[0], argv[i]);
+                return 1;
+            }
+            if (argv[i][1] == 'x')
+            {
+                index_out = argv[i + 1];
+            }
+            else
+            {
+                index_in = argv[i + 1];
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "-s") == 0)
+        {
+            if (i == argc - 1)
+            {
+                fprintf(stderr, "%s: -s must be followed by a list of thresholds\n", argv[0]);
+                return 1;
+            }
+            sweep_list = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-v") == 0)
+        {
+            verbose = true;
+        }
+        else if (!path && argv[i][0] != '-')
+        {
+            path = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "%s: usage: %s [-f text|wav|raw16|raw24|raw32] [-c channels] [-m max|mid|channel] "
+                    "[-r rate] [-T threshold] [-g gap] [-e rms|peak] [-w window] [-L off] [-k kernel] [-t threads] "
+                    "[-o prefix] [-x index | -i index] [-s list] [-v] [file]\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    if ((index_in && (index_out || envelope)) || (index_out && format == AUDIO_TEXT))
+    {
+        fprintf(stderr, "%s: -x needs a raw or WAV file, and -i can't go with -x or -e\n", argv[0]);
+        return 1;
+    }
+    split_config sweep_configs[SWEEP_MAX_CONFIGS];
+    int sweep_count = sweep_list ? parse_sweep(sweep_list, min_gap, sweep_configs) : 0;
+    if (sweep_list && (sweep_count == 0 || envelope || index_in || index_out || prefix))
+    {
+        fprintf(stderr, "%s: -s must be followed by up to %d thresholds, each with an optional :gap, and can't "
+                "go with -e, -x, -i or -o\n", argv[0], SWEEP_MAX_CONFIGS);
+        return 1;
+    }
+
+    audio_reader reader;
+    if (!audio_open(&reader, path, format))
+    {
+        fprintf(stderr, "%s: could not read %s\n", argv[0], path ? path : "standard input");
+        return 1;
+    }
+    if (channels && !audio_set_channels(&reader, channels) && reader.channels != channels)
+    {
+        fprintf(stderr, "%s: %s has %d channels\n", argv[0], path ? path : "standard input", reader.channels);
+        audio_close(&reader);
+        return 1;
+    }
+    if (!audio_set_reduction(&reader, reduction, channel))
+    {
+        fprintf(stderr, "%s: -m asks for channel %d of %d\n", argv[0], channel + 1, reader.channels);
+        audio_close(&reader);
+        return 1;
+    }
+
     //Initializing values
-    enum state curr = GAP;
+    if (rate == 0)
+    {
+        rate = reader.sample_rate ? reader.sample_rate : 44100;
+    }
+    const double sample_rate = (double) 1 / rate;
+    split_config config = {threshold, min_gap ? min_gap : split_default_gap(threshold)};
+    envelope_config levels;
+    levels.kind = kind;
+    levels.window = window ? window : (rate >= 200 ? (int)(rate / 100) : 1);
+    levels.on = threshold;
+    levels.off = off < 0 ? threshold / 2 : (off < threshold ? off : threshold);
+    levels.min_gap = min_gap ? min_gap : levels.window;
+    int32_t *samples = malloc(sizeof(int32_t) * BLOCK_SAMPLES);
+    if (!samples)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        audio_close(&reader);
+        return 1;
+    }
 
-    int count = 0;
-    int start, end;
-
-    const double sample_rate = (double) 1 / 44100;
-    const int threshold = 5;
-
-    int value;
-    int zeros;
-    
-    /*While loop that looks at one input line at a time
-    For each line looks at current state and reacts according to the value of the input*/
-    while (scanf("%d", &value) > 0)
-    {
-        switch (curr)
-        {
-            //If the current state is GAP
-            case GAP:
-                //If value is high, remember the start position and change state to TRACK
-                if (abs(value) > threshold)
-                {
-                    start = count;
-                    curr = TRACK;
-                }
-                break;
-
-            //If the current state is TRACK
-            case TRACK:
-                //If value is low, remember the end position and change state to ZEROS
-                if (abs(value) <= threshold)
-                {
-                    end = count - 1;
-                    zeros = 1;
-                    curr = ZEROS;
-                }
-                break;
-
-            //If the current state is ZEROS
-            case ZEROS:
-                //If value is high, change state to TRACK
-                if (abs(value) > threshold)
-                {
-                    curr = TRACK;
-                }
-
-                /*If value is low, check if there have been four consecutive low values
-                If yes, print start and end of the finished track and change state to GAP*/
-                else if (abs(value) <= threshold)
-                {
-                    zeros = zeros + 1;
-                    if (zeros >= threshold - 1)
-                    {
-                        printf("[%.6f-%.6f]\n", (double)(start) * sample_rate, (double)(end) * sample_rate);
-                        zeros = 0;
-                        curr = GAP;
-                    }
-                }
-                break;
+    //Tracks can only be copied out of a binary file
+    track_writer writer;
+    track_output output = {sample_rate, NULL, argv[0], false};
+    if (prefix)
+    {
+        if (!track_writer_init(&writer, &reader, prefix))
+        {
+            fprintf(stderr, "%s: -o needs a raw or WAV file to copy tracks from\n", argv[0]);
+            free(samples);
+            audio_close(&reader);
+            return 1;
         }
-        count++;
+        output.writer = &writer;
     }
 
-    /*After parsing through the input files, look at final state
-    If current state is TRACK or ZEROS, print start and end of the last track*/
-    if (curr == TRACK)
+    /*A binary file is mapped and split in chunks on all the threads, or
+    from its index with -i; anything else, and anything for the envelope
+    detector, for writing an index or for a sweep, is read a block at a
+    time*/
+    uint64_t mapped_count = 0;
+    const unsigned char *mapped = envelope || index_out || sweep_list ? NULL : audio_map(&reader, &mapped_count);
+    split_index index;
+    if (index_in && (!mapped || !index_open(&index, index_in, &reader, mapped_count)))
     {
-        printf("[%.6f-%.6f]\n", (double)(start) * sample_rate, (double)(count - 1) * sample_rate);
+        fprintf(stderr, "%s: %s is not an index of %s read this way\n", argv[0], index_in,
+                path ? path : "standard input");
+        free(samples);
+        audio_close(&reader);
+        return 1;
     }
+    index_builder builder;
+    index_builder_init(&builder);
 
-    else if (curr == ZEROS)
+    uint64_t bytes = 0;
+    int64_t count = 0;
+    double start = now();
+    if (sweep_list)
     {
-        printf("[%.6f-%.6f]\n", (double)(start) * sample_rate, (double)(end) * sample_rate);
+        sweep_state sweep;
+        if (!sweep_init(&sweep, sweep_configs, sweep_count))
+        {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+            free(samples);
+            audio_close(&reader);
+            return 1;
+        }
+        size_t n;
+        while ((n = audio_read(&reader, samples, BLOCK_SAMPLES)) > 0)
+        {
+            sweep_feed(&sweep, samples, n);
+        }
+        if (!sweep_finish(&sweep))
+        {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+            sweep_destroy(&sweep);
+            free(samples);
+            audio_close(&reader);
+            return 1;
+        }
+        print_sweep(&sweep, sample_rate);
+        sweep_destroy(&sweep);
+        bytes = reader.bytes_read;
+        count = sweep.count_seen;
+    }
+    else if (index_in)
+    {
+        bool ok = index_split(&index, &reader, mapped, &config, print_track, &output);
+        index_close(&index);
+        if (!ok)
+        {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+            free(samples);
+            audio_close(&reader);
+            return 1;
+        }
+        bytes = index.frames_read * reader.bytes_per_sample * reader.channels;
+        count = mapped_count;
+    }
+    else if (envelope)
+    {
+        envelope_state detector;
+        if (!envelope_init(&detector, &levels, print_track, &output))
+        {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+            free(samples);
+            audio_close(&reader);
+            return 1;
+        }
+        size_t n;
+        while ((n = audio_read(&reader, samples, BLOCK_SAMPLES)) > 0)
+        {
+            envelope_feed(&detector, samples, n);
+            if (index_out)
+            {
+                index_builder_feed(&builder, samples, n);
+            }
+        }
+        envelope_finish(&detector);
+        envelope_destroy(&detector);
+        bytes = reader.bytes_read;
+        count = detector.count;
+    }
+    else if (mapped)
+    {
+        if (!split_parallel(&reader, mapped, mapped_count, &config, threads, print_track, &output))
+        {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+            free(samples);
+            audio_close(&reader);
+            return 1;
+        }
+        bytes = reader.data_offset + mapped_count * reader.bytes_per_sample * reader.channels;
+        count = mapped_count;
+    }
+    else
+    {
+        /*Decode a block of samples at a time and run the GAP/TRACK/ZEROS
+        state machine over each block; tracks are printed as they end*/
+        split_state detector;
+        split_init(&detector, &config, print_track, &output);
+        size_t n;
+        while ((n = audio_read(&reader, samples, BLOCK_SAMPLES)) > 0)
+        {
+            split_feed(&detector, samples, n);
+            if (index_out)
+            {
+                index_builder_feed(&builder, samples, n);
+            }
+        }
+
+        //If the input ended in the middle of a track, print it too
+        split_finish(&detector);
+        bytes = reader.bytes_read;
+        count = detector.count;
+    }
+    double elapsed = now() - start;
+
+    if (reader.failed)
+    {
+        fprintf(stderr, "%s: error reading %s\n", argv[0], path ? path : "standard input");
+    }
+    bool indexed = !index_out || index_builder_write(&builder, &reader, index_out);
+    index_builder_destroy(&builder);
+    if (!indexed)
+    {
+        fprintf(stderr, "%s: could not write %s\n", argv[0], index_out);
+    }
+    if (verbose)
+    {
+        fprintf(stderr, "%llu bytes, %lld samples in %.3f s (%s): %.1f MB/s, %.1f Msamples/s\n",
+                (unsigned long long)bytes, (long long)count, elapsed,
+                sweep_list ? "sweep" : (index_in ? "index"
+                : (envelope ? (kind == ENVELOPE_RMS ? "rms" : "peak") : scan_kernel_name())),
+                bytes / elapsed / 1e6, count / elapsed / 1e6);
     }
 
+    free(samples);
+    audio_close(&reader);
+    return reader.failed || output.failed || !indexed ? 1 : 0;
+}
+
+void print_track(int64_t start, int64_t end, void *arg)
+{
+    track_output *output = (track_output *)arg;
+    double sample_rate = output->sample_rate;
+    printf("[%.6f-%.6f]\n", (double)(start) * sample_rate, (double)(end) * sample_rate);
+
+    //After the first file that can't be written, only print
+    if (output->writer && !output->failed && !track_writer_write(output->writer, start, end))
+    {
+        fprintf(stderr, "%s: could not write %s\n", output->program, output->writer->path);
+        output->failed = true;
+    }
+}
+
+int parse_sweep(const char *list, int min_gap, split_config *configs)
+{
+    int count = 0;
+    const char *p = list;
+    while (count < SWEEP_MAX_CONFIGS)
+    {
+        char *next;
+        long threshold = strtol(p, &next, 10);
+        if (next == p || threshold < 0 || threshold > INT32_MAX)
+        {
+            return 0;
+        }
+        long gap = min_gap ? min_gap : split_default_gap((int)threshold);
+        if (*next == ':')
+        {
+            p = next + 1;
+            gap = strtol(p, &next, 10);
+            if (next == p || gap < 1 || gap > INT32_MAX)
+            {
+                return 0;
+            }
+        }
+        configs[count].threshold = (int)threshold;
+        configs[count].min_gap = (int)gap;
+        count++;
+        if (*next == '\0')
+        {
+            return count;
+        }
+        if (*next != ',')
+        {
+            return 0;
+        }
+        p = next + 1;
+    }
     return 0;
 }
+
+void print_sweep(const sweep_state *sweep, double sample_rate)
+{
+    for (int k = 0; k < sweep->count; k++)
+    {
+        const sweep_result *result = &sweep->results[k];
+        printf("#threshold %d gap %d: %zu tracks, %.6f s\n", result->config.threshold, result->config.min_gap,
+               result->count, (double)result->samples * sample_rate);
+        for (size_t j = 0; j < result->count; j++)
+        {
+            printf("[%.6f-%.6f]\n", (double)(result->tracks[j].start) * sample_rate,
+                   (double)(result->tracks[j].end) * sample_rate);
+        }
+    }
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,719 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "audio_input.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Binary input is read this many bytes at a time
+#define AUDIO_BLOCK_SIZE (1 << 20)
+
+// WAV format tags for integer PCM
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+// Text is classified this many bytes at a time, and parsed in blocks
+// while there's a block after the current one to look ahead into; the
+// last few bytes of the input, and anything the blocks can't handle, go
+// through parse_slow
+#define TEXT_BLOCK 64
+#define TEXT_LOOKAHEAD (2 * TEXT_BLOCK)
+
+// Bit i of each mask says what byte i of a block of text is
+typedef struct
+{
+    uint64_t digits;
+    uint64_t spaces;
+    uint64_t signs;
+    uint64_t minus;
+} text_masks;
+
+// Reads and decodes up to max samples, one per channel, without reducing
+static size_t read_samples(audio_reader *reader, int32_t *samples, size_t max);
+
+// Returns the magnitude of a sample, which for INT32_MIN needs all 32 bits
+static uint32_t magnitude(int32_t value);
+
+// Parses up to max integers of text input
+static size_t read_text(audio_reader *reader, int32_t *samples, size_t max);
+
+// Parses whole blocks of text from where a number could start, up to max
+// integers, and stops short of anything it can't handle on its own: an
+// integer longer than 8 digits or the end of the input
+static size_t parse_blocks(audio_reader *reader, int32_t *samples, size_t max);
+
+// Classifies a block of TEXT_BLOCK bytes
+static text_masks classify(const unsigned char *p);
+
+// Converts a run of len digits, up to 8 of them, with its sign
+static int32_t parse_digits(const unsigned char *p, int len, bool negative);
+
+// Parses one integer a byte at a time, refilling as needed; returns 1 if
+// successful, 0 at something that isn't an integer and -1 at the end
+static int parse_slow(audio_reader *reader, int32_t *value);
+
+// Returns the next byte of text without taking it, or -1 at the end
+static int peek_byte(audio_reader *reader);
+
+// Moves what's left of the buffer to its front and reads more after it
+static void refill(audio_reader *reader);
+
+// Returns what scanf("%d") stores for a digit string of the given
+// magnitude and sign: glibc saturates to a long, then truncates to int
+static int32_t to_int(uint64_t magnitude, bool saturated, bool negative);
+
+// Returns true for the characters scanf skips before a number
+static bool is_space(int c);
+
+// Reads exactly n bytes unless the input ends first
+static bool read_exact(audio_reader *reader, unsigned char *data, size_t n);
+
+// Reads a WAV header up to the start of the samples
+static bool read_wav_header(audio_reader *reader);
+
+// Returns the little-endian integers at the given bytes
+static uint32_t le32(const unsigned char *p);
+static uint16_t le16(const unsigned char *p);
+
+bool audio_open(audio_reader *reader, const char *path, audio_format format)
+{
+    memset(reader, 0, sizeof(audio_reader));
+    reader->format = format;
+    reader->data_left = UINT64_MAX;
+    reader->channels = 1;
+    reader->reduction = AUDIO_MAX_ABS;
+    reader->fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (reader->fd < 0)
+    {
+        return false;
+    }
+
+    reader->buffer = malloc(AUDIO_BLOCK_SIZE);
+    reader->bytes_per_sample = format == AUDIO_RAW16 ? 2 : (format == AUDIO_RAW24 ? 3 : 4);
+    if (!reader->buffer || (format == AUDIO_WAV && !read_wav_header(reader)))
+    {
+        audio_close(reader);
+        return false;
+    }
+    return true;
+}
+
+bool audio_set_channels(audio_reader *reader, int channels)
+{
+    if (reader->format == AUDIO_WAV || channels < 1 || channels > AUDIO_MAX_CHANNELS)
+    {
+        return false;
+    }
+    reader->channels = channels;
+    return true;
+}
+
+bool audio_set_reduction(audio_reader *reader, audio_reduction reduction, int channel)
+{
+    if (reduction == AUDIO_CHANNEL && (channel < 0 || channel >= reader->channels))
+    {
+        return false;
+    }
+    reader->reduction = reduction;
+    reader->channel = reduction == AUDIO_CHANNEL ? channel : 0;
+    return true;
+}
+
+size_t audio_read(audio_reader *reader, int32_t *samples, size_t max)
+{
+    size_t channels = reader->channels;
+    if (channels == 1)
+    {
+        return read_samples(reader, samples, max);
+    }
+
+    // Read whole frames into the caller's array and reduce them in place;
+    // once fewer than a frame's worth of room is left, read just one frame
+    // on the side
+    size_t n = 0;
+    while (n < max)
+    {
+        int32_t frame[AUDIO_MAX_CHANNELS];
+        size_t frames = (max - n) / channels;
+        int32_t *into = frames > 0 ? samples + n : frame;
+        if (frames == 0)
+        {
+            frames = 1;
+        }
+        size_t got = read_samples(reader, into, frames * channels);
+        audio_reduce(reader, into, got / channels, samples + n);
+        n += got / channels;
+        if (got < frames * channels)
+        {
+            break;
+        }
+    }
+    return n;
+}
+
+static size_t read_samples(audio_reader *reader, int32_t *samples, size_t max)
+{
+    if (reader->format == AUDIO_TEXT)
+    {
+        return read_text(reader, samples, max);
+    }
+
+    size_t n = 0;
+    int width = reader->bytes_per_sample;
+    while (n < max)
+    {
+        // Refill once less than a whole sample is left, keeping the part
+        if (reader->end - reader->start < (size_t)width)
+        {
+            size_t left = reader->end - reader->start;
+            memmove(reader->buffer, reader->buffer + reader->start, left);
+            reader->start = 0;
+            reader->end = left;
+
+            size_t want = AUDIO_BLOCK_SIZE - left;
+            if (want > reader->data_left)
+            {
+                want = reader->data_left;
+            }
+            ssize_t got = want > 0 ? read(reader->fd, reader->buffer + left, want) : 0;
+            if (got <= 0)
+            {
+                reader->failed = got < 0;
+                break;
+            }
+            reader->end += got;
+            reader->bytes_read += got;
+            if (reader->data_left != UINT64_MAX)
+            {
+                reader->data_left -= got;
+            }
+            continue;
+        }
+
+        // Decode as many whole samples as are buffered and wanted
+        size_t count = (reader->end - reader->start) / width;
+        if (count > max - n)
+        {
+            count = max - n;
+        }
+        audio_decode(reader->buffer + reader->start, count, width, samples + n);
+        reader->start += count * width;
+        n += count;
+    }
+    return n;
+}
+
+const unsigned char *audio_map(audio_reader *reader, uint64_t *count)
+{
+    struct stat st;
+    if (reader->format == AUDIO_TEXT || reader->bytes_read != reader->data_offset
+        || fstat(reader->fd, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size <= reader->data_offset)
+    {
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return NULL;
+    }
+    reader->map = map;
+    reader->map_size = st.st_size;
+
+    uint64_t bytes = st.st_size - reader->data_offset;
+    *count = (bytes < reader->data_left ? bytes : reader->data_left) / ((uint64_t)reader->bytes_per_sample * reader->channels);
+    return (const unsigned char *)map + reader->data_offset;
+}
+
+void audio_decode(const unsigned char *bytes, size_t count, int bytes_per_sample, int32_t *samples)
+{
+    if (bytes_per_sample == 2)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            samples[i] = (int16_t)le16(bytes + 2 * i);
+        }
+    }
+    else if (bytes_per_sample == 3)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const unsigned char *q = bytes + 3 * i;
+            samples[i] = (int32_t)((uint32_t)q[0] << 8 | (uint32_t)q[1] << 16 | (uint32_t)q[2] << 24) >> 8;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            samples[i] = (int32_t)le32(bytes + 4 * i);
+        }
+    }
+}
+
+void audio_reduce(const audio_reader *reader, const int32_t *frames, size_t count, int32_t *samples)
+{
+    int channels = reader->channels;
+    size_t f = 0;
+#ifdef __SSE2__
+    if (channels == 2)
+    {
+        // Each step loads four frames before storing four samples, which
+        // land no further than the frames already loaded, so samples may
+        // be frames
+        const __m128i sign = _mm_set1_epi32(INT32_MIN);
+        const __m128i one = _mm_set1_epi32(1);
+        for (; f + 4 <= count; f += 4)
+        {
+            __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(frames + 2 * f)));
+            __m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(frames + 2 * f + 4)));
+            __m128i left = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i right = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            __m128i result;
+            if (reader->reduction == AUDIO_MAX_ABS)
+            {
+                // Magnitudes as unsigned, compared with their top bits
+                // flipped since SSE2 only compares signed
+                __m128i left_sign = _mm_srai_epi32(left, 31);
+                __m128i right_sign = _mm_srai_epi32(right, 31);
+                left = _mm_sub_epi32(_mm_xor_si128(left, left_sign), left_sign);
+                right = _mm_sub_epi32(_mm_xor_si128(right, right_sign), right_sign);
+                __m128i greater = _mm_cmpgt_epi32(_mm_xor_si128(left, sign), _mm_xor_si128(right, sign));
+                result = _mm_or_si128(_mm_and_si128(greater, left), _mm_andnot_si128(greater, right));
+            }
+            else if (reader->reduction == AUDIO_MID)
+            {
+                // floor((left + right) / 2) without overflowing
+                __m128i odd = _mm_and_si128(_mm_and_si128(left, right), one);
+                result = _mm_add_epi32(_mm_add_epi32(_mm_srai_epi32(left, 1), _mm_srai_epi32(right, 1)), odd);
+            }
+            else
+            {
+                result = reader->channel == 0 ? left : right;
+            }
+            _mm_storeu_si128((__m128i *)(samples + f), result);
+        }
+    }
+#endif
+
+    for (; f < count; f++)
+    {
+        const int32_t *frame = frames + f * channels;
+        if (reader->reduction == AUDIO_MAX_ABS)
+        {
+            uint32_t largest = 0;
+            for (int c = 0; c < channels; c++)
+            {
+                uint32_t m = magnitude(frame[c]);
+                largest = m > largest ? m : largest;
+            }
+            // 2^31 comes out as INT32_MIN, which has that magnitude
+            samples[f] = (int32_t)largest;
+        }
+        else if (reader->reduction == AUDIO_MID)
+        {
+            int64_t sum = 0;
+            for (int c = 0; c < channels; c++)
+            {
+                sum += frame[c];
+            }
+            samples[f] = (int32_t)(sum >= 0 ? sum / channels : -((-sum + channels - 1) / channels));
+        }
+        else
+        {
+            samples[f] = frame[reader->channel];
+        }
+    }
+}
+
+void audio_close(audio_reader *reader)
+{
+    if (reader->map)
+    {
+        munmap(reader->map, reader->map_size);
+        reader->map = NULL;
+    }
+    if (reader->fd > STDIN_FILENO)
+    {
+        close(reader->fd);
+    }
+    free(reader->buffer);
+    reader->buffer = NULL;
+    reader->fd = -1;
+}
+
+bool audio_format_named(const char *name, audio_format *format)
+{
+    const char *names[] = {"text", "wav", "raw16", "raw24", "raw32"};
+    for (int i = 0; i < 5; i++)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            *format = (audio_format)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool audio_reduction_named(const char *name, audio_reduction *reduction, int *channel)
+{
+    if (strcmp(name, "max") == 0 || strcmp(name, "mid") == 0)
+    {
+        *reduction = name[1] == 'a' ? AUDIO_MAX_ABS : AUDIO_MID;
+        return true;
+    }
+    int number = atoi(name);
+    if (number < 1 || number > AUDIO_MAX_CHANNELS)
+    {
+        return false;
+    }
+    *reduction = AUDIO_CHANNEL;
+    *channel = number - 1;
+    return true;
+}
+
+static uint32_t magnitude(int32_t value)
+{
+    return value < 0 ? 0 - (uint32_t)value : (uint32_t)value;
+}
+
+static size_t read_text(audio_reader *reader, int32_t *samples, size_t max)
+{
+    size_t n = 0;
+    while (n < max && !reader->stopped)
+    {
+        if (reader->end - reader->start < TEXT_LOOKAHEAD && !reader->at_eof)
+        {
+            refill(reader);
+        }
+        n += parse_blocks(reader, samples + n, max - n);
+        if (n == max)
+        {
+            break;
+        }
+
+        // Then one integer the careful way, to get past whatever stopped it
+        int32_t value;
+        if (parse_slow(reader, &value) <= 0)
+        {
+            reader->stopped = true;
+            break;
+        }
+        samples[n++] = value;
+    }
+    return n;
+}
+
+static size_t parse_blocks(audio_reader *reader, int32_t *samples, size_t max)
+{
+    size_t pos = reader->start;
+    if (reader->end - pos < TEXT_LOOKAHEAD)
+    {
+        return 0;
+    }
+
+    // A block holds at most TEXT_BLOCK / 2 numbers
+    size_t n = 0;
+    size_t last = pos;   // just past the last number parsed
+    uint64_t carry_digit = 0, carry_sign = 0, carry_minus = 0;
+    text_masks block = classify(reader->buffer + pos);
+    while (reader->end - pos >= TEXT_LOOKAHEAD && max - n >= TEXT_BLOCK / 2)
+    {
+        const unsigned char *p = reader->buffer + pos;
+        text_masks next = classify(p + TEXT_BLOCK);
+
+        // Anything else, or a sign without a digit right after it, ends
+        // the input somewhere in here; parse_slow finds out where
+        if (~(block.digits | block.spaces | block.signs)
+            || (block.signs & ~((block.digits >> 1) | (next.digits << 63))))
+        {
+            break;
+        }
+
+        // Each run of digits starting here is a number, negative if a
+        // minus comes right before it; runs can go on into the next block
+        uint64_t starts = block.digits & ~((block.digits << 1) | carry_digit);
+        uint64_t negative = starts & ((block.minus << 1) | carry_minus);
+        while (starts)
+        {
+            int at = __builtin_ctzll(starts);
+            uint64_t after = (block.digits >> at) | ((next.digits << 1) << (63 - at));
+            int len = ~after ? __builtin_ctzll(~after) : 64;
+            if (len > 8)
+            {
+                goto done;
+            }
+            samples[n++] = parse_digits(p + at, len, (negative >> at) & 1);
+            last = pos + at + len;
+            starts &= starts - 1;
+        }
+
+        carry_digit = block.digits >> 63;
+        carry_sign = block.signs >> 63;
+        carry_minus = block.minus >> 63;
+        block = next;
+        pos += TEXT_BLOCK;
+    }
+
+done:
+    // Resume after the last number, or at the sign of one not yet parsed
+    if (last > pos)
+    {
+        reader->start = last;
+    }
+    else
+    {
+        reader->start = carry_sign ? pos - 1 : pos;
+    }
+    return n;
+}
+
+static text_masks classify(const unsigned char *p)
+{
+    text_masks masks = {0, 0, 0, 0};
+#ifdef __SSE2__
+    for (int i = 0; i < TEXT_BLOCK; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (p + i));
+
+        // Shifting a range down to -128 makes it one signed comparison
+        __m128i digit = _mm_cmplt_epi8(_mm_add_epi8(bytes, _mm_set1_epi8(128 - '0')), _mm_set1_epi8(-128 + 10));
+        __m128i space = _mm_or_si128(_mm_cmplt_epi8(_mm_add_epi8(bytes, _mm_set1_epi8(128 - '\t')), _mm_set1_epi8(-128 + 5)),
+                                     _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')));
+        __m128i minus = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('-'));
+        __m128i sign = _mm_or_si128(minus, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('+')));
+        masks.digits |= (uint64_t)(uint16_t)_mm_movemask_epi8(digit) << i;
+        masks.spaces |= (uint64_t)(uint16_t)_mm_movemask_epi8(space) << i;
+        masks.signs |= (uint64_t)(uint16_t)_mm_movemask_epi8(sign) << i;
+        masks.minus |= (uint64_t)(uint16_t)_mm_movemask_epi8(minus) << i;
+    }
+#else
+    for (int i = 0; i < TEXT_BLOCK; i++)
+    {
+        masks.digits |= (uint64_t)(p[i] >= '0' && p[i] <= '9') << i;
+        masks.spaces |= (uint64_t)is_space(p[i]) << i;
+        masks.signs |= (uint64_t)(p[i] == '-' || p[i] == '+') << i;
+        masks.minus |= (uint64_t)(p[i] == '-') << i;
+    }
+#endif
+    return masks;
+}
+
+static int32_t parse_digits(const unsigned char *p, int len, bool negative)
+{
+    // Line the digits up at the top and combine them pairwise
+    uint64_t v;
+    memcpy(&v, p, 8);
+    v = (v & 0x0F0F0F0F0F0F0F0FULL) << (8 * (8 - len));
+    v = (v * 10 + (v >> 8)) & 0x00FF00FF00FF00FFULL;
+    v = (v * 100 + (v >> 16)) & 0x0000FFFF0000FFFFULL;
+    v = (v * 10000 + (v >> 32)) & 0x00000000FFFFFFFFULL;
+    uint32_t sign = -(uint32_t)negative;
+    return (int32_t)(((uint32_t)v ^ sign) - sign);
+}
+
+static int parse_slow(audio_reader *reader, int32_t *value)
+{
+    int c = peek_byte(reader);
+    while (is_space(c))
+    {
+        reader->start++;
+        c = peek_byte(reader);
+    }
+    if (c < 0)
+    {
+        return -1;
+    }
+
+    // scanf takes the sign even if no digits follow
+    bool negative = c == '-';
+    if (c == '-' || c == '+')
+    {
+        reader->start++;
+        c = peek_byte(reader);
+    }
+    if (c < '0' || c > '9')
+    {
+        return 0;
+    }
+
+    uint64_t magnitude = 0;
+    bool saturated = false;
+    while (c >= '0' && c <= '9')
+    {
+        if (magnitude > (UINT64_MAX - 9) / 10)
+        {
+            saturated = true;
+        }
+        else
+        {
+            magnitude = magnitude * 10 + (c - '0');
+        }
+        reader->start++;
+        c = peek_byte(reader);
+    }
+    *value = to_int(magnitude, saturated, negative);
+    return 1;
+}
+
+static int peek_byte(audio_reader *reader)
+{
+    if (reader->start == reader->end)
+    {
+        if (reader->at_eof)
+        {
+            return -1;
+        }
+        refill(reader);
+        if (reader->start == reader->end)
+        {
+            return -1;
+        }
+    }
+    return reader->buffer[reader->start];
+}
+
+static void refill(audio_reader *reader)
+{
+    size_t left = reader->end - reader->start;
+    memmove(reader->buffer, reader->buffer + reader->start, left);
+    reader->start = 0;
+    reader->end = left;
+    while (reader->end < AUDIO_BLOCK_SIZE && !reader->at_eof)
+    {
+        ssize_t got = read(reader->fd, reader->buffer + reader->end, AUDIO_BLOCK_SIZE - reader->end);
+        if (got <= 0)
+        {
+            reader->failed = got < 0;
+            reader->at_eof = true;
+            break;
+        }
+        reader->end += got;
+        reader->bytes_read += got;
+
+        // A pipe hands over a little at a time; one block is enough
+        if (reader->end - left >= TEXT_LOOKAHEAD)
+        {
+            break;
+        }
+    }
+}
+
+static int32_t to_int(uint64_t magnitude, bool saturated, bool negative)
+{
+    int64_t value;
+    if (negative)
+    {
+        value = saturated || magnitude > (uint64_t)INT64_MAX + 1 ? INT64_MIN : (int64_t)(0 - magnitude);
+    }
+    else
+    {
+        value = saturated || magnitude > INT64_MAX ? INT64_MAX : (int64_t)magnitude;
+    }
+    return (int32_t)(uint32_t)(uint64_t)value;
+}
+
+static bool is_space(int c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static bool read_wav_header(audio_reader *reader)
+{
+    unsigned char header[12];
+    if (!read_exact(reader, header, 12) || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+    {
+        return false;
+    }
+
+    // Go through the chunks until the samples, skipping any we don't use;
+    // the input may be a pipe, so skipping means reading
+    bool have_format = false;
+    unsigned char chunk[8];
+    while (read_exact(reader, chunk, 8))
+    {
+        uint32_t size = le32(chunk + 4);
+        if (memcmp(chunk, "data", 4) == 0)
+        {
+            if (!have_format)
+            {
+                return false;
+            }
+            // Streaming writers leave the size at 0 or all ones
+            reader->data_offset = reader->bytes_read;
+            reader->data_left = size == 0 || size == UINT32_MAX ? UINT64_MAX : size;
+            return true;
+        }
+
+        unsigned char fmt[40];
+        uint32_t keep = memcmp(chunk, "fmt ", 4) == 0 ? (size < sizeof(fmt) ? size : sizeof(fmt)) : 0;
+        if (keep > 0)
+        {
+            if (keep < 16 || !read_exact(reader, fmt, keep))
+            {
+                return false;
+            }
+            uint16_t tag = le16(fmt);
+            uint16_t channels = le16(fmt + 2);
+            uint16_t bits = le16(fmt + 14);
+            if (tag == WAVE_FORMAT_EXTENSIBLE && keep >= 26)
+            {
+                tag = le16(fmt + 24);
+            }
+            if (tag != WAVE_FORMAT_PCM || channels < 1 || channels > AUDIO_MAX_CHANNELS
+                || (bits != 16 && bits != 24 && bits != 32))
+            {
+                return false;
+            }
+            reader->sample_rate = le32(fmt + 4);
+            reader->bytes_per_sample = bits / 8;
+            reader->channels = channels;
+            have_format = true;
+        }
+
+        // Chunks are padded to an even length
+        uint64_t skip = (uint64_t)size + (size & 1) - keep;
+        while (skip > 0)
+        {
+            size_t step = skip < AUDIO_BLOCK_SIZE ? skip : AUDIO_BLOCK_SIZE;
+            if (!read_exact(reader, reader->buffer, step))
+            {
+                return false;
+            }
+            skip -= step;
+        }
+    }
+    return false;
+}
+
+static bool read_exact(audio_reader *reader, unsigned char *data, size_t n)
+{
+    size_t done = 0;
+    while (done < n)
+    {
+        ssize_t got = read(reader->fd, data + done, n - done);
+        if (got <= 0)
+        {
+            return false;
+        }
+        done += got;
+    }
+    reader->bytes_read += n;
+    return true;
+}
+
+static uint32_t le32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t le16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
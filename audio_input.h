@@ -0,0 +1,156 @@
+#ifndef __AUDIO_INPUT_H__
+#define __AUDIO_INPUT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The kinds of input SplitAudio reads: one integer per line (or any
+// whitespace) as text, a RIFF WAV file of integer PCM, or headerless
+// little-endian PCM of 16, 24 or 32 bits per sample
+typedef enum {AUDIO_TEXT, AUDIO_WAV, AUDIO_RAW16, AUDIO_RAW24, AUDIO_RAW32} audio_format;
+
+// How a frame of several interleaved channels becomes the one sample the
+// detectors see: the largest magnitude in it, the mean of its channels
+// rounded down, or one chosen channel
+typedef enum {AUDIO_MAX_ABS, AUDIO_MID, AUDIO_CHANNEL} audio_reduction;
+
+// The most channels a frame may have
+#define AUDIO_MAX_CHANNELS 64
+
+// A source of samples, read a block at a time and decoded to 32 bits
+typedef struct
+{
+    audio_format format;
+    int fd;
+    int bytes_per_sample;   // for the binary formats
+    int channels;           // interleaved in each frame
+    audio_reduction reduction;
+    int channel;            // the one AUDIO_CHANNEL keeps, from 0
+    uint32_t sample_rate;   // from a WAV header, 0 otherwise
+    uint64_t data_offset;   // where the samples start in the file
+    uint64_t data_left;     // bytes of samples not yet read; UINT64_MAX
+                            // if the length isn't known
+    unsigned char *buffer;  // bytes [start, end) are read but not decoded
+    size_t start;
+    size_t end;
+    uint64_t bytes_read;    // everything read so far, headers included
+    bool at_eof;            // read() has returned 0
+    bool stopped;           // text input hit something not an integer
+    bool failed;
+    void *map;              // the whole file, once audio_map has mapped it
+    size_t map_size;
+} audio_reader;
+
+/**
+ * Opens a source of samples and, for a WAV file, reads its header.  Only
+ * integer PCM of 16, 24 or 32 bits is supported.  Input starts out as a
+ * single channel unless a WAV header says otherwise; frames of several
+ * channels are reduced to their largest magnitude.
+ *
+ * @param reader the reader to fill in
+ * @param path the file to read, or NULL for standard input
+ * @param format the kind of input
+ * @return true if successful, false if the file could not be opened, is
+ *         not a supported WAV file, or memory could not be allocated
+ */
+bool audio_open(audio_reader *reader, const char *path, audio_format format);
+
+/**
+ * Sets the number of interleaved channels in raw or text input.
+ *
+ * @param reader an open reader of a format other than WAV
+ * @param channels from 1 to AUDIO_MAX_CHANNELS
+ * @return true if successful, false for a WAV file or a bad count
+ */
+bool audio_set_channels(audio_reader *reader, int channels);
+
+/**
+ * Sets how each frame is reduced to one sample.
+ *
+ * @param reader an open reader
+ * @param reduction how to reduce a frame
+ * @param channel the channel to keep, for AUDIO_CHANNEL
+ * @return true if successful, false if there is no such channel
+ */
+bool audio_set_reduction(audio_reader *reader, audio_reduction reduction, int channel);
+
+/**
+ * Reads and decodes the next samples, one per frame.  Text input ends at
+ * the end of the file or at the first thing that isn't an integer,
+ * exactly where a loop of scanf("%d") would, and out-of-range values come
+ * out as they would from glibc's scanf; it is parsed straight from the
+ * read() buffer, 64 bytes at a time.  A partial frame at the end of the
+ * input is dropped.
+ *
+ * @param reader an open reader
+ * @param samples an array that can hold max samples
+ * @param max a positive integer
+ * @return the number of samples written, 0 at the end of the input
+ */
+size_t audio_read(audio_reader *reader, int32_t *samples, size_t max);
+
+/**
+ * Maps the samples of a binary input file into memory, for reading them
+ * in any order instead of through audio_read.  The mapping lasts until
+ * the reader is closed.
+ *
+ * @param reader a reader of a binary format, just opened on a regular file
+ * @param count set to the number of whole frames in the file
+ * @return the first frame, to be decoded with audio_decode and, for more
+ *         than one channel, reduced with audio_reduce, or NULL if
+ *         the input is text, not a regular file, empty or can't be mapped
+ */
+const unsigned char *audio_map(audio_reader *reader, uint64_t *count);
+
+/**
+ * Decodes little-endian PCM samples to 32 bits.
+ *
+ * @param bytes count samples of bytes_per_sample bytes each
+ * @param count a nonnegative integer
+ * @param bytes_per_sample 2, 3 or 4
+ * @param samples an array that can hold count samples
+ */
+void audio_decode(const unsigned char *bytes, size_t count, int bytes_per_sample, int32_t *samples);
+
+/**
+ * Reduces frames of interleaved 32-bit samples to one sample each, the
+ * way the given reader is set to.  Stereo is deinterleaved four frames at
+ * a time with SSE2 where it's available.
+ *
+ * @param reader the reader the frames came from
+ * @param frames count frames of reader->channels samples each
+ * @param count a nonnegative integer
+ * @param samples an array that can hold count samples; it may be frames
+ */
+void audio_reduce(const audio_reader *reader, const int32_t *frames, size_t count, int32_t *samples);
+
+/**
+ * Closes the given reader.
+ *
+ * @param reader a reader opened by audio_open
+ */
+void audio_close(audio_reader *reader);
+
+/**
+ * Returns the format named by a -f argument ("text", "wav", "raw16",
+ * "raw24" or "raw32").
+ *
+ * @param name a format name
+ * @param format set to the format
+ * @return true if successful, false if the name is not a format
+ */
+bool audio_format_named(const char *name, audio_format *format);
+
+/**
+ * Returns the reduction named by a -m argument: "max", "mid", or a
+ * channel number counted from 1.
+ *
+ * @param name a reduction name
+ * @param reduction set to the reduction
+ * @param channel set to the channel, from 0, for AUDIO_CHANNEL
+ * @return true if successful, false if the name is not a reduction
+ */
+bool audio_reduction_named(const char *name, audio_reduction *reduction, int *channel);
+
+#endif
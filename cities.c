@@ -1,7 +1,60 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #include "cities.h"
+#include "city_init.h"
+#include "city_phash.h"
+
+// The sorted table find_city searches, or NULL until it's ready; set once
+// with a release store so that a lookup that sees it sees the sorted data
+static _Atomic(city *) sorted_table = NULL;
+
+// The perfect hash over the sorted table, if one was asked for; written
+// before sorted_table is published, so readers of the table see it
+static atomic_bool phash_wanted = false;
+static city_phash *phash = NULL;
+
+// Bumped whenever cities[] is rearranged or edited; see
+// city_database_version
+static atomic_ulong table_version = 0;
+
+// How the database is being prepared, decided once by whichever of the
+// two modes claims it first: cities[] can't be sorted in place under the
+// scans of async mode, nor copied while it is being sorted in place
+enum
+{
+    PREPARE_NONE,
+    PREPARE_IN_PLACE,
+    PREPARE_ASYNC
+};
+static atomic_int prepare_mode = PREPARE_NONE;
+
+// Makes sure the database is sorted in place exactly once
+static pthread_once_t sort_once = PTHREAD_ONCE_INIT;
+
+// Waiters in async mode sleep on async_done until the copy is published
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_done = PTHREAD_COND_INITIALIZER;
+
+// Claims in-place mode unless async mode has been claimed, then waits
+// until the database is ready
+static void prepare_database();
+
+// Sorts cities[] in place and publishes it; run through sort_once
+static void sort_in_place();
+
+// Sorts cities[] into the given copy and publishes the copy; the async
+// thread
+static void *sort_copy(void *arg);
+
+// Sorts the edited cities[] into the published table again and rebuilds
+// the perfect hash over it, whose records are copies
+static void refresh_table();
+
+// Returns the index of the code in the unsorted cities[], or -1
+static int linear_search(const char *code);
 
 /**
  * Makes a sorted copy of the given input array in the given output array.
@@ -27,6 +80,30 @@ void merge(int n1, const city *a1, int n2, const city *a2, city *out);
 int binary_search(const char *code, city *cities, int m, int n);
 
 void initialize_city_database()
+{
+    prepare_database();
+}
+
+static void prepare_database()
+{
+    int none = PREPARE_NONE;
+    atomic_compare_exchange_strong(&prepare_mode, &none, PREPARE_IN_PLACE);
+    if (atomic_load(&prepare_mode) == PREPARE_ASYNC)
+    {
+        pthread_mutex_lock(&async_lock);
+        while (!atomic_load(&sorted_table))
+        {
+            pthread_cond_wait(&async_done, &async_lock);
+        }
+        pthread_mutex_unlock(&async_lock);
+    }
+    else
+    {
+        pthread_once(&sort_once, sort_in_place);
+    }
+}
+
+static void sort_in_place()
 {
     city *sorted = malloc(city_count * sizeof(city));
     
@@ -38,6 +115,113 @@ void initialize_city_database()
     memcpy(cities, sorted, city_count * sizeof(city));
 
     free(sorted);
+    atomic_fetch_add(&table_version, 1);
+    if (atomic_load(&phash_wanted))
+    {
+        // Without the hash, lookups fall back to the binary search
+        phash = city_phash_build(city_count, cities);
+    }
+    atomic_store_explicit(&sorted_table, cities, memory_order_release);
+}
+
+void use_city_perfect_hash(bool on)
+{
+    atomic_store(&phash_wanted, on);
+}
+
+bool start_city_database_async()
+{
+    if (atomic_load(&prepare_mode) != PREPARE_NONE)
+    {
+        return true;
+    }
+    city *sorted = malloc(city_count * sizeof(city));
+    if (!sorted)
+    {
+        prepare_database();
+        return false;
+    }
+
+    // Another thread may have claimed a mode since the check above
+    int none = PREPARE_NONE;
+    if (!atomic_compare_exchange_strong(&prepare_mode, &none, PREPARE_ASYNC))
+    {
+        free(sorted);
+        return true;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, sort_copy, sorted) != 0)
+    {
+        sort_copy(sorted);
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+
+void wait_city_database()
+{
+    prepare_database();
+}
+
+bool city_database_ready()
+{
+    return atomic_load_explicit(&sorted_table, memory_order_acquire) != NULL;
+}
+
+unsigned long city_database_version()
+{
+    return atomic_load(&table_version);
+}
+
+void city_database_changed()
+{
+    atomic_fetch_add(&table_version, 1);
+    if (atomic_load(&prepare_mode) != PREPARE_NONE)
+    {
+        // Let a sort still in progress finish before redoing it
+        prepare_database();
+        refresh_table();
+    }
+}
+
+static void refresh_table()
+{
+    // In place this is cities[] itself, in async mode the copy
+    city *table = atomic_load_explicit(&sorted_table, memory_order_acquire);
+    city_phash_destroy(phash);
+    phash = NULL;
+
+    city *sorted = malloc(city_count * sizeof(city));
+    if (!sorted)
+    {
+        // The binary search over the old order is the best left
+        return;
+    }
+    merge_sort(city_count, cities, sorted);
+    memcpy(table, sorted, city_count * sizeof(city));
+    free(sorted);
+    if (atomic_load(&phash_wanted))
+    {
+        phash = city_phash_build(city_count, table);
+    }
+}
+
+static void *sort_copy(void *arg)
+{
+    city *sorted = arg;
+    merge_sort(city_count, cities, sorted);
+    if (atomic_load(&phash_wanted))
+    {
+        phash = city_phash_build(city_count, sorted);
+    }
+
+    // The copy stays in use for as long as the program runs
+    pthread_mutex_lock(&async_lock);
+    atomic_store_explicit(&sorted_table, sorted, memory_order_release);
+    pthread_cond_broadcast(&async_done);
+    pthread_mutex_unlock(&async_lock);
+    return NULL;
 }
 
 void merge_sort(int n, const city *a, city *out)
@@ -95,8 +279,35 @@ void merge(int n1, const city *a1, int n2, const city *a2, city *out)
 
 bool find_city(const char *code, location *loc)
 {
-    // Call a binary search function on the cities array
-    int index = binary_search(code, cities, 0, city_count - 1);
+    // Once the database is ready this load is all it costs
+    city *table = atomic_load_explicit(&sorted_table, memory_order_acquire);
+    if (!table)
+    {
+        // While the background sort runs, scan the untouched cities[]
+        if (atomic_load(&prepare_mode) == PREPARE_ASYNC)
+        {
+            int index = linear_search(code);
+            if (index == -1)
+            {
+                return false;
+            }
+            *loc = cities[index].coord;
+            return true;
+        }
+
+        // Otherwise this is the first lookup, so sort now
+        prepare_database();
+        table = atomic_load_explicit(&sorted_table, memory_order_acquire);
+    }
+
+    // One hash, one probe, one compare
+    if (phash)
+    {
+        return city_phash_find(phash, code, loc);
+    }
+
+    // Call a binary search function on the sorted array
+    int index = binary_search(code, table, 0, city_count - 1);
 
     // If the code did not exist in the cities array, return false
     if (index == -1)
@@ -107,11 +318,23 @@ bool find_city(const char *code, location *loc)
     // If it did exist, assign coordinates to loc and return true
     else
     {
-        *loc = cities[index].coord;
+        *loc = table[index].coord;
         return true;
     }
 }
 
+static int linear_search(const char *code)
+{
+    for (int i = 0; i < city_count; i++)
+    {
+        if (strcmp(code, cities[i].name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
 /**
  * This function takes 4 parameters; integers m and n are the first
  * and last indices of the array we are checking (initialized as 
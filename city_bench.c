@@ -0,0 +1,478 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "cities.h"
+#include "city_code_index.h"
+#include "city_init.h"
+#include "city_phash.h"
+#include "city_store.h"
+
+// Defined in cities.c; initialize_city_database only sorts once, so the
+// initialization benchmarks time the sort it runs
+void merge_sort(int n, const city *in, city *out);
+
+// The number of precomputed lookup keys; a power of 2
+#define KEY_COUNT (1 << 16)
+
+// How the lookup keys are drawn from the table
+typedef enum {UNIFORM, ZIPF, SEQUENTIAL} access_pattern;
+
+// One benchmark: run(arg, iterations) does the operation iterations times
+typedef struct
+{
+    char name[64];
+    long (*run)(void *arg, long iterations);
+    void *arg;
+} benchmark;
+
+// What one benchmark measured
+typedef struct
+{
+    long iterations;
+    double ns_per_op;
+    double cache_misses_per_op;  // negative if the counter isn't available
+    double branch_misses_per_op;
+} result;
+
+// A table to sort for the initialization benchmarks
+typedef struct
+{
+    int n;
+    city *in;
+    city *out;
+} sort_arg;
+
+// The keys to look up and the index to look them up in
+typedef struct
+{
+    const char **keys;
+    const city_phash *phash;
+    const city_code_index *code_index;
+    const city_store *store;
+} lookup_arg;
+
+// The hardware counters, or -1 where perf_event_open isn't allowed
+static int cache_fd = -1;
+static int branch_fd = -1;
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+/**
+ * Opens the cache-miss and branch-miss counters for this thread.
+ */
+void open_counters();
+
+/**
+ * Returns the current value of the given counter, or -1 if it isn't open.
+ */
+long read_counter(int fd);
+
+/**
+ * Runs a benchmark with growing iteration counts until one run takes at
+ * least min_time seconds, like Google Benchmark does.
+ */
+result measure(const benchmark *b, double min_time);
+
+/**
+ * Fills in KEY_COUNT lookup keys: codes from the given table drawn with
+ * the given pattern, with the given fraction replaced by codes that are
+ * not in the table.
+ */
+const char **make_keys(int n, const city *table, access_pattern pattern, double miss_fraction);
+
+/**
+ * Returns a new table of n synthetic cities with distinct codes, shuffled.
+ */
+city *make_table(int n);
+
+long run_sort(void *arg, long iterations);
+long run_find_city(void *arg, long iterations);
+long run_phash(void *arg, long iterations);
+long run_code_index(void *arg, long iterations);
+long run_store(void *arg, long iterations);
+
+int main(int argc, char **argv)
+{
+    // Usage: city_bench [-o json_file] [-f filter] [-t min_seconds]
+    FILE *json = stdout;
+    const char *filter = "";
+    double min_time = 0.2;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i == argc - 1)
+        {
+            fprintf(stderr, "%s: usage: %s [-o json_file] [-f filter] [-t min_seconds]\n", argv[0], argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-o") == 0)
+        {
+            json = fopen(argv[++i], "w");
+            if (!json)
+            {
+                fprintf(stderr, "%s: could not open %s\n", argv[0], argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-f") == 0)
+        {
+            filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "-t") == 0)
+        {
+            min_time = atof(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "%s: unknown option %s\n", argv[0], argv[i]);
+            return 1;
+        }
+    }
+
+    srand(223);
+    open_counters();
+
+    benchmark benchmarks[64];
+    int count = 0;
+
+    // Initialization: the stock table and scaled synthetic ones
+    int sizes[] = {0, 100000, 1000000};
+    sort_arg sorts[3];
+    for (int k = 0; k < 3; k++)
+    {
+        sorts[k].n = sizes[k] ? sizes[k] : city_count;
+        sorts[k].in = sizes[k] ? make_table(sizes[k]) : cities;
+        sorts[k].out = malloc(sizeof(city) * sorts[k].n);
+        benchmarks[count].run = run_sort;
+        benchmarks[count].arg = &sorts[k];
+        sprintf(benchmarks[count].name, "BM_InitializeCityDatabase/%d", sorts[k].n);
+        count++;
+    }
+
+    // Lookups in every index, after sorting the stock table
+    initialize_city_database();
+    city_phash *phash = city_phash_build(city_count, cities);
+    city_code_index code_index;
+    city_code_index_build(&code_index);
+    city_store *store = city_store_create();
+    if (!phash || !code_index.coords || !store)
+    {
+        fprintf(stderr, "%s: could not build the indexes\n", argv[0]);
+        return 1;
+    }
+
+    const char *pattern_names[] = {"uniform", "zipf", "sequential"};
+    const char *index_names[] = {"FindCity", "PerfectHash", "CodeIndex", "CityStore"};
+    long (*index_runs[])(void *, long) = {run_find_city, run_phash, run_code_index, run_store};
+    lookup_arg lookups[3][2];
+    for (int p = 0; p < 3; p++)
+    {
+        for (int miss = 0; miss < 2; miss++)
+        {
+            lookup_arg *a = &lookups[p][miss];
+            a->keys = make_keys(city_count, cities, (access_pattern)p, miss ? 1.0 : 0.0);
+            a->phash = phash;
+            a->code_index = &code_index;
+            a->store = store;
+            for (int x = 0; x < 4; x++)
+            {
+                benchmarks[count].run = index_runs[x];
+                benchmarks[count].arg = a;
+                sprintf(benchmarks[count].name, "BM_%s/%s/%s", index_names[x], miss ? "miss" : "hit", pattern_names[p]);
+                count++;
+            }
+        }
+    }
+
+    // Report as Google Benchmark's JSON does, with the counters added
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    time_t t = time(NULL);
+    char date[64];
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+    fprintf(json, "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"host_name\": \"%s\",\n", date, host);
+    fprintf(json, "    \"num_cpus\": %ld,\n    \"city_count\": %d,\n", sysconf(_SC_NPROCESSORS_ONLN), city_count);
+    fprintf(json, "    \"perf_counters\": %s\n  },\n  \"benchmarks\": [", cache_fd >= 0 ? "true" : "false");
+
+    bool first = true;
+    fprintf(stderr, "%-45s %12s %12s %14s %14s\n", "Benchmark", "ns/op", "Iterations", "cache-miss/op", "branch-miss/op");
+    for (int i = 0; i < count; i++)
+    {
+        if (!strstr(benchmarks[i].name, filter))
+        {
+            continue;
+        }
+        result r = measure(&benchmarks[i], min_time);
+
+        fprintf(stderr, "%-45s %12.1f %12ld", benchmarks[i].name, r.ns_per_op, r.iterations);
+        fprintf(json, "%s\n    {\n      \"name\": \"%s\",\n      \"iterations\": %ld,\n", first ? "" : ",", benchmarks[i].name, r.iterations);
+        fprintf(json, "      \"real_time\": %.3f,\n      \"time_unit\": \"ns\"", r.ns_per_op);
+        if (r.cache_misses_per_op >= 0)
+        {
+            fprintf(stderr, " %14.3f %14.3f", r.cache_misses_per_op, r.branch_misses_per_op);
+            fprintf(json, ",\n      \"cache_misses\": %.4f,\n      \"branch_misses\": %.4f", r.cache_misses_per_op, r.branch_misses_per_op);
+        }
+        fprintf(stderr, "\n");
+        fprintf(json, "\n    }");
+        first = false;
+    }
+    fprintf(json, "\n  ]\n}\n");
+
+    if (json != stdout)
+    {
+        fclose(json);
+    }
+    return 0;
+}
+
+result measure(const benchmark *b, double min_time)
+{
+    result r;
+    long iterations = 1;
+    while (true)
+    {
+        long cache_start = read_counter(cache_fd);
+        long branch_start = read_counter(branch_fd);
+        double start = now();
+        b->run(b->arg, iterations);
+        double elapsed = now() - start;
+        long cache = read_counter(cache_fd) - cache_start;
+        long branch = read_counter(branch_fd) - branch_start;
+
+        // Aim a little past min_time next round, at most 10x more
+        if (elapsed >= min_time || iterations >= 1000000000L)
+        {
+            r.iterations = iterations;
+            r.ns_per_op = elapsed * 1e9 / iterations;
+            r.cache_misses_per_op = cache_fd >= 0 ? (double)cache / iterations : -1;
+            r.branch_misses_per_op = branch_fd >= 0 ? (double)branch / iterations : -1;
+            return r;
+        }
+        double factor = elapsed > 0 ? min_time * 1.4 / elapsed : 10;
+        iterations = (long)(iterations * (factor > 10 ? 10 : factor)) + 1;
+    }
+}
+
+long run_sort(void *arg, long iterations)
+{
+    sort_arg *a = arg;
+    for (long i = 0; i < iterations; i++)
+    {
+        merge_sort(a->n, a->in, a->out);
+    }
+    return a->out[0].coord.lat != 0;
+}
+
+long run_find_city(void *arg, long iterations)
+{
+    lookup_arg *a = arg;
+    location loc;
+    long found = 0;
+    for (long i = 0; i < iterations; i++)
+    {
+        found += find_city(a->keys[i & (KEY_COUNT - 1)], &loc);
+    }
+    return found;
+}
+
+long run_phash(void *arg, long iterations)
+{
+    lookup_arg *a = arg;
+    location loc;
+    long found = 0;
+    for (long i = 0; i < iterations; i++)
+    {
+        found += city_phash_find(a->phash, a->keys[i & (KEY_COUNT - 1)], &loc);
+    }
+    return found;
+}
+
+long run_code_index(void *arg, long iterations)
+{
+    lookup_arg *a = arg;
+    location loc;
+    long found = 0;
+    for (long i = 0; i < iterations; i++)
+    {
+        const char *key = a->keys[i & (KEY_COUNT - 1)];
+        found += city_code_index_find(a->code_index, key, strlen(key), &loc);
+    }
+    return found;
+}
+
+long run_store(void *arg, long iterations)
+{
+    lookup_arg *a = arg;
+    location loc;
+    long found = 0;
+    for (long i = 0; i < iterations; i++)
+    {
+        found += city_store_find(a->store, a->keys[i & (KEY_COUNT - 1)], &loc);
+    }
+    return found;
+}
+
+const char **make_keys(int n, const city *table, access_pattern pattern, double miss_fraction)
+{
+    const char **keys = malloc(sizeof(char *) * KEY_COUNT);
+
+    // Zipf with s = 1 by inverse transform over the ranks; rank r is
+    // a fixed random entry so popular codes are spread over the table
+    double *cdf = NULL;
+    int *ranked = NULL;
+    if (pattern == ZIPF)
+    {
+        cdf = malloc(sizeof(double) * n);
+        ranked = malloc(sizeof(int) * n);
+        double sum = 0;
+        for (int r = 0; r < n; r++)
+        {
+            sum += 1.0 / (r + 1);
+            cdf[r] = sum;
+            ranked[r] = r;
+        }
+        for (int r = n - 1; r > 0; r--)
+        {
+            int j = rand() % (r + 1);
+            int tmp = ranked[r];
+            ranked[r] = ranked[j];
+            ranked[j] = tmp;
+        }
+        for (int r = 0; r < n; r++)
+        {
+            cdf[r] /= sum;
+        }
+    }
+
+    // Misses are codes that can't be in the table; they are leaked, as
+    // are the keys, since they live as long as the program
+    char *misses = malloc(KEY_COUNT * 8);
+    for (int i = 0; i < KEY_COUNT; i++)
+    {
+        int entry;
+        if (pattern == SEQUENTIAL)
+        {
+            entry = i % n;
+        }
+        else if (pattern == UNIFORM)
+        {
+            entry = rand() % n;
+        }
+        else
+        {
+            double u = (double)rand() / RAND_MAX;
+            int lo = 0;
+            int hi = n - 1;
+            while (lo < hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (cdf[mid] < u)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            entry = ranked[lo];
+        }
+
+        if ((double)rand() / RAND_MAX < miss_fraction)
+        {
+            // Same first characters as a real code, then a character no
+            // code has, so the search goes as deep as a hit would
+            snprintf(misses + i * 8, 8, "%.2s#", table[entry].name);
+            keys[i] = misses + i * 8;
+        }
+        else
+        {
+            keys[i] = table[entry].name;
+        }
+    }
+
+    free(ranked);
+    free(cdf);
+    return keys;
+}
+
+city *make_table(int n)
+{
+    city *table = malloc(sizeof(city) * n);
+    char *names = malloc((size_t)n * 8);
+    for (int i = 0; i < n; i++)
+    {
+        char *name = names + (size_t)i * 8;
+        sprintf(name, "S%06d", i);
+        table[i].name = name;
+        table[i].coord.lat = (double)rand() / RAND_MAX * 180 - 90;
+        table[i].coord.lon = (double)rand() / RAND_MAX * 360 - 180;
+    }
+    for (int i = n - 1; i > 0; i--)
+    {
+        int j = rand() % (i + 1);
+        city tmp = table[i];
+        table[i] = table[j];
+        table[j] = tmp;
+    }
+    return table;
+}
+
+void open_counters()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    cache_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    branch_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+    // Report both or neither
+    if (cache_fd < 0 || branch_fd < 0)
+    {
+        if (cache_fd >= 0)
+        {
+            close(cache_fd);
+        }
+        if (branch_fd >= 0)
+        {
+            close(branch_fd);
+        }
+        cache_fd = -1;
+        branch_fd = -1;
+    }
+}
+
+long read_counter(int fd)
+{
+    long long value;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value))
+    {
+        return -1;
+    }
+    return (long)value;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
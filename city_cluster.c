@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <math.h>
+
+#include "cities.h"
+#include "city_cluster.h"
+#include "city_grid.h"
+#include "geo.h"
+#include "work_pool.h"
+
+// Keep the grid within bounds for very small or large radii
+#define CLUSTER_MIN_CELL_DEG 0.05
+#define CLUSTER_MAX_CELL_DEG 10.0
+
+typedef struct
+{
+    double eps_km;
+    int min_points;
+    city_grid grid;
+    int **neighbours;      // per-thread scratch space for city_grid_neighbours
+    bool *core;
+    atomic_int *parent;    // union-find forest over the core points
+    int *cluster_ids;
+} cluster_state;
+
+// Returns the root of the set holding x, halving the path on the way
+static int find_root(atomic_int *parent, int x);
+
+// Merges the sets holding a and b; the smaller index becomes the root
+static void union_sets(atomic_int *parent, int a, int b);
+
+// The three parallel phases, one task per grid cell; most cells are empty
+// at small radii, and those return before listing their neighbours
+static void count_neighbours(int task, int worker, void *arg);
+static void link_cores(int task, int worker, void *arg);
+static void attach_borders(int task, int worker, void *arg);
+
+int city_cluster(double eps_km, int min_points, int threads, int *cluster_ids)
+{
+    cluster_state s;
+    s.eps_km = eps_km;
+    s.min_points = min_points;
+    s.cluster_ids = cluster_ids;
+
+    double cell_deg = eps_km / CITY_GRID_KM_PER_DEG;
+    cell_deg = fmax(CLUSTER_MIN_CELL_DEG, fmin(CLUSTER_MAX_CELL_DEG, cell_deg));
+    if (!city_grid_build(&s.grid, city_count, &cities[0].coord, sizeof(city), cell_deg))
+    {
+        return -1;
+    }
+
+    if (threads <= 0)
+    {
+        threads = work_pool_default_threads();
+    }
+    int n = city_count > 0 ? city_count : 1;
+    s.core = malloc(sizeof(bool) * n);
+    s.parent = malloc(sizeof(atomic_int) * n);
+    s.neighbours = calloc(threads, sizeof(int *));
+    bool ok = s.core && s.parent && s.neighbours;
+    for (int i = 0; ok && i < threads; i++)
+    {
+        s.neighbours[i] = malloc(sizeof(int) * city_grid_max_neighbours(&s.grid, eps_km));
+        ok = s.neighbours[i] != NULL;
+    }
+
+    int clusters = -1;
+    if (ok)
+    {
+        for (int i = 0; i < city_count; i++)
+        {
+            atomic_init(&s.parent[i], i);
+        }
+
+        int cell_count = s.grid.rows * s.grid.cols;
+        work_pool_run(cell_count, threads, count_neighbours, &s);
+        work_pool_run(cell_count, threads, link_cores, &s);
+
+        // Number the clusters by their roots, which are their first entries
+        clusters = 0;
+        for (int i = 0; i < city_count; i++)
+        {
+            if (s.core[i] && find_root(s.parent, i) == i)
+            {
+                cluster_ids[i] = clusters++;
+            }
+        }
+        for (int i = 0; i < city_count; i++)
+        {
+            cluster_ids[i] = s.core[i] ? cluster_ids[find_root(s.parent, i)] : CLUSTER_NOISE;
+        }
+
+        work_pool_run(cell_count, threads, attach_borders, &s);
+    }
+
+    for (int i = 0; s.neighbours && i < threads; i++)
+    {
+        free(s.neighbours[i]);
+    }
+    free(s.neighbours);
+    free(s.parent);
+    free(s.core);
+    city_grid_destroy(&s.grid);
+    return clusters;
+}
+
+static void count_neighbours(int task, int worker, void *arg)
+{
+    cluster_state *s = arg;
+    const city_grid *g = &s->grid;
+    if (g->start[task] == g->start[task + 1])
+    {
+        return;
+    }
+    int *cells = s->neighbours[worker];
+    int cell_count = city_grid_neighbours(g, task, s->eps_km, cells);
+
+    for (int i = g->start[task]; i < g->start[task + 1]; i++)
+    {
+        int p = g->items[i];
+        int count = 0;
+        for (int k = 0; k < cell_count && count < s->min_points; k++)
+        {
+            for (int j = g->start[cells[k]]; j < g->start[cells[k] + 1] && count < s->min_points; j++)
+            {
+                if (geo_spherical_km(&cities[p].coord, &cities[g->items[j]].coord) <= s->eps_km)
+                {
+                    count++;
+                }
+            }
+        }
+        s->core[p] = count >= s->min_points;
+    }
+}
+
+static void link_cores(int task, int worker, void *arg)
+{
+    cluster_state *s = arg;
+    const city_grid *g = &s->grid;
+    if (g->start[task] == g->start[task + 1])
+    {
+        return;
+    }
+    int *cells = s->neighbours[worker];
+    int cell_count = city_grid_neighbours(g, task, s->eps_km, cells);
+
+    for (int i = g->start[task]; i < g->start[task + 1]; i++)
+    {
+        int p = g->items[i];
+        if (!s->core[p])
+        {
+            continue;
+        }
+        for (int k = 0; k < cell_count; k++)
+        {
+            for (int j = g->start[cells[k]]; j < g->start[cells[k] + 1]; j++)
+            {
+                // Each pair is linked once, from its smaller index
+                int q = g->items[j];
+                if (q > p && s->core[q]
+                    && find_root(s->parent, p) != find_root(s->parent, q)
+                    && geo_spherical_km(&cities[p].coord, &cities[q].coord) <= s->eps_km)
+                {
+                    union_sets(s->parent, p, q);
+                }
+            }
+        }
+    }
+}
+
+static void attach_borders(int task, int worker, void *arg)
+{
+    cluster_state *s = arg;
+    const city_grid *g = &s->grid;
+    if (g->start[task] == g->start[task + 1])
+    {
+        return;
+    }
+    int *cells = s->neighbours[worker];
+    int cell_count = city_grid_neighbours(g, task, s->eps_km, cells);
+
+    for (int i = g->start[task]; i < g->start[task + 1]; i++)
+    {
+        int p = g->items[i];
+        if (s->core[p])
+        {
+            continue;
+        }
+
+        // Join the nearest core point, the smaller index on ties
+        int nearest = -1;
+        double nearest_km = 0;
+        for (int k = 0; k < cell_count; k++)
+        {
+            for (int j = g->start[cells[k]]; j < g->start[cells[k] + 1]; j++)
+            {
+                int q = g->items[j];
+                if (!s->core[q])
+                {
+                    continue;
+                }
+                double d = geo_spherical_km(&cities[p].coord, &cities[q].coord);
+                if (d <= s->eps_km && (nearest < 0 || d < nearest_km || (d == nearest_km && q < nearest)))
+                {
+                    nearest = q;
+                    nearest_km = d;
+                }
+            }
+        }
+
+        // Core ids are final by now, and only non-core ids are written here
+        if (nearest >= 0)
+        {
+            s->cluster_ids[p] = s->cluster_ids[nearest];
+        }
+    }
+}
+
+static int find_root(atomic_int *parent, int x)
+{
+    while (true)
+    {
+        int p = atomic_load(&parent[x]);
+        if (p == x)
+        {
+            return x;
+        }
+        int gp = atomic_load(&parent[p]);
+        if (gp != p)
+        {
+            // Losing this race only means the path isn't shortened
+            atomic_compare_exchange_weak(&parent[x], &p, gp);
+        }
+        x = gp;
+    }
+}
+
+static void union_sets(atomic_int *parent, int a, int b)
+{
+    while (true)
+    {
+        a = find_root(parent, a);
+        b = find_root(parent, b);
+        if (a == b)
+        {
+            return;
+        }
+        if (a > b)
+        {
+            int t = a;
+            a = b;
+            b = t;
+        }
+
+        // Hang the larger root under the smaller one, unless b stopped
+        // being a root in the meantime, in which case start over
+        int expected = b;
+        if (atomic_compare_exchange_strong(&parent[b], &expected, a))
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef __CITY_CLUSTER_H__
+#define __CITY_CLUSTER_H__
+
+// The cluster id of points that belong to no cluster
+#define CLUSTER_NOISE -1
+
+/**
+ * Groups the entries of cities[] into clusters with DBSCAN: an entry with
+ * at least min_points entries (itself included) within eps_km is a core
+ * point, core points within eps_km of each other share a cluster, and any
+ * other entry within eps_km of a core point joins the cluster of the
+ * nearest one.  Neighbour queries go through a grid with eps_km cells and
+ * every phase runs on a work-stealing pool.  Clusters are numbered from 0
+ * in order of their first entry, so the result does not depend on the
+ * number of threads.
+ *
+ * @param eps_km the neighbourhood radius in kilometers, positive
+ * @param min_points the number of neighbours that makes a core point
+ * @param threads the number of threads to use; 0 for one per processor
+ * @param cluster_ids an array that can hold city_count ints, filled in
+ *        with the cluster of each entry of cities[] or CLUSTER_NOISE
+ * @return the number of clusters, or -1 if memory could not be allocated
+ */
+int city_cluster(double eps_km, int min_points, int threads, int *cluster_ids);
+
+#endif
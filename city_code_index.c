@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cities.h"
+#include "city_code_index.h"
+#include "city_init.h"
+
+// The longest code passed through to find_city by the fallback
+#define FALLBACK_CODE_MAX 63
+
+// Maps one character to its digit in the key, or -1
+static int code_digit(char c);
+
+int city_code_key(const char *code, size_t length)
+{
+    if (length != 3)
+    {
+        return -1;
+    }
+    int d0 = code_digit(code[0]);
+    int d1 = code_digit(code[1]);
+    int d2 = code_digit(code[2]);
+    if ((d0 | d1 | d2) < 0)
+    {
+        return -1;
+    }
+    return (d0 * 36 + d1) * 36 + d2;
+}
+
+void city_code_from_key(int key, char *code)
+{
+    static const char digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    code[0] = digits[key / (36 * 36)];
+    code[1] = digits[key / 36 % 36];
+    code[2] = digits[key % 36];
+    code[3] = '\0';
+}
+
+bool city_code_index_build(city_code_index *index)
+{
+    index->coords = malloc(sizeof(location) * CODE_KEY_COUNT);
+    index->present = calloc((CODE_KEY_COUNT + 7) / 8, 1);
+    if (!index->coords || !index->present)
+    {
+        city_code_index_destroy(index);
+        return false;
+    }
+
+    // The first find_city() of a lazy database sorts cities[] in place,
+    // which would reorder the table under this loop, so get that done
+    // before walking it
+    wait_city_database();
+    for (int i = 0; i < city_count; i++)
+    {
+        int key = city_code_key(cities[i].name, strlen(cities[i].name));
+        if (key >= 0 && !(index->present[key / 8] & (1 << (key % 8))))
+        {
+            // Ask find_city so that duplicates resolve the same way
+            find_city(cities[i].name, &index->coords[key]);
+            index->present[key / 8] |= 1 << (key % 8);
+        }
+    }
+    return true;
+}
+
+void city_code_index_destroy(city_code_index *index)
+{
+    free(index->coords);
+    free(index->present);
+    index->coords = NULL;
+    index->present = NULL;
+}
+
+bool city_code_index_contains(const city_code_index *index, int key)
+{
+    return key >= 0 && (index->present[key / 8] & (1 << (key % 8)));
+}
+
+bool city_code_index_find(const city_code_index *index, const char *code, size_t length, location *loc)
+{
+    int key = city_code_key(code, length);
+    if (key >= 0)
+    {
+        if (!(index->present[key / 8] & (1 << (key % 8))))
+        {
+            return false;
+        }
+        *loc = index->coords[key];
+        return true;
+    }
+
+    // Codes of other shapes can still be in cities[]
+    char buffer[FALLBACK_CODE_MAX + 1];
+    if (length > FALLBACK_CODE_MAX)
+    {
+        return false;
+    }
+    memcpy(buffer, code, length);
+    buffer[length] = '\0';
+    return find_city(buffer, loc);
+}
+
+static int code_digit(char c)
+{
+    // Digits first, as in ASCII, so that keys sort like strcmp on codes
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'Z')
+    {
+        return 10 + (c - 'A');
+    }
+    return -1;
+}
@@ -0,0 +1,77 @@
+#ifndef __CITY_CODE_INDEX_H__
+#define __CITY_CODE_INDEX_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "location.h"
+
+// The number of distinct 3-character codes of uppercase letters and digits
+#define CODE_KEY_COUNT (36 * 36 * 36)
+
+// A direct-mapped index over the 3-character codes in cities[]: every
+// such code has its own slot, so a lookup is one multiply-add and one load
+// with no comparisons.  Other codes fall back to find_city().
+typedef struct
+{
+    location *coords;        // CODE_KEY_COUNT slots
+    unsigned char *present;  // one bit per slot
+} city_code_index;
+
+/**
+ * Returns the dense key of a 3-character code of uppercase letters and
+ * digits, in [0, CODE_KEY_COUNT), or -1 for any other code.  Keys are in
+ * the same order as the codes are by strcmp.
+ *
+ * @param code the characters of the code, not necessarily terminated
+ * @param length the number of characters
+ */
+int city_code_key(const char *code, size_t length);
+
+/**
+ * Writes the code with the given dense key into code, '\0'-terminated.
+ *
+ * @param key a key returned by city_code_key
+ * @param code an array of at least 4 chars
+ */
+void city_code_from_key(int key, char *code);
+
+/**
+ * Fills in an index over cities[].  Where a code appears more than once
+ * the slot holds the entry find_city() would return once the database
+ * is initialized, so the two always agree.  The database is initialized
+ * (or waited for, if it is being prepared in the background) first,
+ * since that may reorder cities[].
+ *
+ * @param index the index to fill in
+ * @return true if successful, false if memory could not be allocated
+ */
+bool city_code_index_build(city_code_index *index);
+
+/**
+ * Frees the memory held by the given index.
+ *
+ * @param index an index filled in by city_code_index_build
+ */
+void city_code_index_destroy(city_code_index *index);
+
+/**
+ * Returns true if the code with the given key is in the given index.
+ *
+ * @param index an index filled in by city_code_index_build
+ * @param key a key returned by city_code_key, or -1
+ */
+bool city_code_index_contains(const city_code_index *index, int key);
+
+/**
+ * Looks a code up in the given index, like find_city().
+ *
+ * @param index an index filled in by city_code_index_build
+ * @param code the characters of the code, not necessarily terminated
+ * @param length the number of characters
+ * @param loc set to its location if found
+ * @return true if the code was found, false otherwise
+ */
+bool city_code_index_find(const city_code_index *index, const char *code, size_t length, location *loc);
+
+#endif
@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cities.h"
+#include "city_proto.h"
+
+#define MAX_EVENTS 64
+#define READ_CHUNK (64 * 1024)
+
+// A client stops being read while its output buffer holds this much, so
+// one that sends faster than it reads can't make the daemon buffer without
+// bound
+#define MAX_PENDING_OUTPUT (1024 * 1024)
+
+// The bytes read from and to be written to one client
+typedef struct
+{
+    int fd;
+    char *in;
+    size_t in_used;
+    size_t in_size;
+    char *out;
+    size_t out_sent;
+    size_t out_used;
+    size_t out_size;
+    bool eof;  // the client has shut down its side; answer and close
+} client;
+
+/**
+ * Makes sure the given buffer can hold at least needed bytes.
+ *
+ * @param buffer the buffer, reallocated as necessary
+ * @param size its capacity, updated as necessary
+ * @param needed the capacity required
+ * @return true if successful, false if memory could not be allocated
+ */
+bool reserve(char **buffer, size_t *size, size_t needed);
+
+/**
+ * Answers every complete request in the client's input buffer, appending
+ * the responses to its output buffer.
+ *
+ * @param c a client
+ * @return true if successful, false if a request was malformed or memory
+ *         could not be allocated, in which case the client is dropped
+ */
+bool answer_requests(client *c);
+
+/**
+ * Reads and answers what is available from the client, until its output
+ * buffer holds MAX_PENDING_OUTPUT.  At the end of its input, sets eof
+ * once everything complete has been answered.
+ *
+ * @param c a client
+ * @return false if the client must be dropped
+ */
+bool read_client(client *c);
+
+/**
+ * Writes as much of the client's pending output as the socket takes.  Once
+ * at least half of the buffer has been sent, the rest is moved to the
+ * front, so the buffer never holds more than twice what is unsent.
+ *
+ * @param c a client
+ * @return false if the client must be dropped
+ */
+bool write_client(client *c);
+
+void close_client(int epoll_fd, client *c);
+
+int main(int argc, char **argv)
+{
+    // Usage: city_daemon [-s socket_path]
+    const char *path = CITY_SOCKET_PATH;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i < argc - 1)
+        {
+            path = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "%s: usage: %s [-s socket_path]\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    initialize_city_database();
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "%s: socket path too long\n", argv[0]);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 128) < 0)
+    {
+        fprintf(stderr, "%s: could not listen on %s: %s\n", argv[0], path, strerror(errno));
+        return 1;
+    }
+
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;  // NULL marks the listening socket
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (true)
+    {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "%s: epoll_wait: %s\n", argv[0], strerror(errno));
+            return 1;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            client *c = events[i].data.ptr;
+
+            // Accept every waiting connection
+            if (!c)
+            {
+                int fd;
+                while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0)
+                {
+                    client *new_client = calloc(1, sizeof(client));
+                    if (!new_client)
+                    {
+                        close(fd);
+                        continue;
+                    }
+                    new_client->fd = fd;
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = new_client;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+                }
+                continue;
+            }
+
+            bool ok = true;
+            if (!c->eof && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+            {
+                ok = read_client(c);
+            }
+            if (ok)
+            {
+                ok = write_client(c);
+            }
+
+            // A client that has shut down its side is closed once all of
+            // its answers are out
+            if (!ok || (c->eof && c->out_sent == c->out_used))
+            {
+                close_client(epoll_fd, c);
+                continue;
+            }
+
+            // Only wait for the socket to drain while there is output left,
+            // and stop reading while the output buffer is full
+            size_t pending = c->out_used - c->out_sent;
+            ev.events = (!c->eof && c->out_used < MAX_PENDING_OUTPUT ? EPOLLIN : 0) | (pending > 0 ? EPOLLOUT : 0);
+            ev.data.ptr = c;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+        }
+    }
+}
+
+bool read_client(client *c)
+{
+    // Each chunk read is answered in one go, which batches the writes of
+    // pipelined requests too; they are sent after the reading stops
+    while (c->out_used < MAX_PENDING_OUTPUT)
+    {
+        if (!reserve(&c->in, &c->in_size, c->in_used + READ_CHUNK))
+        {
+            return false;
+        }
+        ssize_t got = read(c->fd, c->in + c->in_used, c->in_size - c->in_used);
+        if (got > 0)
+        {
+            c->in_used += got;
+            if (!answer_requests(c))
+            {
+                return false;
+            }
+        }
+        else if (got == 0)
+        {
+            // Whatever is left is an unfinished request, never answered
+            c->eof = true;
+            break;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            break;
+        }
+        else if (errno != EINTR)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool answer_requests(client *c)
+{
+    size_t pos = 0;
+    while (c->in_used - pos >= sizeof(city_msg_header))
+    {
+        city_msg_header request;
+        memcpy(&request, c->in + pos, sizeof(request));
+        if (request.count > CITY_MAX_BATCH || request.length > request.count * (CITY_MAX_CODE_LENGTH + 1))
+        {
+            return false;
+        }
+        if (c->in_used - pos - sizeof(request) < request.length)
+        {
+            // Wait for the rest of this request
+            break;
+        }
+
+        city_msg_header response = request;
+        response.length = request.count * sizeof(city_answer);
+        if (!reserve(&c->out, &c->out_size, c->out_used + sizeof(response) + response.length))
+        {
+            return false;
+        }
+        memcpy(c->out + c->out_used, &response, sizeof(response));
+        c->out_used += sizeof(response);
+
+        const char *body = c->in + pos + sizeof(request);
+        size_t offset = 0;
+        for (uint32_t k = 0; k < request.count; k++)
+        {
+            char code[CITY_MAX_CODE_LENGTH + 1];
+            if (offset >= request.length)
+            {
+                return false;
+            }
+            size_t len = (unsigned char)body[offset];
+            if (len > CITY_MAX_CODE_LENGTH || offset + 1 + len > request.length)
+            {
+                return false;
+            }
+            memcpy(code, body + offset + 1, len);
+            code[len] = '\0';
+            offset += 1 + len;
+
+            city_answer answer;
+            location loc;
+            if (find_city(code, &loc))
+            {
+                answer.lat = loc.lat;
+                answer.lon = loc.lon;
+            }
+            else
+            {
+                answer.lat = NAN;
+                answer.lon = NAN;
+            }
+            memcpy(c->out + c->out_used, &answer, sizeof(answer));
+            c->out_used += sizeof(answer);
+        }
+        pos += sizeof(request) + request.length;
+    }
+
+    // Keep only the partial request, if any
+    memmove(c->in, c->in + pos, c->in_used - pos);
+    c->in_used -= pos;
+    return true;
+}
+
+bool write_client(client *c)
+{
+    while (c->out_sent < c->out_used)
+    {
+        ssize_t sent = write(c->fd, c->out + c->out_sent, c->out_used - c->out_sent);
+        if (sent > 0)
+        {
+            c->out_sent += sent;
+        }
+        else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if (c->out_sent >= c->out_used - c->out_sent)
+            {
+                memmove(c->out, c->out + c->out_sent, c->out_used - c->out_sent);
+                c->out_used -= c->out_sent;
+                c->out_sent = 0;
+            }
+            return true;
+        }
+        else if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    c->out_sent = 0;
+    c->out_used = 0;
+    return true;
+}
+
+void close_client(int epoll_fd, client *c)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+bool reserve(char **buffer, size_t *size, size_t needed)
+{
+    if (needed <= *size)
+    {
+        return true;
+    }
+    size_t new_size = *size ? *size : READ_CHUNK;
+    while (new_size < needed)
+    {
+        new_size *= 2;
+    }
+    char *bigger = realloc(*buffer, new_size);
+    if (!bigger)
+    {
+        return false;
+    }
+    *buffer = bigger;
+    *size = new_size;
+    return true;
+}
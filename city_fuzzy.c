@@ -0,0 +1,317 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "city_fuzzy.h"
+
+// The most deletion strings of one code: itself, one character gone, two
+#define FUZZY_MAX_VARIANTS (1 + FUZZY_MAX_CODE + FUZZY_MAX_CODE * (FUZZY_MAX_CODE - 1) / 2)
+
+// One deletion string of one code
+typedef struct
+{
+    uint64_t hash;
+    uint32_t entry;
+} fuzzy_key;
+
+struct city_fuzzy
+{
+    int max_distance;
+    int count;
+    const city **entries;  // the distinct codes
+    fuzzy_key *keys;       // sorted by hash, then entry
+    size_t key_count;
+};
+
+// Writes the distinct hashes of the strings a code turns into after
+// deleting up to depth characters and returns how many there are
+static int variants(const char *code, int length, int depth, uint64_t *hashes);
+
+// Hashes the characters of code other than those at skip1 and skip2
+static uint64_t hash_without(const char *code, int length, int skip1, int skip2);
+
+// Returns the Levenshtein distance between two codes, or limit + 1 if
+// it's more than limit
+static int edit_distance(const char *a, const char *b, int limit);
+
+// Orders keys by hash, then entry, for qsort
+static int compare_keys(const void *a, const void *b);
+
+// Orders 64-bit hashes or 32-bit entries, for qsort
+static int compare_hashes(const void *a, const void *b);
+static int compare_entries(const void *a, const void *b);
+
+// Orders matches by distance, then code, for qsort
+static int compare_matches(const void *a, const void *b);
+
+city_fuzzy *city_fuzzy_build(int n, const city *table, int max_distance)
+{
+    if (max_distance < 1 || max_distance > FUZZY_MAX_DISTANCE)
+    {
+        return NULL;
+    }
+    city_fuzzy *fuzzy = calloc(1, sizeof(city_fuzzy));
+    if (!fuzzy)
+    {
+        return NULL;
+    }
+    fuzzy->max_distance = max_distance;
+
+    // The table is sorted, so duplicates are neighbours
+    fuzzy->entries = malloc(sizeof(city *) * (n > 0 ? n : 1));
+    size_t capacity = 0;
+    for (int i = 0; fuzzy->entries && i < n; i++)
+    {
+        size_t length = strlen(table[i].name);
+        if (length > FUZZY_MAX_CODE)
+        {
+            continue;
+        }
+        if (fuzzy->count == 0 || strcmp(fuzzy->entries[fuzzy->count - 1]->name, table[i].name) != 0)
+        {
+            fuzzy->entries[fuzzy->count++] = &table[i];
+            capacity += 1 + length + (max_distance > 1 ? length * (length - 1) / 2 : 0);
+        }
+    }
+
+    fuzzy->keys = malloc(sizeof(fuzzy_key) * (capacity > 0 ? capacity : 1));
+    if (!fuzzy->entries || !fuzzy->keys)
+    {
+        city_fuzzy_destroy(fuzzy);
+        return NULL;
+    }
+
+    uint64_t hashes[FUZZY_MAX_VARIANTS];
+    for (int e = 0; e < fuzzy->count; e++)
+    {
+        const char *code = fuzzy->entries[e]->name;
+        int count = variants(code, strlen(code), max_distance, hashes);
+        for (int v = 0; v < count; v++)
+        {
+            fuzzy->keys[fuzzy->key_count].hash = hashes[v];
+            fuzzy->keys[fuzzy->key_count].entry = e;
+            fuzzy->key_count++;
+        }
+    }
+    qsort(fuzzy->keys, fuzzy->key_count, sizeof(fuzzy_key), compare_keys);
+    return fuzzy;
+}
+
+void city_fuzzy_destroy(city_fuzzy *fuzzy)
+{
+    if (fuzzy)
+    {
+        free(fuzzy->entries);
+        free(fuzzy->keys);
+        free(fuzzy);
+    }
+}
+
+int city_fuzzy_find(const city_fuzzy *fuzzy, const char *code, int max_distance, fuzzy_match *matches, int capacity)
+{
+    size_t length = strlen(code);
+    if (length > FUZZY_MAX_CODE || max_distance < 0)
+    {
+        return 0;
+    }
+    if (max_distance > fuzzy->max_distance)
+    {
+        max_distance = fuzzy->max_distance;
+    }
+
+    // Gather every entry that shares a deletion string with the query
+    uint64_t hashes[FUZZY_MAX_VARIANTS];
+    int variant_count = variants(code, length, max_distance, hashes);
+    int candidate_count = 0;
+    int candidate_capacity = 64;
+    uint32_t *candidates = malloc(sizeof(uint32_t) * candidate_capacity);
+    for (int v = 0; candidates && v < variant_count; v++)
+    {
+        size_t lo = 0;
+        size_t hi = fuzzy->key_count;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (fuzzy->keys[mid].hash < hashes[v])
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        for (size_t k = lo; k < fuzzy->key_count && fuzzy->keys[k].hash == hashes[v]; k++)
+        {
+            // Double the array when it's full
+            if (candidate_count == candidate_capacity)
+            {
+                candidate_capacity *= 2;
+                uint32_t *more = realloc(candidates, sizeof(uint32_t) * candidate_capacity);
+                if (!more)
+                {
+                    free(candidates);
+                    return 0;
+                }
+                candidates = more;
+            }
+            candidates[candidate_count++] = fuzzy->keys[k].entry;
+        }
+    }
+    if (!candidates)
+    {
+        return 0;
+    }
+
+    // Keep each entry once, and only if it really is close enough
+    qsort(candidates, candidate_count, sizeof(uint32_t), compare_entries);
+    fuzzy_match *found = malloc(sizeof(fuzzy_match) * (candidate_count > 0 ? candidate_count : 1));
+    int found_count = 0;
+    for (int c = 0; found && c < candidate_count; c++)
+    {
+        if (c > 0 && candidates[c] == candidates[c - 1])
+        {
+            continue;
+        }
+        const city *entry = fuzzy->entries[candidates[c]];
+        int distance = edit_distance(code, entry->name, max_distance);
+        if (distance <= max_distance)
+        {
+            found[found_count].code = entry->name;
+            found[found_count].coord = entry->coord;
+            found[found_count].distance = distance;
+            found_count++;
+        }
+    }
+    free(candidates);
+    if (!found)
+    {
+        return 0;
+    }
+
+    qsort(found, found_count, sizeof(fuzzy_match), compare_matches);
+    memcpy(matches, found, sizeof(fuzzy_match) * (found_count < capacity ? found_count : capacity));
+    free(found);
+    return found_count;
+}
+
+static int variants(const char *code, int length, int depth, uint64_t *hashes)
+{
+    int count = 0;
+    hashes[count++] = hash_without(code, length, -1, -1);
+    for (int i = 0; depth >= 1 && i < length; i++)
+    {
+        hashes[count++] = hash_without(code, length, i, -1);
+        for (int j = i + 1; depth >= 2 && j < length; j++)
+        {
+            hashes[count++] = hash_without(code, length, i, j);
+        }
+    }
+
+    // Repeated characters give the same string more than once
+    qsort(hashes, count, sizeof(uint64_t), compare_hashes);
+    int distinct = 0;
+    for (int v = 0; v < count; v++)
+    {
+        if (distinct == 0 || hashes[distinct - 1] != hashes[v])
+        {
+            hashes[distinct++] = hashes[v];
+        }
+    }
+    return distinct;
+}
+
+static uint64_t hash_without(const char *code, int length, int skip1, int skip2)
+{
+    // FNV-1a, then the MurmurHash3 finalizer to spread the bits
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < length; i++)
+    {
+        if (i != skip1 && i != skip2)
+        {
+            h = (h ^ (unsigned char)code[i]) * 0x100000001b3ULL;
+        }
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static int edit_distance(const char *a, const char *b, int limit)
+{
+    int la = strlen(a);
+    int lb = strlen(b);
+    if (la - lb > limit || lb - la > limit)
+    {
+        return limit + 1;
+    }
+
+    // Two rows of the usual table, giving up once a whole row is too far
+    int rows[2][FUZZY_MAX_CODE + 1];
+    int *previous = rows[0];
+    int *current = rows[1];
+    for (int j = 0; j <= lb; j++)
+    {
+        previous[j] = j;
+    }
+    for (int i = 1; i <= la; i++)
+    {
+        current[0] = i;
+        int best = current[0];
+        for (int j = 1; j <= lb; j++)
+        {
+            int cost = previous[j - 1] + (a[i - 1] != b[j - 1]);
+            int del = previous[j] + 1;
+            int ins = current[j - 1] + 1;
+            current[j] = cost < del ? (cost < ins ? cost : ins) : (del < ins ? del : ins);
+            best = current[j] < best ? current[j] : best;
+        }
+        if (best > limit)
+        {
+            return limit + 1;
+        }
+        int *swap = previous;
+        previous = current;
+        current = swap;
+    }
+    return previous[lb] <= limit ? previous[lb] : limit + 1;
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+    const fuzzy_key *x = a;
+    const fuzzy_key *y = b;
+    if (x->hash != y->hash)
+    {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return (x->entry > y->entry) - (x->entry < y->entry);
+}
+
+static int compare_hashes(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_matches(const void *a, const void *b)
+{
+    const fuzzy_match *x = a;
+    const fuzzy_match *y = b;
+    if (x->distance != y->distance)
+    {
+        return x->distance - y->distance;
+    }
+    return strcmp(x->code, y->code);
+}
@@ -0,0 +1,63 @@
+#ifndef __CITY_FUZZY_H__
+#define __CITY_FUZZY_H__
+
+#include "cities.h"
+
+// The largest edit distance an index can answer for
+#define FUZZY_MAX_DISTANCE 2
+
+// The longest code an index holds or looks up
+#define FUZZY_MAX_CODE 15
+
+// A typo-tolerant index over the codes of a city table, using deletion
+// neighbourhoods: every code is indexed under each string it turns into
+// after deleting up to max_distance of its characters, so two codes within
+// that many edits of each other share at least one such string.  Only the
+// 64-bit hashes of those strings are kept, sorted, with the code each came
+// from; a lookup hashes the deletions of its query, gathers the codes
+// under them and keeps those whose real edit distance is small enough.
+typedef struct city_fuzzy city_fuzzy;
+
+// One code found by city_fuzzy_find
+typedef struct
+{
+    const char *code;
+    location coord;
+    int distance;
+} fuzzy_match;
+
+/**
+ * Builds a fuzzy index over the given table.  Codes that appear more than
+ * once are only kept once, and codes longer than FUZZY_MAX_CODE are left
+ * out.  The table must outlive the index.
+ *
+ * @param n the number of entries
+ * @param table an array of n cities sorted by code
+ * @param max_distance the largest edit distance to support, from 1 to
+ *        FUZZY_MAX_DISTANCE
+ * @return a new index, or NULL if max_distance is out of range or memory
+ *         could not be allocated
+ */
+city_fuzzy *city_fuzzy_build(int n, const city *table, int max_distance);
+
+/**
+ * Frees the given index.
+ *
+ * @param fuzzy an index returned by city_fuzzy_build, or NULL
+ */
+void city_fuzzy_destroy(city_fuzzy *fuzzy);
+
+/**
+ * Finds the codes within the given Levenshtein distance of a code (one
+ * insertion, deletion or substitution each), closest first, then by code.
+ *
+ * @param fuzzy an index
+ * @param code a code
+ * @param max_distance at most the distance the index was built for
+ * @param matches an array that can hold capacity matches
+ * @param capacity the most matches to write
+ * @return the number of codes found, which may be more than capacity
+ */
+int city_fuzzy_find(const city_fuzzy *fuzzy, const char *code, int max_distance, fuzzy_match *matches, int capacity);
+
+#endif
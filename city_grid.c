@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "city_grid.h"
+
+#define PI 3.14159265358979323846
+
+// Returns the point at the given index of a strided array
+static const location *point_at(const location *points, size_t stride, int i);
+
+bool city_grid_build(city_grid *grid, int n, const location *points, size_t stride, double cell_deg)
+{
+    // The cell size is shrunk to divide 360 degrees exactly, so the
+    // columns that wrap around the antimeridian are as wide as the rest
+    grid->cols = (int)ceil(360.0 / cell_deg);
+    grid->cell_deg = 360.0 / grid->cols;
+    grid->rows = (grid->cols + 1) / 2;
+
+    int cell_count = grid->rows * grid->cols;
+    grid->start = calloc(cell_count + 1, sizeof(int));
+    grid->items = malloc(sizeof(int) * (n > 0 ? n : 1));
+    int *cell = malloc(sizeof(int) * (n > 0 ? n : 1));
+    if (!grid->start || !grid->items || !cell)
+    {
+        free(cell);
+        city_grid_destroy(grid);
+        return false;
+    }
+
+    // Counting sort of the points by cell: count, prefix sum, then place
+    for (int i = 0; i < n; i++)
+    {
+        cell[i] = city_grid_cell(grid, point_at(points, stride, i));
+        grid->start[cell[i] + 1]++;
+    }
+    for (int c = 0; c < cell_count; c++)
+    {
+        grid->start[c + 1] += grid->start[c];
+    }
+
+    int *fill = malloc(sizeof(int) * cell_count);
+    if (!fill)
+    {
+        free(cell);
+        city_grid_destroy(grid);
+        return false;
+    }
+    memcpy(fill, grid->start, sizeof(int) * cell_count);
+    for (int i = 0; i < n; i++)
+    {
+        grid->items[fill[cell[i]]++] = i;
+    }
+
+    free(fill);
+    free(cell);
+    return true;
+}
+
+void city_grid_destroy(city_grid *grid)
+{
+    free(grid->start);
+    free(grid->items);
+    grid->start = NULL;
+    grid->items = NULL;
+}
+
+int city_grid_cell(const city_grid *grid, const location *loc)
+{
+    // A latitude past a pole goes over it and comes down the far side of
+    // the earth, which is where the distance functions put it too
+    double lat = remainder(loc->lat, 360.0);
+    double lon = loc->lon;
+    if (lat > 90.0)
+    {
+        lat = 180.0 - lat;
+        lon += 180.0;
+    }
+    else if (lat < -90.0)
+    {
+        lat = -180.0 - lat;
+        lon += 180.0;
+    }
+    int row = (int)floor((lat + 90.0) / grid->cell_deg);
+    int col = (int)floor((lon + 180.0) / grid->cell_deg);
+
+    // Keep the poles in the edge rows and wrap the longitude into range
+    if (row < 0)
+    {
+        row = 0;
+    }
+    else if (row >= grid->rows)
+    {
+        row = grid->rows - 1;
+    }
+    col %= grid->cols;
+    if (col < 0)
+    {
+        col += grid->cols;
+    }
+    return row * grid->cols + col;
+}
+
+int city_grid_col_reach(const city_grid *grid, int row, double radius_km)
+{
+    // The highest latitude touched by the band of rows around this one
+    int row_reach = city_grid_row_reach(grid, radius_km);
+    double south = -90.0 + (row - row_reach) * grid->cell_deg;
+    double north = -90.0 + (row + row_reach + 1) * grid->cell_deg;
+    double lat = fmax(fabs(south), fabs(north));
+
+    int max_reach = grid->cols / 2;
+    if (lat >= 89.0)
+    {
+        return max_reach;
+    }
+
+    double lon_deg = radius_km / (CITY_GRID_KM_PER_DEG * cos(lat * PI / 180.0));
+    double reach = ceil(lon_deg / grid->cell_deg);
+    return reach > max_reach ? max_reach : (int)reach;
+}
+
+int city_grid_row_reach(const city_grid *grid, double radius_km)
+{
+    return (int)ceil(radius_km / CITY_GRID_KM_PER_DEG / grid->cell_deg);
+}
+
+int city_grid_neighbours(const city_grid *grid, int cell, double radius_km, int *cells)
+{
+    int row = cell / grid->cols;
+    int col = cell % grid->cols;
+    int row_reach = city_grid_row_reach(grid, radius_km);
+    int col_reach = city_grid_col_reach(grid, row, radius_km);
+    int col_span = 2 * col_reach + 1 < grid->cols ? 2 * col_reach + 1 : grid->cols;
+    int count = 0;
+
+    for (int r = row - row_reach; r <= row + row_reach; r++)
+    {
+        if (r < 0 || r >= grid->rows)
+        {
+            continue;
+        }
+        for (int k = 0; k < col_span; k++)
+        {
+            int c = ((col - col_reach + k) % grid->cols + grid->cols) % grid->cols;
+            cells[count++] = r * grid->cols + c;
+        }
+    }
+    return count;
+}
+
+int city_grid_max_neighbours(const city_grid *grid, double radius_km)
+{
+    int rows = 2 * city_grid_row_reach(grid, radius_km) + 1;
+    return (rows < grid->rows ? rows : grid->rows) * grid->cols;
+}
+
+static const location *point_at(const location *points, size_t stride, int i)
+{
+    return (const location *)((const char *)points + stride * i);
+}
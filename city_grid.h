@@ -0,0 +1,102 @@
+#ifndef __CITY_GRID_H__
+#define __CITY_GRID_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "location.h"
+
+// A bucket grid over latitude and longitude.  Cell (row, col) holds the
+// indices of the points with lat in [-90 + row * cell_deg, ...) and lon in
+// [-180 + col * cell_deg, ...); columns wrap around at the antimeridian,
+// and cell_deg divides 360 so that they are all the same width.  A point
+// with a latitude past a pole, such as -100, is bucketed where it lands
+// over the pole, at -80 on the opposite meridian.
+typedef struct
+{
+    double cell_deg;
+    int rows;
+    int cols;
+    int *start;  // cell c holds items[start[c]] to items[start[c + 1] - 1]
+    int *items;  // point indices, grouped by cell
+} city_grid;
+
+/**
+ * Buckets n points into a grid with the given cell size.  The points are
+ * read as the location at points + i * stride bytes, so both an array of
+ * locations and the coord field of an array of cities can be indexed
+ * without copying, e.g. city_grid_build(&g, city_count, &cities[0].coord,
+ * sizeof(city), 0.5).
+ *
+ * @param grid the grid to fill in
+ * @param n a nonnegative integer
+ * @param points the location of point 0
+ * @param stride the distance in bytes between consecutive points
+ * @param cell_deg the cell size in degrees, positive; the grid uses the
+ *        largest size at most this that divides 360 degrees
+ * @return true if successful, false if memory could not be allocated
+ */
+bool city_grid_build(city_grid *grid, int n, const location *points, size_t stride, double cell_deg);
+
+/**
+ * Frees the memory held by the given grid.
+ *
+ * @param grid a grid filled in by city_grid_build
+ */
+void city_grid_destroy(city_grid *grid);
+
+/**
+ * Returns the index of the cell containing the given location.
+ *
+ * @param grid a grid filled in by city_grid_build
+ * @param loc a location
+ */
+int city_grid_cell(const city_grid *grid, const location *loc);
+
+/**
+ * Returns how many columns on each side of a cell in the given row must be
+ * visited to cover every point within radius_km of a point in that row;
+ * this grows towards the poles and is capped at half the columns.  Callers
+ * visit the min(2 * reach + 1, cols) columns starting at col - reach
+ * (wrapping around) so that no column is visited twice.
+ *
+ * @param grid a grid filled in by city_grid_build
+ * @param row a row of the grid
+ * @param radius_km a nonnegative distance in kilometers
+ */
+int city_grid_col_reach(const city_grid *grid, int row, double radius_km);
+
+/**
+ * Returns how many rows above and below must be visited to cover every
+ * point within radius_km.
+ *
+ * @param grid a grid filled in by city_grid_build
+ * @param radius_km a nonnegative distance in kilometers
+ */
+int city_grid_row_reach(const city_grid *grid, double radius_km);
+
+/**
+ * Fills in the indices of the cells that must be visited to find every
+ * point within radius_km of a point in the given cell, each cell once.
+ *
+ * @param grid a grid filled in by city_grid_build
+ * @param cell a cell of the grid
+ * @param radius_km a nonnegative distance in kilometers
+ * @param cells an array that can hold city_grid_max_neighbours cells
+ * @return the number of cells written to cells
+ */
+int city_grid_neighbours(const city_grid *grid, int cell, double radius_km, int *cells);
+
+/**
+ * Returns an upper bound on what city_grid_neighbours returns for the
+ * given radius.
+ *
+ * @param grid a grid filled in by city_grid_build
+ * @param radius_km a nonnegative distance in kilometers
+ */
+int city_grid_max_neighbours(const city_grid *grid, double radius_km);
+
+// The length of one degree of latitude, in kilometers
+#define CITY_GRID_KM_PER_DEG 111.19492664455873
+
+#endif
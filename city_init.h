@@ -0,0 +1,65 @@
+#ifndef __CITY_INIT_H__
+#define __CITY_INIT_H__
+
+#include <stdbool.h>
+
+// Ways to get the city database ready, besides calling
+// initialize_city_database() up front:
+//
+// Lazy: just call find_city().  The first lookup sorts cities[] (once,
+// even if many threads get there together) and later lookups go straight
+// to the binary search without taking a lock.
+//
+// Async: call start_city_database_async() and start looking codes up
+// right away.  A background thread sorts a copy of cities[] while
+// lookups scan the unsorted table; once the copy is ready lookups switch
+// to it.  cities[] itself is left in its original order in this mode.
+
+/**
+ * Starts sorting the city database on a background thread.  Does nothing
+ * if the database is already ready or being prepared, in either mode.
+ *
+ * @return true if successful, false if the thread or the memory for the
+ *         copy could not be had, in which case the database is
+ *         initialized before returning
+ */
+bool start_city_database_async();
+
+/**
+ * Waits until the city database is sorted, initializing it now if
+ * nothing else has.
+ */
+void wait_city_database();
+
+/**
+ * Asks for a minimal perfect hash (see city_phash.h) to be built over the
+ * database when it is initialized, which find_city then uses instead of
+ * the binary search.  Must be called before anything initializes the
+ * database to have an effect.
+ *
+ * @param on true to build the hash, false (the default) not to
+ */
+void use_city_perfect_hash(bool on);
+
+/**
+ * Returns true if lookups use the sorted database, false while they
+ * would still have to scan or sort first.
+ */
+bool city_database_ready();
+
+/**
+ * Returns a number that changes whenever the entries of cities[] are
+ * rearranged or edited, so that results cached by position in cities[]
+ * can tell when they are stale.
+ */
+unsigned long city_database_version();
+
+/**
+ * Tells caches over cities[] that its entries were edited in place.  If
+ * the database was already initialized, it is sorted again from cities[]
+ * and its perfect hash (if any) is rebuilt, so find_city sees the edits.
+ * Must not be called while other threads are looking cities up.
+ */
+void city_database_changed();
+
+#endif
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cities.h"
+#include "city_init.h"
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+int main(int argc, char **argv)
+{
+    // Usage: city_init_bench eager|lazy|async [code...]
+    // Each mode needs a fresh process since the database is only ever
+    // initialized once; the default codes are two that exist
+    if (argc < 2 || (strcmp(argv[1], "eager") != 0 && strcmp(argv[1], "lazy") != 0 && strcmp(argv[1], "async") != 0))
+    {
+        fprintf(stderr, "%s: usage: %s eager|lazy|async [code...]\n", argv[0], argv[0]);
+        return 1;
+    }
+    const char *default_codes[] = {"JFK", "LHR"};
+    const char **codes = argc > 2 ? (const char **)argv + 2 : default_codes;
+    int code_count = argc > 2 ? argc - 2 : 2;
+
+    double start = now();
+    if (strcmp(argv[1], "eager") == 0)
+    {
+        initialize_city_database();
+    }
+    else if (strcmp(argv[1], "async") == 0)
+    {
+        start_city_database_async();
+    }
+
+    double first = 0;
+    for (int i = 0; i < code_count; i++)
+    {
+        location loc;
+        bool found = find_city(codes[i], &loc);
+        if (i == 0)
+        {
+            first = now() - start;
+        }
+        if (found)
+        {
+            printf("%s: %f %f\n", codes[i], loc.lat, loc.lon);
+        }
+        else
+        {
+            printf("%s: not found\n", codes[i]);
+        }
+    }
+    double answered = now() - start;
+
+    wait_city_database();
+    double ready = now() - start;
+
+    printf("%s: first answer %.1f us, all %d answers %.1f us, sorted %.1f us\n",
+           argv[1], first * 1e6, code_count, answered * 1e6, ready * 1e6);
+    return 0;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "cities.h"
+#include "city_grid.h"
+#include "city_join.h"
+#include "geo.h"
+#include "work_pool.h"
+
+// Size of the block each thread fills before writing it out
+#define JOIN_BUFFER_SIZE (64 * 1024)
+
+// The cell size is the radius (so only neighbouring cells are visited)
+// but kept within bounds so the grid is neither huge nor useless
+#define JOIN_MIN_CELL_DEG 0.25
+#define JOIN_MAX_CELL_DEG 10.0
+
+typedef struct
+{
+    char *data;
+    size_t used;
+    long matches;
+    int *neighbours;  // scratch space for city_grid_neighbours
+} join_buffer;
+
+typedef struct
+{
+    const location *stations;
+    const int64_t *ids;
+    double radius_km;
+    join_format format;
+    FILE *out;
+    pthread_mutex_t out_lock;
+    city_grid airports;
+    city_grid points;
+    int *tasks;  // the nonempty cells of the station grid
+    join_buffer *buffers;
+} join_state;
+
+// Writes the given buffer out under the output lock and empties it
+static void flush_buffer(join_state *s, join_buffer *b);
+
+// Appends one match to the given buffer, flushing it first if it's full
+static void emit_match(join_state *s, join_buffer *b, int station, int airport, double distance);
+
+// Joins the stations in one cell of the station grid
+static void join_cell(int task, int worker, void *arg);
+
+long city_join(int n, const location *stations, const int64_t *ids, double radius_km, int threads, join_format format, FILE *out)
+{
+    join_state s;
+    s.stations = stations;
+    s.ids = ids;
+    s.radius_km = radius_km;
+    s.format = format;
+    s.out = out;
+
+    double cell_deg = radius_km / CITY_GRID_KM_PER_DEG;
+    cell_deg = fmax(JOIN_MIN_CELL_DEG, fmin(JOIN_MAX_CELL_DEG, cell_deg));
+
+    if (!city_grid_build(&s.airports, city_count, &cities[0].coord, sizeof(city), cell_deg))
+    {
+        return -1;
+    }
+    if (!city_grid_build(&s.points, n, stations, sizeof(location), cell_deg))
+    {
+        city_grid_destroy(&s.airports);
+        return -1;
+    }
+
+    // Only the cells that hold stations are worth a task
+    int cell_count = s.points.rows * s.points.cols;
+    int task_count = 0;
+    s.tasks = malloc(sizeof(int) * (n > 0 ? n : 1));
+    for (int c = 0; s.tasks && c < cell_count; c++)
+    {
+        if (s.points.start[c + 1] > s.points.start[c])
+        {
+            s.tasks[task_count++] = c;
+        }
+    }
+
+    if (threads <= 0)
+    {
+        threads = work_pool_default_threads();
+    }
+    s.buffers = calloc(threads, sizeof(join_buffer));
+    bool ok = s.tasks && s.buffers;
+    for (int i = 0; ok && i < threads; i++)
+    {
+        s.buffers[i].data = malloc(JOIN_BUFFER_SIZE);
+        s.buffers[i].neighbours = malloc(sizeof(int) * city_grid_max_neighbours(&s.airports, radius_km));
+        ok = s.buffers[i].data && s.buffers[i].neighbours;
+    }
+
+    long matches = -1;
+    if (ok)
+    {
+        pthread_mutex_init(&s.out_lock, NULL);
+        work_pool_run(task_count, threads, join_cell, &s);
+
+        matches = 0;
+        for (int i = 0; i < threads; i++)
+        {
+            flush_buffer(&s, &s.buffers[i]);
+            matches += s.buffers[i].matches;
+        }
+        pthread_mutex_destroy(&s.out_lock);
+    }
+
+    for (int i = 0; s.buffers && i < threads; i++)
+    {
+        free(s.buffers[i].data);
+        free(s.buffers[i].neighbours);
+    }
+    free(s.buffers);
+    free(s.tasks);
+    city_grid_destroy(&s.points);
+    city_grid_destroy(&s.airports);
+    return matches;
+}
+
+static void join_cell(int task, int worker, void *arg)
+{
+    join_state *s = arg;
+    join_buffer *b = &s->buffers[worker];
+    const city_grid *g = &s->airports;
+
+    int cell = s->tasks[task];
+    int *neighbours = b->neighbours;
+    int neighbour_count = city_grid_neighbours(g, cell, s->radius_km, neighbours);
+
+    // Visit each neighbouring airport cell once for the whole station cell
+    for (int k = 0; k < neighbour_count; k++)
+    {
+        int neighbour = neighbours[k];
+        for (int i = s->points.start[cell]; i < s->points.start[cell + 1]; i++)
+        {
+            int station = s->points.items[i];
+            for (int j = g->start[neighbour]; j < g->start[neighbour + 1]; j++)
+            {
+                int airport = g->items[j];
+                double d = geo_spherical_km(&s->stations[station], &cities[airport].coord);
+                if (d <= s->radius_km)
+                {
+                    emit_match(s, b, station, airport, d);
+                }
+            }
+        }
+    }
+}
+
+static void emit_match(join_state *s, join_buffer *b, int station, int airport, double distance)
+{
+    // A CSV line is at most 20 + 1 + code + 1 + ~330 characters
+    size_t max_line = 400 + strlen(cities[airport].name);
+    if (b->used + max_line > JOIN_BUFFER_SIZE)
+    {
+        flush_buffer(s, b);
+    }
+
+    int64_t id = s->ids ? s->ids[station] : station;
+    if (s->format == JOIN_BINARY)
+    {
+        join_record rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.station_id = id;
+        size_t len = strlen(cities[airport].name);
+        memcpy(rec.code, cities[airport].name, len < sizeof(rec.code) ? len : sizeof(rec.code));
+        rec.distance = distance;
+        memcpy(b->data + b->used, &rec, sizeof(rec));
+        b->used += sizeof(rec);
+    }
+    else
+    {
+        b->used += sprintf(b->data + b->used, "%" PRId64 ",%s,%.3f\n", id, cities[airport].name, distance);
+    }
+    b->matches++;
+}
+
+static void flush_buffer(join_state *s, join_buffer *b)
+{
+    if (b->used > 0)
+    {
+        pthread_mutex_lock(&s->out_lock);
+        fwrite(b->data, 1, b->used, s->out);
+        pthread_mutex_unlock(&s->out_lock);
+        b->used = 0;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef __CITY_JOIN_H__
+#define __CITY_JOIN_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "location.h"
+
+// Output formats for city_join
+typedef enum {JOIN_CSV, JOIN_BINARY} join_format;
+
+// One match as written by city_join in JOIN_BINARY format, in host byte
+// order; the code is padded with '\0' (and not terminated if it has 8
+// characters)
+typedef struct
+{
+    int64_t station_id;
+    char code[8];
+    double distance;
+} join_record;
+
+/**
+ * Writes every (station, airport) pair from the given stations and cities[]
+ * that lie within radius_km of each other to the given file, either as
+ * "station_id,code,distance" CSV lines or as join_record structs.  Both sides
+ * are bucketed into the same grid, each cell of stations is one task on a
+ * work-stealing pool, and each thread streams its matches out in blocks, so
+ * the order of the matches is unspecified.
+ *
+ * @param n the number of stations
+ * @param stations an array of n locations
+ * @param ids the ids to write for the stations, or NULL to use the indices
+ * @param radius_km a nonnegative distance in kilometers
+ * @param threads the number of threads to use; 0 for one per processor
+ * @param format JOIN_CSV or JOIN_BINARY
+ * @param out a file to write into
+ * @return the number of matches, or -1 if memory could not be allocated
+ */
+long city_join(int n, const location *stations, const int64_t *ids, double radius_km, int threads, join_format format, FILE *out);
+
+#endif
@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "city_grid.h"
+#include "city_knn.h"
+#include "geo.h"
+#include "work_pool.h"
+
+#define PI 3.14159265358979323846
+
+// Cells are sized to hold about k points if the points were spread
+// evenly over the 180 x 360 degrees, within these bounds
+#define KNN_MIN_CELL_DEG 0.1
+#define KNN_MAX_CELL_DEG 10.0
+
+// Cells with more points than this are checked against a lower bound on
+// their distance before their points are
+#define KNN_BOUND_MIN_POINTS 32
+
+// No two points are further apart than this
+#define KNN_MAX_RADIUS_KM (PI * GEO_MEAN_RADIUS_KM)
+
+// What a graph file starts with; the arrays follow in the order of the
+// fields of city_knn, each starting on an 8-byte boundary
+typedef struct
+{
+    char magic[8];
+    uint32_t n;
+    uint32_t k;
+    uint64_t edges;
+} knn_header;
+
+static const char KNN_MAGIC[8] = "CITYKNN1";
+
+// What each thread needs to search: the cells to visit, the points of
+// its cell that are still searching, and a max-heap of the best k so far
+// by squared chord length
+typedef struct
+{
+    int *cells;
+    int *pending;
+    double *heap_chord;
+    int *heap_index;
+} knn_scratch;
+
+typedef struct
+{
+    const location *points;
+    size_t stride;
+    double *xyz;  // each point on the unit sphere, so that comparing
+                  // distances only takes a squared chord length
+    int k;
+    city_grid grid;
+    int *tasks;  // the nonempty cells
+    int32_t *neighbours;
+    float *distances;
+    knn_scratch *scratch;
+} knn_state;
+
+// Returns the number of bytes of a graph file with the given sizes
+static size_t image_size(int n, uint64_t edges);
+
+// Points the arrays of the given graph into an image of a graph file
+static void attach(city_knn *graph, void *image);
+
+// Finds the neighbours of the points in one cell of the grid
+static void search_cell(int task, int worker, void *arg);
+
+// Returns a lower bound on the distance in kilometers from the given point
+// to anything in the given cell; cos_lat is the cosine of its latitude
+static double cell_bound(const city_grid *grid, int cell, const location *p, double cos_lat);
+
+// Returns the squared chord length on the unit sphere of an arc of the
+// given length in kilometers
+static double chord2(double km);
+
+// Returns true if neighbour (d1, i1) is further than (d2, i2)
+static bool further(double d1, int i1, double d2, int i2);
+
+// Returns the point at the given index of a strided array
+static const location *point_at(const location *points, size_t stride, int i);
+
+bool city_knn_build(city_knn *graph, int n, const location *points, size_t stride, int k, int threads)
+{
+    if (k < 1 || k > KNN_MAX_K || n < 0)
+    {
+        return false;
+    }
+
+    // Every point gets the same number of neighbours
+    knn_state s;
+    s.points = points;
+    s.stride = stride;
+    s.k = n - 1 < k ? (n > 0 ? n - 1 : 0) : k;
+    uint64_t edges = (uint64_t)n * s.k;
+
+    void *image = malloc(image_size(n, edges));
+    if (!image)
+    {
+        return false;
+    }
+    knn_header *header = image;
+    memcpy(header->magic, KNN_MAGIC, sizeof(KNN_MAGIC));
+    header->n = n;
+    header->k = s.k;
+    header->edges = edges;
+    attach(graph, image);
+    graph->mapped = 0;
+
+    uint64_t *offsets = (uint64_t *)graph->offsets;
+    for (int i = 0; i <= n; i++)
+    {
+        offsets[i] = (uint64_t)i * s.k;
+    }
+    s.neighbours = (int32_t *)graph->neighbours;
+    s.distances = (float *)graph->distances;
+    if (s.k == 0)
+    {
+        return true;
+    }
+
+    double cell_deg = sqrt(180.0 * 360.0 * s.k / n);
+    cell_deg = fmax(KNN_MIN_CELL_DEG, fmin(KNN_MAX_CELL_DEG, cell_deg));
+    if (!city_grid_build(&s.grid, n, points, stride, cell_deg))
+    {
+        city_knn_destroy(graph);
+        return false;
+    }
+
+    // Only the cells that hold points are worth a task
+    int cell_count = s.grid.rows * s.grid.cols;
+    int task_count = 0;
+    int largest = 0;
+    s.tasks = malloc(sizeof(int) * n);
+    s.xyz = malloc(sizeof(double) * 3 * n);
+    for (int i = 0; s.xyz && i < n; i++)
+    {
+        const location *p = point_at(points, stride, i);
+        double lat = p->lat * PI / 180.0;
+        double lon = p->lon * PI / 180.0;
+        s.xyz[3 * i] = cos(lat) * cos(lon);
+        s.xyz[3 * i + 1] = cos(lat) * sin(lon);
+        s.xyz[3 * i + 2] = sin(lat);
+    }
+    for (int c = 0; s.tasks && c < cell_count; c++)
+    {
+        int size = s.grid.start[c + 1] - s.grid.start[c];
+        if (size > 0)
+        {
+            s.tasks[task_count++] = c;
+            largest = size > largest ? size : largest;
+        }
+    }
+
+    if (threads <= 0)
+    {
+        threads = work_pool_default_threads();
+    }
+    s.scratch = calloc(threads, sizeof(knn_scratch));
+    bool ok = s.tasks && s.xyz && s.scratch;
+    for (int i = 0; ok && i < threads; i++)
+    {
+        s.scratch[i].cells = malloc(sizeof(int) * city_grid_max_neighbours(&s.grid, KNN_MAX_RADIUS_KM));
+        s.scratch[i].pending = malloc(sizeof(int) * largest);
+        s.scratch[i].heap_chord = malloc(sizeof(double) * s.k);
+        s.scratch[i].heap_index = malloc(sizeof(int) * s.k);
+        ok = s.scratch[i].cells && s.scratch[i].pending && s.scratch[i].heap_chord && s.scratch[i].heap_index;
+    }
+
+    if (ok)
+    {
+        work_pool_run(task_count, threads, search_cell, &s);
+    }
+
+    for (int i = 0; s.scratch && i < threads; i++)
+    {
+        free(s.scratch[i].cells);
+        free(s.scratch[i].pending);
+        free(s.scratch[i].heap_chord);
+        free(s.scratch[i].heap_index);
+    }
+    free(s.scratch);
+    free(s.xyz);
+    free(s.tasks);
+    city_grid_destroy(&s.grid);
+    if (!ok)
+    {
+        city_knn_destroy(graph);
+    }
+    return ok;
+}
+
+static void search_cell(int task, int worker, void *arg)
+{
+    knn_state *s = arg;
+    knn_scratch *sc = &s->scratch[worker];
+    const city_grid *g = &s->grid;
+    int cell = s->tasks[task];
+
+    int pending_count = 0;
+    for (int i = g->start[cell]; i < g->start[cell + 1]; i++)
+    {
+        sc->pending[pending_count++] = g->items[i];
+    }
+
+    // Every point within the radius is in the visited cells, so a point
+    // is done once its k-th neighbour is within the radius; the others
+    // try again with twice the radius until it covers the whole sphere
+    double radius = g->cell_deg * CITY_GRID_KM_PER_DEG;
+    while (pending_count > 0)
+    {
+        bool everything = radius >= KNN_MAX_RADIUS_KM;
+        double radius_chord = chord2(radius);
+        int cell_count = city_grid_neighbours(g, cell, fmin(radius, KNN_MAX_RADIUS_KM), sc->cells);
+        int still_pending = 0;
+
+        // Visit the own cell first so the heap fills up with close points
+        // and the bound below can skip most of the others
+        for (int c = 0; c < cell_count; c++)
+        {
+            if (sc->cells[c] == cell)
+            {
+                sc->cells[c] = sc->cells[0];
+                sc->cells[0] = cell;
+                break;
+            }
+        }
+
+        for (int p = 0; p < pending_count; p++)
+        {
+            int point = sc->pending[p];
+            const location *from = point_at(s->points, s->stride, point);
+            const double *v = s->xyz + 3 * point;
+            double *heap_d = sc->heap_chord;
+            int *heap_i = sc->heap_index;
+            int size = 0;
+            double cos_lat = cos(from->lat * PI / 180.0);
+
+            for (int c = 0; c < cell_count; c++)
+            {
+                // Points past the radius only matter on a later pass, and
+                // points past the k-th best so far don't matter at all;
+                // small cells are quicker to scan than to bound
+                int other_cell = sc->cells[c];
+                if (g->start[other_cell + 1] - g->start[other_cell] > KNN_BOUND_MIN_POINTS)
+                {
+                    double bound = chord2(cell_bound(g, other_cell, from, cos_lat));
+                    if ((!everything && bound > radius_chord) || (size == s->k && bound > heap_d[0]))
+                    {
+                        continue;
+                    }
+                }
+                for (int j = g->start[other_cell]; j < g->start[other_cell + 1]; j++)
+                {
+                    int other = g->items[j];
+                    if (other == point)
+                    {
+                        continue;
+                    }
+                    const double *w = s->xyz + 3 * other;
+                    double d = (v[0] - w[0]) * (v[0] - w[0]) + (v[1] - w[1]) * (v[1] - w[1]) + (v[2] - w[2]) * (v[2] - w[2]);
+
+                    // Sift up into a heap that isn't full yet, or replace
+                    // the furthest and sift down
+                    int at;
+                    if (size < s->k)
+                    {
+                        at = size++;
+                        while (at > 0 && further(d, other, heap_d[(at - 1) / 2], heap_i[(at - 1) / 2]))
+                        {
+                            heap_d[at] = heap_d[(at - 1) / 2];
+                            heap_i[at] = heap_i[(at - 1) / 2];
+                            at = (at - 1) / 2;
+                        }
+                    }
+                    else if (further(heap_d[0], heap_i[0], d, other))
+                    {
+                        at = 0;
+                        while (2 * at + 1 < size)
+                        {
+                            int child = 2 * at + 1;
+                            if (child + 1 < size && further(heap_d[child + 1], heap_i[child + 1], heap_d[child], heap_i[child]))
+                            {
+                                child++;
+                            }
+                            if (!further(heap_d[child], heap_i[child], d, other))
+                            {
+                                break;
+                            }
+                            heap_d[at] = heap_d[child];
+                            heap_i[at] = heap_i[child];
+                            at = child;
+                        }
+                    }
+                    else
+                    {
+                        continue;
+                    }
+                    heap_d[at] = d;
+                    heap_i[at] = other;
+                }
+            }
+
+            if (!everything && (size < s->k || heap_d[0] > radius_chord))
+            {
+                sc->pending[still_pending++] = point;
+                continue;
+            }
+
+            // Pop the furthest into the last position until it's empty,
+            // turning chord lengths back into great-circle distances
+            int32_t *out_i = s->neighbours + (uint64_t)point * s->k;
+            float *out_d = s->distances + (uint64_t)point * s->k;
+            while (size > 0)
+            {
+                out_i[size - 1] = heap_i[0];
+                out_d[size - 1] = (float)(2 * GEO_MEAN_RADIUS_KM * asin(fmin(1.0, sqrt(heap_d[0]) / 2)));
+                size--;
+                double d = heap_d[size];
+                int other = heap_i[size];
+                int at = 0;
+                while (2 * at + 1 < size)
+                {
+                    int child = 2 * at + 1;
+                    if (child + 1 < size && further(heap_d[child + 1], heap_i[child + 1], heap_d[child], heap_i[child]))
+                    {
+                        child++;
+                    }
+                    if (!further(heap_d[child], heap_i[child], d, other))
+                    {
+                        break;
+                    }
+                    heap_d[at] = heap_d[child];
+                    heap_i[at] = heap_i[child];
+                    at = child;
+                }
+                heap_d[at] = d;
+                heap_i[at] = other;
+            }
+        }
+
+        pending_count = still_pending;
+        radius *= 2;
+    }
+}
+
+bool city_knn_write(const city_knn *graph, const char *path)
+{
+    FILE *out = fopen(path, "wb");
+    if (!out)
+    {
+        return false;
+    }
+    size_t size = image_size(graph->n, graph->offsets[graph->n]);
+    bool ok = fwrite(graph->memory, 1, size, out) == size;
+    return fclose(out) == 0 && ok;
+}
+
+bool city_knn_map(city_knn *graph, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(knn_header))
+    {
+        close(fd);
+        return false;
+    }
+    void *image = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // The sizes in the header have to account for the whole file
+    const knn_header *header = image;
+    if (memcmp(header->magic, KNN_MAGIC, sizeof(KNN_MAGIC)) != 0
+        || header->edges != (uint64_t)header->n * header->k
+        || image_size(header->n, header->edges) != (size_t)st.st_size)
+    {
+        munmap(image, st.st_size);
+        return false;
+    }
+    attach(graph, image);
+    graph->mapped = st.st_size;
+    return true;
+}
+
+void city_knn_destroy(city_knn *graph)
+{
+    if (graph->mapped)
+    {
+        munmap(graph->memory, graph->mapped);
+    }
+    else
+    {
+        free(graph->memory);
+    }
+    graph->memory = NULL;
+    graph->offsets = NULL;
+    graph->neighbours = NULL;
+    graph->distances = NULL;
+}
+
+static size_t image_size(int n, uint64_t edges)
+{
+    size_t neighbour_bytes = (edges * sizeof(int32_t) + 7) / 8 * 8;
+    return sizeof(knn_header) + sizeof(uint64_t) * ((size_t)n + 1) + neighbour_bytes + edges * sizeof(float);
+}
+
+static void attach(city_knn *graph, void *image)
+{
+    const knn_header *header = image;
+    char *at = (char *)image + sizeof(knn_header);
+    graph->n = header->n;
+    graph->k = header->k;
+    graph->memory = image;
+    graph->offsets = (const uint64_t *)at;
+    at += sizeof(uint64_t) * ((size_t)header->n + 1);
+    graph->neighbours = (const int32_t *)at;
+    at += (header->edges * sizeof(int32_t) + 7) / 8 * 8;
+    graph->distances = (const float *)at;
+}
+
+static double cell_bound(const city_grid *grid, int cell, const location *p, double cos_lat)
+{
+    int row = cell / grid->cols;
+    int col = cell % grid->cols;
+    double south = -90.0 + row * grid->cell_deg;
+    double north = south + grid->cell_deg;
+    double west = -180.0 + col * grid->cell_deg;
+
+    // No closer than the latitude difference along a meridian
+    double dlat = p->lat < south ? south - p->lat : (p->lat > north ? p->lat - north : 0);
+    double bound = dlat * CITY_GRID_KM_PER_DEG;
+
+    // No closer than the great circle through the nearer edge meridian,
+    // as long as the whole cell is within 90 degrees of longitude
+    double east_of_west = fmod(p->lon - west + 720.0, 360.0);
+    if (east_of_west > grid->cell_deg)
+    {
+        double gap = fmin(east_of_west - grid->cell_deg, 360.0 - east_of_west);
+        if (gap + grid->cell_deg <= 90.0)
+        {
+            double across = asin(sin(gap * PI / 180.0) * cos_lat) * GEO_MEAN_RADIUS_KM;
+            bound = fmax(bound, across);
+        }
+    }
+
+    // Leave room for rounding so equal distances are never skipped
+    return bound * (1 - 1e-9) - 1e-9;
+}
+
+static double chord2(double km)
+{
+    double half = sin(fmax(0.0, fmin(km, KNN_MAX_RADIUS_KM)) / (2 * GEO_MEAN_RADIUS_KM));
+    return 4 * half * half;
+}
+
+static bool further(double d1, int i1, double d2, int i2)
+{
+    return d1 > d2 || (d1 == d2 && i1 > i2);
+}
+
+static const location *point_at(const location *points, size_t stride, int i)
+{
+    return (const location *)((const char *)points + stride * i);
+}
@@ -0,0 +1,82 @@
+#ifndef __CITY_KNN_H__
+#define __CITY_KNN_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "location.h"
+
+// The largest number of neighbours city_knn_build finds per point
+#define KNN_MAX_K 32
+
+// The k nearest neighbours of every point, in compressed sparse row form:
+// the neighbours of point i are neighbours[offsets[i]] to
+// neighbours[offsets[i + 1] - 1], nearest first, with their great-circle
+// distances in kilometers in the same positions of distances.  A graph
+// is either built in memory or mapped read-only from a file written by
+// city_knn_write, which holds a header and then these arrays as they are.
+typedef struct
+{
+    int n;
+    int k;
+    const uint64_t *offsets;    // n + 1 entries
+    const int32_t *neighbours;
+    const float *distances;
+    void *memory;               // what city_knn_destroy releases
+    size_t mapped;              // the length of the mapping, 0 if built
+} city_knn;
+
+/**
+ * Finds the k nearest other points of each of n points.  The points are
+ * bucketed into a grid sized to hold about k points per cell, and each
+ * nonempty cell is one task on a work-stealing pool: its points search
+ * the cells within a radius that doubles until their k-th neighbour is
+ * closer than the radius, skipping large cells that can't hold anything
+ * closer than the k-th neighbour so far.  Candidates are compared by
+ * chord length between unit vectors, which orders them the same as the
+ * great-circle distance without any trigonometry.  Ties are broken by
+ * index, so the graph does not depend on the number of threads.
+ * Latitudes must be within [-90, 90].  Points are read as in
+ * city_grid_build, e.g. city_knn_build(&g, city_count, &cities[0].coord,
+ * sizeof(city), 8, 0).
+ *
+ * @param graph the graph to fill in
+ * @param n a nonnegative integer
+ * @param points the location of point 0
+ * @param stride the distance in bytes between consecutive points
+ * @param k the number of neighbours, from 1 to KNN_MAX_K; points get
+ *        fewer if there are not that many others
+ * @param threads the number of threads to use; 0 for one per processor
+ * @return true if successful, false if k is out of range or memory could
+ *         not be allocated
+ */
+bool city_knn_build(city_knn *graph, int n, const location *points, size_t stride, int k, int threads);
+
+/**
+ * Writes the given graph to a file that city_knn_map can load.
+ *
+ * @param graph a graph filled in by city_knn_build or city_knn_map
+ * @param path the file to write
+ * @return true if successful, false if the file could not be written
+ */
+bool city_knn_write(const city_knn *graph, const char *path);
+
+/**
+ * Maps a file written by city_knn_write, without reading or copying it.
+ *
+ * @param graph the graph to fill in
+ * @param path the file to map
+ * @return true if successful, false if the file could not be mapped or
+ *         is not a graph file
+ */
+bool city_knn_map(city_knn *graph, const char *path);
+
+/**
+ * Frees or unmaps the given graph.
+ *
+ * @param graph a graph filled in by city_knn_build or city_knn_map
+ */
+void city_knn_destroy(city_knn *graph);
+
+#endif
@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cities.h"
+#include "city_proto.h"
+
+// The settings shared by every connection, and what each one measured
+typedef struct
+{
+    const char *path;
+    int depth;      // requests in flight per connection
+    int batch;      // codes per request
+    int requests;   // requests per connection
+    unsigned seed;
+    double *latencies;
+    long not_found;
+    bool failed;
+} load_arg;
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+/**
+ * Writes the whole buffer to the given socket.
+ *
+ * @return true if successful, false if the connection failed
+ */
+bool write_all(int fd, const char *buffer, size_t length);
+
+/**
+ * Reads exactly length bytes from the given socket.
+ *
+ * @return true if successful, false if the connection failed or closed
+ */
+bool read_all(int fd, char *buffer, size_t length);
+
+/**
+ * Runs one connection: keeps depth requests of batch random codes in
+ * flight until all requests are answered, timing each one.
+ */
+void *run_connection(void *arg);
+
+int compare_doubles(const void *a, const void *b);
+
+int main(int argc, char **argv)
+{
+    // Usage: city_load [-s path] [-c connections] [-d depth] [-b batch] [-n requests]
+    const char *path = CITY_SOCKET_PATH;
+    int connections = 4;
+    int depth = 16;
+    int batch = 32;
+    int requests = 100000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i == argc - 1 || argv[i][0] != '-' || strlen(argv[i]) != 2 || !strchr("scdbn", argv[i][1]))
+        {
+            fprintf(stderr, "%s: usage: %s [-s path] [-c connections] [-d depth] [-b batch] [-n requests]\n", argv[0], argv[0]);
+            return 1;
+        }
+        switch (argv[i][1])
+        {
+            case 's':
+                path = argv[i + 1];
+                break;
+            case 'c':
+                connections = atoi(argv[i + 1]);
+                break;
+            case 'd':
+                depth = atoi(argv[i + 1]);
+                break;
+            case 'b':
+                batch = atoi(argv[i + 1]);
+                break;
+            case 'n':
+                requests = atoi(argv[i + 1]);
+                break;
+        }
+        i++;
+    }
+    if (connections < 1 || depth < 1 || batch < 1 || batch > CITY_MAX_BATCH || requests < 1)
+    {
+        fprintf(stderr, "%s: counts must be positive and batch at most %d\n", argv[0], CITY_MAX_BATCH);
+        return 1;
+    }
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * connections);
+    load_arg *args = calloc(connections, sizeof(load_arg));
+    double *latencies = malloc(sizeof(double) * connections * requests);
+    if (!threads || !args || !latencies)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    double start = now();
+    for (int i = 0; i < connections; i++)
+    {
+        args[i].path = path;
+        args[i].depth = depth;
+        args[i].batch = batch;
+        args[i].requests = requests;
+        args[i].seed = i + 1;
+        args[i].latencies = latencies + (size_t)i * requests;
+        pthread_create(&threads[i], NULL, run_connection, &args[i]);
+    }
+
+    long not_found = 0;
+    bool failed = false;
+    for (int i = 0; i < connections; i++)
+    {
+        pthread_join(threads[i], NULL);
+        not_found += args[i].not_found;
+        failed = failed || args[i].failed;
+    }
+    double elapsed = now() - start;
+
+    if (failed)
+    {
+        fprintf(stderr, "%s: could not talk to the daemon at %s\n", argv[0], path);
+        return 1;
+    }
+
+    long total = (long)connections * requests;
+    qsort(latencies, total, sizeof(double), compare_doubles);
+    printf("%d connections, depth %d, batch %d\n", connections, depth, batch);
+    printf("requests/s: %.0f\n", total / elapsed);
+    printf("codes/s:    %.0f\n", total * (double)batch / elapsed);
+    printf("p50:        %.1f us\n", latencies[total / 2] * 1e6);
+    printf("p99:        %.1f us\n", latencies[total * 99 / 100] * 1e6);
+    printf("not found:  %ld\n", not_found);
+
+    free(latencies);
+    free(args);
+    free(threads);
+    return 0;
+}
+
+void *run_connection(void *arg)
+{
+    load_arg *a = arg;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, a->path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        a->failed = true;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    size_t request_size = sizeof(city_msg_header) + (size_t)a->batch * (CITY_MAX_CODE_LENGTH + 1);
+    size_t response_size = sizeof(city_msg_header) + (size_t)a->batch * sizeof(city_answer);
+    char *request = malloc(request_size);
+    char *response = malloc(response_size);
+    double *sent_at = malloc(sizeof(double) * a->requests);
+
+    int sent = 0;
+    int received = 0;
+    while (request && response && sent_at && received < a->requests)
+    {
+        // Top the pipeline up, then wait for the oldest answer
+        while (sent < a->requests && sent - received < a->depth)
+        {
+            city_msg_header header;
+            size_t length = 0;
+            char *body = request + sizeof(header);
+            for (int k = 0; k < a->batch; k++)
+            {
+                const char *code = cities[rand_r(&a->seed) % city_count].name;
+                size_t len = strlen(code);
+                body[length] = (char)len;
+                memcpy(body + length + 1, code, len);
+                length += 1 + len;
+            }
+            header.length = length;
+            header.id = sent;
+            header.count = a->batch;
+            memcpy(request, &header, sizeof(header));
+
+            sent_at[sent] = now();
+            if (!write_all(fd, request, sizeof(header) + length))
+            {
+                a->failed = true;
+                break;
+            }
+            sent++;
+        }
+
+        city_msg_header header;
+        if (a->failed || !read_all(fd, (char *)&header, sizeof(header))
+            || header.id >= (uint32_t)a->requests || header.length != a->batch * sizeof(city_answer)
+            || !read_all(fd, response, header.length))
+        {
+            a->failed = true;
+            break;
+        }
+        a->latencies[received] = now() - sent_at[header.id];
+
+        for (uint32_t k = 0; k < header.count; k++)
+        {
+            city_answer answer;
+            memcpy(&answer, response + k * sizeof(answer), sizeof(answer));
+            if (isnan(answer.lat))
+            {
+                a->not_found++;
+            }
+        }
+        received++;
+    }
+
+    free(sent_at);
+    free(response);
+    free(request);
+    close(fd);
+    return NULL;
+}
+
+bool write_all(int fd, const char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = write(fd, buffer, length);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        buffer += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool read_all(int fd, char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = read(fd, buffer, length);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        buffer += n;
+        length -= n;
+    }
+    return true;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
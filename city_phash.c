@@ -0,0 +1,339 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "city_phash.h"
+
+// Average codes per bucket; bigger saves pilot space but slows the build
+#define PHASH_BUCKET_SIZE 4
+
+// Slots per code before remapping; a little slack makes the last buckets
+// much easier to place
+#define PHASH_LOAD 0.99
+
+// Pilots are 16 bits; a seed that needs a larger one is abandoned
+#define PHASH_MAX_PILOT 65535
+#define PHASH_MAX_SEEDS 16
+
+struct city_phash
+{
+    uint64_t seed;
+    uint32_t n;             // codes, and records
+    uint32_t m;             // slots; slots in [n, m) are remapped below n
+    uint32_t buckets;
+    uint16_t *pilots;       // one per bucket
+    uint32_t *remap;        // m - n entries
+    unsigned char *prints;  // one fingerprint per record
+    city *records;          // in slot order
+};
+
+// Hashes a code with the given seed
+static uint64_t hash_code(const char *code, uint64_t seed);
+
+// Mixes the bits of x (the finalizer of MurmurHash3)
+static uint64_t mix(uint64_t x);
+
+// Maps x onto [0, range) without a division
+static uint32_t reduce(uint64_t x, uint32_t range);
+
+// Returns the bucket of a code's hash
+static uint32_t bucket_of(const city_phash *ph, uint64_t h);
+
+// Returns the slot of a code's hash under the given pilot, before remapping
+static uint32_t slot_of(const city_phash *ph, uint64_t h, uint32_t pilot);
+
+// Returns the fingerprint of a code's hash
+static unsigned char print_of(uint64_t h);
+
+// Tries to place every bucket with the current seed
+static bool place_buckets(city_phash *ph, const uint64_t *hashes, uint32_t *slots);
+
+
+city_phash *city_phash_build(int n, const city *table)
+{
+    city_phash *ph = calloc(1, sizeof(city_phash));
+    if (!ph)
+    {
+        return NULL;
+    }
+
+    // The table is sorted, so duplicates are neighbours
+    const city **distinct = malloc(sizeof(city *) * (n > 0 ? n : 1));
+    uint32_t count = 0;
+    for (int i = 0; distinct && i < n; i++)
+    {
+        if (count == 0 || strcmp(distinct[count - 1]->name, table[i].name) != 0)
+        {
+            distinct[count++] = &table[i];
+        }
+    }
+
+    ph->n = count;
+    ph->m = count > 0 ? (uint32_t)(count / PHASH_LOAD) + 1 : 1;
+    ph->buckets = count / PHASH_BUCKET_SIZE + 1;
+    ph->pilots = malloc(sizeof(uint16_t) * ph->buckets);
+    ph->remap = malloc(sizeof(uint32_t) * (ph->m - ph->n));
+    ph->prints = malloc(count > 0 ? count : 1);
+    ph->records = malloc(sizeof(city) * (count > 0 ? count : 1));
+    uint64_t *hashes = malloc(sizeof(uint64_t) * (count > 0 ? count : 1));
+    uint32_t *slots = malloc(sizeof(uint32_t) * (count > 0 ? count : 1));
+
+    bool ok = distinct && ph->pilots && ph->remap && ph->prints && ph->records && hashes && slots;
+    bool placed = false;
+    for (int attempt = 0; ok && !placed && attempt < PHASH_MAX_SEEDS; attempt++)
+    {
+        ph->seed = mix(0x5eed0000 + attempt);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            hashes[i] = hash_code(distinct[i]->name, ph->seed);
+        }
+        placed = place_buckets(ph, hashes, slots);
+    }
+    ok = ok && placed;
+
+    if (ok)
+    {
+        // Slots past n are remapped onto the free slots below n, in order
+        uint32_t *owner = malloc(sizeof(uint32_t) * ph->m);
+        ok = owner != NULL;
+        for (uint32_t s = 0; ok && s < ph->m; s++)
+        {
+            owner[s] = UINT32_MAX;
+        }
+        for (uint32_t i = 0; ok && i < count; i++)
+        {
+            owner[slot_of(ph, hashes[i], ph->pilots[bucket_of(ph, hashes[i])])] = i;
+        }
+        uint32_t next_free = 0;
+        for (uint32_t s = ph->n; ok && s < ph->m; s++)
+        {
+            while (next_free < ph->n && owner[next_free] != UINT32_MAX)
+            {
+                next_free++;
+            }
+            ph->remap[s - ph->n] = next_free;
+            if (owner[s] != UINT32_MAX)
+            {
+                owner[next_free] = owner[s];
+                next_free++;
+            }
+        }
+
+        for (uint32_t s = 0; ok && s < ph->n; s++)
+        {
+            const city *c = distinct[owner[s]];
+            ph->records[s] = *c;
+            ph->prints[s] = print_of(hashes[owner[s]]);
+        }
+        free(owner);
+    }
+
+    free(slots);
+    free(hashes);
+    free(distinct);
+    if (!ok)
+    {
+        city_phash_destroy(ph);
+        return NULL;
+    }
+    return ph;
+}
+
+static bool place_buckets(city_phash *ph, const uint64_t *hashes, uint32_t *slots)
+{
+    uint32_t n = ph->n;
+    uint32_t *start = calloc(ph->buckets + 1, sizeof(uint32_t));
+    uint64_t *by_bucket = malloc(sizeof(uint64_t) * (n > 0 ? n : 1));
+    uint32_t *order = malloc(sizeof(uint32_t) * ph->buckets);
+    unsigned char *taken = calloc((ph->m + 7) / 8, 1);
+    bool ok = start && by_bucket && order && taken;
+
+    if (ok)
+    {
+        // Group the hashes by bucket with a counting sort
+        for (uint32_t i = 0; i < n; i++)
+        {
+            start[bucket_of(ph, hashes[i]) + 1]++;
+        }
+        uint32_t largest = 0;
+        for (uint32_t b = 0; b < ph->buckets; b++)
+        {
+            largest = start[b + 1] > largest ? start[b + 1] : largest;
+            start[b + 1] += start[b];
+        }
+        uint32_t *fill = malloc(sizeof(uint32_t) * ph->buckets);
+        uint32_t *by_size = calloc(largest + 2, sizeof(uint32_t));
+        ok = fill && by_size;
+        if (ok)
+        {
+            memcpy(fill, start, sizeof(uint32_t) * ph->buckets);
+            for (uint32_t i = 0; i < n; i++)
+            {
+                by_bucket[fill[bucket_of(ph, hashes[i])]++] = hashes[i];
+            }
+
+            // Biggest buckets first, while there is the most room; another
+            // counting sort, on size this time
+            for (uint32_t b = 0; b < ph->buckets; b++)
+            {
+                by_size[largest - (start[b + 1] - start[b]) + 1]++;
+            }
+            for (uint32_t k = 0; k <= largest; k++)
+            {
+                by_size[k + 1] += by_size[k];
+            }
+            for (uint32_t b = 0; b < ph->buckets; b++)
+            {
+                order[by_size[largest - (start[b + 1] - start[b])]++] = b;
+            }
+        }
+        free(by_size);
+        free(fill);
+    }
+
+    memset(ph->pilots, 0, sizeof(uint16_t) * ph->buckets);
+    for (uint32_t k = 0; ok && k < ph->buckets; k++)
+    {
+        uint32_t b = order[k];
+        uint32_t first = start[b];
+        uint32_t size = start[b + 1] - first;
+        if (size == 0)
+        {
+            // The rest are empty too
+            break;
+        }
+
+        uint32_t pilot;
+        for (pilot = 0; pilot <= PHASH_MAX_PILOT; pilot++)
+        {
+            // Every code must land on a free slot, and not on each other
+            uint32_t j;
+            for (j = 0; j < size; j++)
+            {
+                uint32_t s = slot_of(ph, by_bucket[first + j], pilot);
+                if (taken[s / 8] & (1 << (s % 8)))
+                {
+                    break;
+                }
+                slots[j] = s;
+                taken[s / 8] |= 1 << (s % 8);
+            }
+            if (j == size)
+            {
+                break;
+            }
+            for (uint32_t u = 0; u < j; u++)
+            {
+                taken[slots[u] / 8] &= ~(1 << (slots[u] % 8));
+            }
+        }
+
+        // Codes with equal hashes never separate, so they end up here too
+        if (pilot > PHASH_MAX_PILOT)
+        {
+            ok = false;
+        }
+        else
+        {
+            ph->pilots[b] = (uint16_t)pilot;
+        }
+    }
+
+    free(taken);
+    free(order);
+    free(by_bucket);
+    free(start);
+    return ok;
+}
+
+void city_phash_destroy(city_phash *ph)
+{
+    if (ph)
+    {
+        free(ph->pilots);
+        free(ph->remap);
+        free(ph->prints);
+        free(ph->records);
+        free(ph);
+    }
+}
+
+bool city_phash_find(const city_phash *ph, const char *code, location *loc)
+{
+    if (ph->n == 0)
+    {
+        return false;
+    }
+    uint64_t h = hash_code(code, ph->seed);
+    uint32_t s = slot_of(ph, h, ph->pilots[bucket_of(ph, h)]);
+    if (s >= ph->n)
+    {
+        s = ph->remap[s - ph->n];
+    }
+    if (ph->prints[s] != print_of(h) || strcmp(code, ph->records[s].name) != 0)
+    {
+        return false;
+    }
+    *loc = ph->records[s].coord;
+    return true;
+}
+
+size_t city_phash_bytes(const city_phash *ph)
+{
+    return sizeof(city_phash) + sizeof(uint16_t) * ph->buckets + sizeof(uint32_t) * (ph->m - ph->n) + ph->n;
+}
+
+int city_phash_size(const city_phash *ph)
+{
+    return (int)ph->n;
+}
+
+static uint32_t bucket_of(const city_phash *ph, uint64_t h)
+{
+    // As in PTHash, 60% of the codes (by the low half of the hash) go to
+    // the first 30% of the buckets (by the high half);
+    // those big buckets are placed while the table is empty, which leaves
+    // the small ones for when it's nearly full
+    uint32_t dense = ph->buckets * 3 / 10;
+    if ((uint32_t)h < (uint32_t)(0.6 * 4294967296.0) || dense == ph->buckets)
+    {
+        return reduce(h >> 32, dense > 0 ? dense : 1);
+    }
+    return dense + reduce(h >> 32, ph->buckets - dense);
+}
+
+static uint32_t slot_of(const city_phash *ph, uint64_t h, uint32_t pilot)
+{
+    return reduce(mix(h ^ (pilot * 0x9E3779B97F4A7C15ull)), ph->m);
+}
+
+static unsigned char print_of(uint64_t h)
+{
+    return (unsigned char)(h >> 56);
+}
+
+static uint64_t hash_code(const char *code, uint64_t seed)
+{
+    // FNV-1a over the bytes, then a full mix
+    uint64_t h = 0xcbf29ce484222325ull ^ seed;
+    for (const unsigned char *p = (const unsigned char *)code; *p; p++)
+    {
+        h = (h ^ *p) * 0x100000001b3ull;
+    }
+    return mix(h);
+}
+
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint32_t reduce(uint64_t x, uint32_t range)
+{
+    return (uint32_t)(((x & 0xFFFFFFFFull) * range) >> 32);
+}
@@ -0,0 +1,61 @@
+#ifndef __CITY_PHASH_H__
+#define __CITY_PHASH_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cities.h"
+
+// A minimal perfect hash over the codes of a city table, in the style of
+// PTHash: codes are hashed into small buckets, and each bucket stores a
+// pilot value chosen so that its codes land on distinct free slots.  The
+// records are copied into slot order, so a lookup is one hash, a check of
+// a one-byte fingerprint (which turns most misses away without touching
+// the record) and one string compare.
+typedef struct city_phash city_phash;
+
+/**
+ * Builds a perfect hash over the given table.  Codes that appear more
+ * than once are only kept once.  The records are copied, so edits to the
+ * table are not seen until a new hash is built.
+ *
+ * @param n the number of entries
+ * @param table an array of n cities sorted by code
+ * @return a new hash, or NULL if memory could not be allocated or no
+ *         working seed was found
+ */
+city_phash *city_phash_build(int n, const city *table);
+
+/**
+ * Frees the given hash.
+ *
+ * @param ph a hash returned by city_phash_build, or NULL
+ */
+void city_phash_destroy(city_phash *ph);
+
+/**
+ * Looks up a code in the given hash, like find_city.
+ *
+ * @param ph a hash returned by city_phash_build
+ * @param code a code
+ * @param loc set to its location if found
+ * @return true if the code was found, false otherwise
+ */
+bool city_phash_find(const city_phash *ph, const char *code, location *loc);
+
+/**
+ * Returns the number of bytes the hash needs besides the copied records:
+ * pilots, fingerprints and the remap table for the slots past the end.
+ *
+ * @param ph a hash returned by city_phash_build
+ */
+size_t city_phash_bytes(const city_phash *ph);
+
+/**
+ * Returns the number of distinct codes in the given hash.
+ *
+ * @param ph a hash returned by city_phash_build
+ */
+int city_phash_size(const city_phash *ph);
+
+#endif
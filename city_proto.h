@@ -0,0 +1,37 @@
+#ifndef __CITY_PROTO_H__
+#define __CITY_PROTO_H__
+
+#include <stdint.h>
+
+// The wire format spoken by city_daemon over a Unix domain socket, in host
+// byte order since both ends are on the same host.  A client may send any
+// number of requests without waiting (pipelining); the daemon answers each
+// connection's requests in order.
+//
+// Request:  city_msg_header, then count codes, each as one length byte
+//           followed by that many characters (no '\0')
+// Response: city_msg_header with the same id and count, then count
+//           city_answers in the order of the codes
+
+// Where the daemon listens unless told otherwise
+#define CITY_SOCKET_PATH "/tmp/city_daemon.sock"
+
+// Limits that keep one message from hogging the daemon
+#define CITY_MAX_CODE_LENGTH 15
+#define CITY_MAX_BATCH 4096
+
+typedef struct
+{
+    uint32_t length;  // the number of bytes following the header
+    uint32_t id;      // chosen by the client, echoed in the response
+    uint32_t count;   // the number of codes or answers
+} city_msg_header;
+
+// The location of one code; both fields are NaN if it wasn't found
+typedef struct
+{
+    double lat;
+    double lon;
+} city_answer;
+
+#endif
@@ -0,0 +1,331 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cities.h"
+#include "city_store.h"
+
+// Codes are kept in sorted blocks of at most this many entries, found
+// through a sorted directory of pointers to the blocks
+#define STORE_BLOCK 128
+
+// Blocks start this full, so that early inserts seldom split them
+#define STORE_BLOCK_FILL (STORE_BLOCK * 3 / 4)
+
+// A block that falls below this many entries after a delete is folded
+// into a neighbour if the two fit in STORE_BLOCK_FILL, which leaves room
+// for inserts before the result splits
+#define STORE_BLOCK_MIN (STORE_BLOCK / 4)
+
+typedef struct
+{
+    char code[CITY_STORE_CODE_MAX + 1];
+    location coord;
+} store_entry;
+
+typedef struct
+{
+    int count;
+    store_entry entries[STORE_BLOCK];  // sorted by code
+} store_block;
+
+struct city_store
+{
+    store_block **blocks;  // sorted by code, none of them empty
+    int block_count;
+    int block_capacity;
+    int size;              // codes in all the blocks
+};
+
+// Returns the index of the block that holds the code if it is present:
+// the last block whose first code is at most code, or block 0
+static int find_block(const city_store *store, const char *code);
+
+// Returns the index of the code in a block, or if absent -1 - the index
+// where it would go
+static int search(const store_block *block, const char *code);
+
+// Puts a block into the directory at the given index
+static bool insert_block(city_store *store, int at, store_block *block);
+
+// Takes the block at the given index out of the directory and frees it
+static void remove_block(city_store *store, int at);
+
+// Orders positions in cities[] by code, then by position
+static int compare_positions(const void *a, const void *b);
+
+city_store *city_store_create()
+{
+    city_store *store = calloc(1, sizeof(city_store));
+    int *order = malloc(sizeof(int) * (city_count > 0 ? city_count : 1));
+    if (!store || !order)
+    {
+        free(order);
+        city_store_destroy(store);
+        return NULL;
+    }
+
+    // Sort positions rather than entries so that ties go to the first one
+    for (int i = 0; i < city_count; i++)
+    {
+        order[i] = i;
+    }
+    qsort(order, city_count, sizeof(int), compare_positions);
+
+    store_block *block = NULL;
+    const char *last = NULL;
+    for (int i = 0; i < city_count; i++)
+    {
+        const city *c = &cities[order[i]];
+        if (strlen(c->name) > CITY_STORE_CODE_MAX || (last && strcmp(last, c->name) == 0))
+        {
+            continue;
+        }
+        if (!block || block->count == STORE_BLOCK_FILL)
+        {
+            block = malloc(sizeof(store_block));
+            if (!block || !insert_block(store, store->block_count, block))
+            {
+                free(block);
+                free(order);
+                city_store_destroy(store);
+                return NULL;
+            }
+            block->count = 0;
+        }
+        store_entry *e = &block->entries[block->count++];
+        memset(e, 0, sizeof(store_entry));
+        strcpy(e->code, c->name);
+        e->coord = c->coord;
+        last = c->name;
+        store->size++;
+    }
+
+    free(order);
+    return store;
+}
+
+void city_store_destroy(city_store *store)
+{
+    if (store)
+    {
+        for (int b = 0; b < store->block_count; b++)
+        {
+            free(store->blocks[b]);
+        }
+        free(store->blocks);
+        free(store);
+    }
+}
+
+bool city_store_insert(city_store *store, const char *code, const location *loc)
+{
+    if (strlen(code) > CITY_STORE_CODE_MAX)
+    {
+        return false;
+    }
+    if (store->block_count == 0)
+    {
+        store_block *first = malloc(sizeof(store_block));
+        if (!first || !insert_block(store, 0, first))
+        {
+            free(first);
+            return false;
+        }
+        first->count = 0;
+    }
+
+    int b = find_block(store, code);
+    store_block *block = store->blocks[b];
+    int i = search(block, code);
+    if (i >= 0)
+    {
+        return false;
+    }
+    int at = -1 - i;
+
+    if (block->count == STORE_BLOCK)
+    {
+        // Split the full block in two and insert into the half the code
+        // belongs in
+        store_block *right = malloc(sizeof(store_block));
+        if (!right || !insert_block(store, b + 1, right))
+        {
+            free(right);
+            return false;
+        }
+        int half = STORE_BLOCK / 2;
+        right->count = STORE_BLOCK - half;
+        memcpy(right->entries, block->entries + half, sizeof(store_entry) * right->count);
+        block->count = half;
+        if (at > half)
+        {
+            block = right;
+            at -= half;
+        }
+    }
+
+    memmove(&block->entries[at + 1], &block->entries[at], sizeof(store_entry) * (block->count - at));
+    memset(&block->entries[at], 0, sizeof(store_entry));
+    strcpy(block->entries[at].code, code);
+    block->entries[at].coord = *loc;
+    block->count++;
+    store->size++;
+    return true;
+}
+
+bool city_store_update(city_store *store, const char *code, const location *loc)
+{
+    if (store->block_count == 0)
+    {
+        return false;
+    }
+    store_block *block = store->blocks[find_block(store, code)];
+    int i = search(block, code);
+    if (i < 0)
+    {
+        return false;
+    }
+    block->entries[i].coord = *loc;
+    return true;
+}
+
+bool city_store_delete(city_store *store, const char *code)
+{
+    if (store->block_count == 0)
+    {
+        return false;
+    }
+    int b = find_block(store, code);
+    store_block *block = store->blocks[b];
+    int i = search(block, code);
+    if (i < 0)
+    {
+        return false;
+    }
+    memmove(&block->entries[i], &block->entries[i + 1], sizeof(store_entry) * (block->count - i - 1));
+    block->count--;
+    store->size--;
+
+    // Keep the blocks from thinning out: fold a small one into the next
+    // or the previous block when they fit
+    if (block->count == 0)
+    {
+        remove_block(store, b);
+    }
+    else if (block->count < STORE_BLOCK_MIN)
+    {
+        if (b + 1 < store->block_count && block->count + store->blocks[b + 1]->count <= STORE_BLOCK_FILL)
+        {
+            store_block *next = store->blocks[b + 1];
+            memcpy(block->entries + block->count, next->entries, sizeof(store_entry) * next->count);
+            block->count += next->count;
+            remove_block(store, b + 1);
+        }
+        else if (b > 0 && store->blocks[b - 1]->count + block->count <= STORE_BLOCK_FILL)
+        {
+            store_block *previous = store->blocks[b - 1];
+            memcpy(previous->entries + previous->count, block->entries, sizeof(store_entry) * block->count);
+            previous->count += block->count;
+            remove_block(store, b);
+        }
+    }
+    return true;
+}
+
+bool city_store_find(const city_store *store, const char *code, location *loc)
+{
+    if (store->block_count == 0)
+    {
+        return false;
+    }
+    const store_block *block = store->blocks[find_block(store, code)];
+    int i = search(block, code);
+    if (i < 0)
+    {
+        return false;
+    }
+    *loc = block->entries[i].coord;
+    return true;
+}
+
+int city_store_size(const city_store *store)
+{
+    return store->size;
+}
+
+static int find_block(const city_store *store, const char *code)
+{
+    int lo = 0;
+    int hi = store->block_count - 1;
+    while (lo < hi)
+    {
+        int middle = lo + (hi - lo + 1) / 2;
+        if (strcmp(store->blocks[middle]->entries[0].code, code) <= 0)
+        {
+            lo = middle;
+        }
+        else
+        {
+            hi = middle - 1;
+        }
+    }
+    return lo;
+}
+
+static int search(const store_block *block, const char *code)
+{
+    int lo = 0;
+    int hi = block->count - 1;
+    while (lo <= hi)
+    {
+        int middle = lo + (hi - lo) / 2;
+        int cmp = strcmp(code, block->entries[middle].code);
+        if (cmp == 0)
+        {
+            return middle;
+        }
+        if (cmp > 0)
+        {
+            lo = middle + 1;
+        }
+        else
+        {
+            hi = middle - 1;
+        }
+    }
+    return -1 - lo;
+}
+
+static bool insert_block(city_store *store, int at, store_block *block)
+{
+    if (store->block_count == store->block_capacity)
+    {
+        int capacity = store->block_capacity ? 2 * store->block_capacity : 64;
+        store_block **bigger = realloc(store->blocks, sizeof(store_block *) * capacity);
+        if (!bigger)
+        {
+            return false;
+        }
+        store->blocks = bigger;
+        store->block_capacity = capacity;
+    }
+    memmove(&store->blocks[at + 1], &store->blocks[at], sizeof(store_block *) * (store->block_count - at));
+    store->blocks[at] = block;
+    store->block_count++;
+    return true;
+}
+
+static void remove_block(city_store *store, int at)
+{
+    free(store->blocks[at]);
+    memmove(&store->blocks[at], &store->blocks[at + 1], sizeof(store_block *) * (store->block_count - at - 1));
+    store->block_count--;
+}
+
+static int compare_positions(const void *a, const void *b)
+{
+    int i = *(const int *)a;
+    int j = *(const int *)b;
+    int cmp = strcmp(cities[i].name, cities[j].name);
+    return cmp != 0 ? cmp : (i > j) - (i < j);
+}
@@ -0,0 +1,87 @@
+#ifndef __CITY_STORE_H__
+#define __CITY_STORE_H__
+
+#include <stdbool.h>
+
+#include "location.h"
+
+// The longest code a city_store holds
+#define CITY_STORE_CODE_MAX 15
+
+// A city database that can be changed one code at a time.  Codes live in
+// sorted blocks of at most 128 entries, reached through a sorted directory
+// of the blocks, as in a B+-tree of height two: a lookup is a binary
+// search of the directory and then of one block, and a change moves
+// entries within one block only.  A full block splits in two, and one
+// that falls below a quarter full after a delete is folded into a
+// neighbour; either way the directory entries after it shift by one.
+// For n codes that is at most n / 32 pointers, and it happens about once
+// per 32 changes, amortized.
+typedef struct city_store city_store;
+
+/**
+ * Returns a new store holding the current contents of cities[], which
+ * need not be sorted.  If a code appears more than once the first entry
+ * wins.
+ *
+ * @return a new store, or NULL if memory could not be allocated
+ */
+city_store *city_store_create();
+
+/**
+ * Frees the given store.
+ *
+ * @param store a store returned by city_store_create, or NULL
+ */
+void city_store_destroy(city_store *store);
+
+/**
+ * Adds a code to the given store in O(log n) plus a move of at most one
+ * block's entries, and a directory shift if the block splits.
+ *
+ * @param store a store
+ * @param code a code of at most CITY_STORE_CODE_MAX characters
+ * @param loc its location
+ * @return true if successful, false if the code is already present, too
+ *         long, or memory could not be allocated
+ */
+bool city_store_insert(city_store *store, const char *code, const location *loc);
+
+/**
+ * Changes the location of a code in the given store in O(log n).
+ *
+ * @param store a store
+ * @param code a code
+ * @param loc its new location
+ * @return true if successful, false if the code is not present
+ */
+bool city_store_update(city_store *store, const char *code, const location *loc);
+
+/**
+ * Removes a code from the given store in O(log n) plus a move of at most
+ * one block's entries, and a directory shift if a block is folded away.
+ *
+ * @param store a store
+ * @param code a code
+ * @return true if successful, false if the code is not present
+ */
+bool city_store_delete(city_store *store, const char *code);
+
+/**
+ * Looks up a code in the given store, like find_city does in cities[].
+ *
+ * @param store a store
+ * @param code a code
+ * @param loc set to its location if found
+ * @return true if the code is present, false otherwise
+ */
+bool city_store_find(const city_store *store, const char *code, location *loc);
+
+/**
+ * Returns the number of codes in the given store.
+ *
+ * @param store a store
+ */
+int city_store_size(const city_store *store);
+
+#endif
@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "cities.h"
+#include "city_cluster.h"
+#include "geo.h"
+
+/**
+ * Clusters cities[] as city_cluster does, by trying every pair, to check
+ * it against.
+ *
+ * @param eps_km the neighbourhood radius in kilometers, positive
+ * @param min_points the number of neighbours that makes a core point
+ * @param cluster_ids an array that can hold city_count ints, filled in
+ *        with the cluster of each entry of cities[] or CLUSTER_NOISE
+ * @return the number of clusters, or -1 if memory could not be allocated
+ */
+int cluster_brute(double eps_km, int min_points, int *cluster_ids);
+
+/**
+ * Returns the root of the set holding x, pointing x straight at it.
+ *
+ * @param parent the parent of each element; roots are their own parents
+ * @param x an element
+ */
+int find_root(int *parent, int x);
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+int main(int argc, char **argv)
+{
+    // Usage: cluster_cities [-e eps_km] [-m min_points] [-t threads] [-c]
+    // Prints "code,cluster" for each entry of cities[], with -1 for noise;
+    // -c also checks the clusters against trying every pair
+    double eps_km = 50.0;
+    int min_points = 4;
+    int threads = 0;
+    bool check = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0)
+        {
+            check = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-e") != 0 && strcmp(argv[i], "-m") != 0 && strcmp(argv[i], "-t") != 0)
+        {
+            fprintf(stderr, "%s: usage: %s [-e eps_km] [-m min_points] [-t threads] [-c]\n", argv[0], argv[0]);
+            return 1;
+        }
+        if (i == argc - 1)
+        {
+            fprintf(stderr, "%s: must specify a value after \"%s\"\n", argv[0], argv[i]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "-e") == 0)
+        {
+            eps_km = atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-m") == 0)
+        {
+            min_points = atoi(argv[i + 1]);
+        }
+        else
+        {
+            threads = atoi(argv[i + 1]);
+        }
+        i++;
+    }
+    if (eps_km <= 0 || min_points < 1)
+    {
+        fprintf(stderr, "%s: eps_km and min_points must be positive\n", argv[0]);
+        return 1;
+    }
+
+    int n = city_count > 0 ? city_count : 1;
+    int *cluster_ids = malloc(sizeof(int) * n);
+    int *expected_ids = malloc(sizeof(int) * n);
+    if (!cluster_ids || !expected_ids)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    double start = now();
+    int clusters = city_cluster(eps_km, min_points, threads, cluster_ids);
+    double elapsed = now() - start;
+    int expected = clusters >= 0 && check ? cluster_brute(eps_km, min_points, expected_ids) : clusters;
+    if (clusters < 0 || expected < 0)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        free(cluster_ids);
+        free(expected_ids);
+        return 1;
+    }
+
+    int noise = 0;
+    int differences = 0;
+    for (int i = 0; i < city_count; i++)
+    {
+        printf("%s,%d\n", cities[i].name, cluster_ids[i]);
+        noise += cluster_ids[i] == CLUSTER_NOISE;
+        differences += check && cluster_ids[i] != expected_ids[i];
+    }
+    free(cluster_ids);
+    free(expected_ids);
+
+    fprintf(stderr, "%d entries, %d clusters, %d noise, %.3f s\n", city_count, clusters, noise, elapsed);
+    if (expected != clusters || differences > 0)
+    {
+        fprintf(stderr, "%s: trying every pair gives %d clusters and differs on %d entries\n", argv[0], expected,
+                differences);
+        return 1;
+    }
+    return 0;
+}
+
+int cluster_brute(double eps_km, int min_points, int *cluster_ids)
+{
+    int n = city_count > 0 ? city_count : 1;
+    bool *core = malloc(sizeof(bool) * n);
+    int *parent = malloc(sizeof(int) * n);
+    if (!core || !parent)
+    {
+        free(core);
+        free(parent);
+        return -1;
+    }
+
+    // Core points have min_points entries within eps_km, themselves included
+    for (int i = 0; i < city_count; i++)
+    {
+        int count = 0;
+        for (int j = 0; j < city_count && count < min_points; j++)
+        {
+            count += geo_spherical_km(&cities[i].coord, &cities[j].coord) <= eps_km;
+        }
+        core[i] = count >= min_points;
+        parent[i] = i;
+    }
+
+    // Core points within eps_km share a set, rooted at its first entry
+    for (int i = 0; i < city_count; i++)
+    {
+        for (int j = i + 1; core[i] && j < city_count; j++)
+        {
+            if (core[j] && geo_spherical_km(&cities[i].coord, &cities[j].coord) <= eps_km)
+            {
+                int a = find_root(parent, i);
+                int b = find_root(parent, j);
+                parent[a > b ? a : b] = a < b ? a : b;
+            }
+        }
+    }
+
+    int clusters = 0;
+    for (int i = 0; i < city_count; i++)
+    {
+        if (core[i] && find_root(parent, i) == i)
+        {
+            cluster_ids[i] = clusters++;
+        }
+    }
+    for (int i = 0; i < city_count; i++)
+    {
+        cluster_ids[i] = core[i] ? cluster_ids[find_root(parent, i)] : CLUSTER_NOISE;
+    }
+
+    // Other entries join the nearest core point within eps_km, the first
+    // one on ties
+    for (int i = 0; i < city_count; i++)
+    {
+        if (core[i])
+        {
+            continue;
+        }
+        int nearest = -1;
+        double nearest_km = 0;
+        for (int j = 0; j < city_count; j++)
+        {
+            double d = core[j] ? geo_spherical_km(&cities[i].coord, &cities[j].coord) : eps_km + 1;
+            if (d <= eps_km && (nearest < 0 || d < nearest_km))
+            {
+                nearest = j;
+                nearest_km = d;
+            }
+        }
+        if (nearest >= 0)
+        {
+            cluster_ids[i] = cluster_ids[nearest];
+        }
+    }
+
+    free(core);
+    free(parent);
+    return clusters;
+}
+
+int find_root(int *parent, int x)
+{
+    int root = x;
+    while (parent[root] != root)
+    {
+        root = parent[root];
+    }
+    while (parent[x] != root)
+    {
+        int next = parent[x];
+        parent[x] = root;
+        x = next;
+    }
+    return root;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
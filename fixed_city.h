@@ -0,0 +1,62 @@
+#ifndef __FIXED_CITY_H__
+#define __FIXED_CITY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "location.h"
+
+// A lookup over a set of 3-character codes fixed at compile time, for
+// builds that only ship a known list of airports.  The list is an X-macro
+// file of FIXED_CITY('L', 'A', 'X', lat, lon) lines; fixed_cities.def by
+// default, or another file given with -DFIXED_CITIES_FILE='"file.def"'.
+// The lookup is a switch the compiler turns into a jump table or a
+// search tree, so it needs no initialization and no heap, and it inlines
+// into its callers.  A code listed twice is a compile error (a duplicate
+// case label) instead of the first entry silently winning.
+#ifndef FIXED_CITIES_FILE
+#define FIXED_CITIES_FILE "fixed_cities.def"
+#endif
+
+// The three characters of a code packed into one integer constant
+#define FIXED_CITY_KEY(a, b, c) \
+    ((uint32_t)(unsigned char)(a) | (uint32_t)(unsigned char)(b) << 8 | (uint32_t)(unsigned char)(c) << 16)
+
+// The number of codes in the list
+enum
+{
+    FIXED_CITY_COUNT = 0
+#define FIXED_CITY(a, b, c, y, x) + 1
+#include FIXED_CITIES_FILE
+#undef FIXED_CITY
+};
+
+/**
+ * Looks up a code in the fixed list, like find_city.
+ *
+ * @param code a code
+ * @param loc set to its location if found
+ * @return true if the code was found, false otherwise
+ */
+static inline bool fixed_city_find(const char *code, location *loc)
+{
+    // Every listed code is exactly 3 characters long
+    if (!code[0] || !code[1] || !code[2] || code[3])
+    {
+        return false;
+    }
+
+    switch (FIXED_CITY_KEY(code[0], code[1], code[2]))
+    {
+#define FIXED_CITY(a, b, c, y, x)     \
+    case FIXED_CITY_KEY(a, b, c):     \
+        loc->lat = (y);               \
+        loc->lon = (x);               \
+        return true;
+#include FIXED_CITIES_FILE
+#undef FIXED_CITY
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cities.h"
+#include "fixed_city.h"
+
+// The codes in the fixed list, for checking and timing it
+static const char fixed_codes[][4] = {
+#define FIXED_CITY(a, b, c, y, x) {a, b, c, '\0'},
+#include FIXED_CITIES_FILE
+#undef FIXED_CITY
+};
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+/**
+ * Looks up codes through the fixed list; kept out of line so its size
+ * can be read from the symbol table with nm -S.
+ */
+__attribute__((noinline)) bool fixed_lookup(const char *code, location *loc);
+
+int main(int argc, char **argv)
+{
+    // Usage: fixed_city_bench [gen CODE...]
+    if (argc > 1 && strcmp(argv[1], "gen") == 0)
+    {
+        // Write a list of the given codes with their locations in cities[]
+        initialize_city_database();
+        for (int i = 2; i < argc; i++)
+        {
+            location loc;
+            if (strlen(argv[i]) != 3 || !find_city(argv[i], &loc))
+            {
+                fprintf(stderr, "%s: %s is not a 3-character code in cities[]\n", argv[0], argv[i]);
+                return 1;
+            }
+            printf("FIXED_CITY('%c', '%c', '%c', %.17g, %.17g)\n", argv[i][0], argv[i][1], argv[i][2], loc.lat, loc.lon);
+        }
+        return 0;
+    }
+    else if (argc > 1)
+    {
+        fprintf(stderr, "%s: usage: %s [gen CODE...]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    // The runtime path includes its startup cost: sorting cities[]
+    double start = now();
+    initialize_city_database();
+    double init = now() - start;
+
+    // Both paths have to agree exactly on every listed code and on misses;
+    // gen prints enough digits for the locations to round-trip
+    int mismatches = 0;
+    for (int i = 0; i < FIXED_CITY_COUNT; i++)
+    {
+        location a;
+        location b;
+        bool in_fixed = fixed_lookup(fixed_codes[i], &a);
+        bool in_table = find_city(fixed_codes[i], &b);
+        if (!in_fixed || !in_table || a.lat != b.lat || a.lon != b.lon)
+        {
+            printf("%s: fixed list and cities[] differ\n", fixed_codes[i]);
+            mismatches++;
+        }
+    }
+    location loc;
+    if (fixed_lookup("ZZ#", &loc) || fixed_lookup("LAXX", &loc) || fixed_lookup("LA", &loc))
+    {
+        printf("fixed list found a code it should not have\n");
+        mismatches++;
+    }
+
+    // Look the codes up in a scattered order, each one many times
+    int lookups = 10000000;
+    int *order = malloc(sizeof(int) * lookups);
+    srand(223);
+    for (int i = 0; i < lookups; i++)
+    {
+        order[i] = rand() % FIXED_CITY_COUNT;
+    }
+
+    long found = 0;
+    start = now();
+    for (int i = 0; i < lookups; i++)
+    {
+        found += fixed_lookup(fixed_codes[order[i]], &loc);
+    }
+    double fixed = now() - start;
+
+    start = now();
+    for (int i = 0; i < lookups; i++)
+    {
+        found += find_city(fixed_codes[order[i]], &loc);
+    }
+    double table = now() - start;
+
+    printf("%d fixed codes, %d in cities[]\n", FIXED_CITY_COUNT, city_count);
+    printf("fixed list: no startup, %.1f ns/lookup\n", fixed * 1e9 / lookups);
+    printf("cities[]:   %.3f ms startup, %.1f ns/lookup\n", init * 1e3, table * 1e9 / lookups);
+    printf("(%ld found)\n", found);
+
+    free(order);
+    return mismatches ? 1 : 0;
+}
+
+bool fixed_lookup(const char *code, location *loc)
+{
+    return fixed_city_find(code, loc);
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "flight_agg.h"
+#include "geo.h"
+#include "work_pool.h"
+
+// Lines are handed out in chunks of about this many bytes
+#define AGG_CHUNK_SIZE (1 << 20)
+
+// Each thread's table starts with this many slots and doubles when half full
+#define AGG_INITIAL_SLOTS 4096
+
+// One slot of a thread's table; key is the pair id plus 1, 0 if empty
+typedef struct
+{
+    uint32_t key;
+    uint64_t count;
+} agg_slot;
+
+typedef struct
+{
+    agg_slot *slots;
+    uint32_t mask;  // slot count - 1
+    uint32_t used;
+    long unknown;
+    bool failed;
+} agg_table;
+
+typedef struct
+{
+    const char *data;
+    size_t size;
+    const city_code_index *index;
+    agg_table *tables;  // one per thread
+} agg_state;
+
+// Adds count flights of the pair with the given id
+static void table_add(agg_table *t, uint32_t pair, uint64_t count);
+
+// Doubles the number of slots of the given table
+static bool table_grow(agg_table *t);
+
+// Counts the flights that begin in one chunk
+static void agg_chunk(int task, int worker, void *arg);
+
+static int compare_slots(const void *a, const void *b);
+
+bool aggregate_flights(const char *path, const city_code_index *index, int threads,
+                       pair_total **totals, int *total_count, long *unknown)
+{
+    *totals = NULL;
+    *total_count = 0;
+    *unknown = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        *totals = malloc(sizeof(pair_total));
+        return *totals != NULL;
+    }
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+    if (threads <= 0)
+    {
+        threads = work_pool_default_threads();
+    }
+
+    agg_state s;
+    s.data = data;
+    s.size = st.st_size;
+    s.index = index;
+    s.tables = calloc(threads, sizeof(agg_table));
+    bool ok = s.tables != NULL;
+    for (int i = 0; ok && i < threads; i++)
+    {
+        s.tables[i].slots = calloc(AGG_INITIAL_SLOTS, sizeof(agg_slot));
+        s.tables[i].mask = AGG_INITIAL_SLOTS - 1;
+        ok = s.tables[i].slots != NULL;
+    }
+
+    if (ok)
+    {
+        int chunks = (int)((s.size + AGG_CHUNK_SIZE - 1) / AGG_CHUNK_SIZE);
+        work_pool_run(chunks, threads, agg_chunk, &s);
+    }
+
+    // Merge the threads' tables into the first one
+    for (int i = 1; ok && i < threads; i++)
+    {
+        agg_table *t = &s.tables[i];
+        for (uint32_t j = 0; j <= t->mask; j++)
+        {
+            if (t->slots[j].key)
+            {
+                table_add(&s.tables[0], t->slots[j].key - 1, t->slots[j].count);
+            }
+        }
+        s.tables[0].unknown += t->unknown;
+        s.tables[0].failed = s.tables[0].failed || t->failed;
+    }
+    ok = ok && !s.tables[0].failed;
+
+    if (ok)
+    {
+        // Squeeze out the empty slots, then sort by key, which is by codes
+        agg_table *t = &s.tables[0];
+        uint32_t n = 0;
+        for (uint32_t j = 0; j <= t->mask; j++)
+        {
+            if (t->slots[j].key)
+            {
+                t->slots[n++] = t->slots[j];
+            }
+        }
+        qsort(t->slots, n, sizeof(agg_slot), compare_slots);
+
+        *totals = malloc(sizeof(pair_total) * (n > 0 ? n : 1));
+        ok = *totals != NULL;
+        for (uint32_t j = 0; ok && j < n; j++)
+        {
+            uint32_t pair = t->slots[j].key - 1;
+            pair_total *p = &(*totals)[j];
+            location from;
+            location to;
+            city_code_from_key(pair / CODE_KEY_COUNT, p->origin);
+            city_code_from_key(pair % CODE_KEY_COUNT, p->dest);
+            city_code_index_find(index, p->origin, 3, &from);
+            city_code_index_find(index, p->dest, 3, &to);
+            p->count = t->slots[j].count;
+            p->total_km = p->count * geo_spherical_km(&from, &to);
+        }
+        *total_count = ok ? (int)n : 0;
+        *unknown = t->unknown;
+    }
+
+    for (int i = 0; s.tables && i < threads; i++)
+    {
+        free(s.tables[i].slots);
+    }
+    free(s.tables);
+    munmap((void *)data, st.st_size);
+    return ok;
+}
+
+static void agg_chunk(int task, int worker, void *arg)
+{
+    agg_state *s = arg;
+    agg_table *t = &s->tables[worker];
+    const char *p = s->data + work_pool_line_start(s->data, s->size, (size_t)task * AGG_CHUNK_SIZE);
+    const char *end = s->data + work_pool_line_start(s->data, s->size, (size_t)(task + 1) * AGG_CHUNK_SIZE);
+
+    while (p < end)
+    {
+        const char *newline = memchr(p, '\n', end - p);
+        const char *line_end = newline ? newline : end;
+        if (line_end > p && line_end[-1] == '\r')
+        {
+            line_end--;
+        }
+
+        if (line_end > p)
+        {
+            // The codes are the first two fields
+            const char *comma = memchr(p, ',', line_end - p);
+            const char *dest = comma ? comma + 1 : line_end;
+            const char *dest_end = comma ? memchr(dest, ',', line_end - dest) : NULL;
+            if (!dest_end)
+            {
+                dest_end = line_end;
+            }
+
+            int from = comma ? city_code_key(p, comma - p) : -1;
+            int to = city_code_key(dest, dest_end - dest);
+            if (city_code_index_contains(s->index, from) && city_code_index_contains(s->index, to))
+            {
+                table_add(t, (uint32_t)from * CODE_KEY_COUNT + to, 1);
+            }
+            else
+            {
+                t->unknown++;
+            }
+        }
+        p = (newline ? newline : end) + 1;
+    }
+}
+
+static void table_add(agg_table *t, uint32_t pair, uint64_t count)
+{
+    if (t->failed)
+    {
+        return;
+    }
+    if (t->used * 2 >= t->mask + 1 && !table_grow(t))
+    {
+        t->failed = true;
+        return;
+    }
+
+    // Fibonacci hashing spreads the dense ids over the table
+    uint32_t key = pair + 1;
+    uint32_t i = (uint32_t)(key * 0x9E3779B97F4A7C15ull >> 32) & t->mask;
+    while (t->slots[i].key && t->slots[i].key != key)
+    {
+        i = (i + 1) & t->mask;
+    }
+    if (!t->slots[i].key)
+    {
+        t->slots[i].key = key;
+        t->used++;
+    }
+    t->slots[i].count += count;
+}
+
+static bool table_grow(agg_table *t)
+{
+    agg_table bigger = *t;
+    bigger.mask = t->mask * 2 + 1;
+    bigger.used = 0;
+    bigger.slots = calloc((size_t)bigger.mask + 1, sizeof(agg_slot));
+    if (!bigger.slots)
+    {
+        return false;
+    }
+    for (uint32_t j = 0; j <= t->mask; j++)
+    {
+        if (t->slots[j].key)
+        {
+            table_add(&bigger, t->slots[j].key - 1, t->slots[j].count);
+        }
+    }
+    free(t->slots);
+    *t = bigger;
+    return true;
+}
+
+static int compare_slots(const void *a, const void *b)
+{
+    uint32_t x = ((const agg_slot *)a)->key;
+    uint32_t y = ((const agg_slot *)b)->key;
+    return (x > y) - (x < y);
+}
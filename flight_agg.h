@@ -0,0 +1,42 @@
+#ifndef __FLIGHT_AGG_H__
+#define __FLIGHT_AGG_H__
+
+#include <stdbool.h>
+
+#include "city_code_index.h"
+
+// A flight log has one flight per line, whose first two comma-separated
+// fields are the origin and destination codes, e.g. "JFK,LHR,2020-09-24";
+// the remaining fields are ignored
+
+// The flights between one ordered pair of airports
+typedef struct
+{
+    char origin[4];
+    char dest[4];
+    long count;
+    double total_km;  // count times the great-circle distance
+} pair_total;
+
+/**
+ * Counts the flights of a log per (origin, destination) pair.  The file is
+ * mapped into memory and cut into chunks at line boundaries; each thread
+ * of a work-stealing pool counts its chunks into its own open-addressing
+ * table keyed by the dense id of the pair, the tables are merged at the
+ * end, and distances are computed once per pair rather than per flight.
+ *
+ * @param path the file to read
+ * @param index an index filled in by city_code_index_build
+ * @param threads the number of threads to use; 0 for one per processor
+ * @param totals set to a new array of the pairs, sorted by origin and then
+ *        destination as strcmp would, which the caller must free
+ * @param total_count set to the number of pairs
+ * @param unknown set to the number of flights skipped because a code was
+ *        missing or not in the index
+ * @return true if successful, false if the file could not be read or
+ *         memory could not be allocated
+ */
+bool aggregate_flights(const char *path, const city_code_index *index, int threads,
+                       pair_total **totals, int *total_count, long *unknown);
+
+#endif
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cities.h"
+#include "flight_agg.h"
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+int main(int argc, char **argv)
+{
+    // Usage: flight_totals [-t threads] [-o file] log
+    // Writes "origin,dest,count,total_km" lines sorted by origin and dest
+    int threads = 0;
+    FILE *output = stdout;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i < argc - 1)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i < argc - 1)
+        {
+            output = fopen(argv[++i], "w");
+            if (!output)
+            {
+                fprintf(stderr, "%s: could not open %s\n", argv[0], argv[i]);
+                return 1;
+            }
+        }
+        else if (!path && argv[i][0] != '-')
+        {
+            path = argv[i];
+        }
+        else
+        {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path)
+    {
+        fprintf(stderr, "%s: usage: %s [-t threads] [-o file] log\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    initialize_city_database();
+    city_code_index index;
+    if (!city_code_index_build(&index))
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    pair_total *totals;
+    int count;
+    long unknown;
+    double start = now();
+    if (!aggregate_flights(path, &index, threads, &totals, &count, &unknown))
+    {
+        fprintf(stderr, "%s: could not aggregate %s\n", argv[0], path);
+        city_code_index_destroy(&index);
+        return 1;
+    }
+    double elapsed = now() - start;
+
+    long flights = unknown;
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(output, "%s,%s,%ld,%.3f\n", totals[i].origin, totals[i].dest, totals[i].count, totals[i].total_km);
+        flights += totals[i].count;
+    }
+    fprintf(stderr, "%ld flights, %d pairs, %ld with unknown codes, %.1f M flights/s\n",
+            flights, count, unknown, flights / elapsed / 1e6);
+
+    free(totals);
+    city_code_index_destroy(&index);
+    return 0;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
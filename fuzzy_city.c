@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cities.h"
+#include "city_fuzzy.h"
+
+// The most matches printed for one code
+#define MAX_MATCHES 20
+
+// Each code is looked up this many times for the timing
+#define REPEATS 10000
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+int main(int argc, char **argv)
+{
+    // Usage: fuzzy_city [-d distance] code...
+    int distance = 1;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-d") == 0)
+    {
+        distance = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || distance < 1 || distance > FUZZY_MAX_DISTANCE)
+    {
+        fprintf(stderr, "%s: usage: %s [-d 1-%d] code...\n", argv[0], argv[0], FUZZY_MAX_DISTANCE);
+        return 1;
+    }
+
+    initialize_city_database();
+    double start = now();
+    city_fuzzy *fuzzy = city_fuzzy_build(city_count, cities, distance);
+    double build = now() - start;
+    if (!fuzzy)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    fuzzy_match matches[MAX_MATCHES];
+    for (int i = first; i < argc; i++)
+    {
+        int count = city_fuzzy_find(fuzzy, argv[i], distance, matches, MAX_MATCHES);
+        printf("%s:", argv[i]);
+        for (int m = 0; m < count && m < MAX_MATCHES; m++)
+        {
+            printf(" %s(%d)", matches[m].code, matches[m].distance);
+        }
+        if (count > MAX_MATCHES)
+        {
+            printf(" and %d more", count - MAX_MATCHES);
+        }
+        printf("\n");
+    }
+
+    start = now();
+    long found = 0;
+    for (int r = 0; r < REPEATS; r++)
+    {
+        for (int i = first; i < argc; i++)
+        {
+            found += city_fuzzy_find(fuzzy, argv[i], distance, matches, MAX_MATCHES);
+        }
+    }
+    double elapsed = now() - start;
+    fprintf(stderr, "built in %.3f ms, %.2f us per lookup (%ld found)\n",
+            build * 1e3, elapsed * 1e6 / REPEATS / (argc - first), found);
+
+    city_fuzzy_destroy(fuzzy);
+    return 0;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
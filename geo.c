@@ -0,0 +1,477 @@
+#include <math.h>
+#include <stdbool.h>
+
+#include "cities.h"
+#include "geo.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define PI 3.14159265358979323846
+#define RADIANS (PI / 180.0)
+
+// Vincenty stops once lambda moves by less than this (about 0.06 mm)
+#define GEODESIC_TOLERANCE 1e-12
+#define GEODESIC_MAX_ITERATIONS 200
+
+// Nearly antipodal pairs, where Vincenty's inverse iteration can fail, are
+// measured through a point this far from the first along each of a few
+// azimuths, then along the best azimuth found to within the tolerance
+#define ANTIPODAL_LEG_KM 10000.0
+#define ANTIPODAL_AZIMUTHS 72
+#define ANTIPODAL_TOLERANCE 1e-10
+
+// Vincenty's inverse solution; returns false if it doesn't converge
+static bool vincenty_inverse(const location *l1, const location *l2, double *km);
+
+// Vincenty's direct solution: the location the given distance away along
+// the geodesic leaving at the given azimuth (radians clockwise from north)
+static location vincenty_direct(const location *from, double azimuth, double km);
+
+// Returns the length of the path that follows the geodesic from l1 at the
+// given azimuth for ANTIPODAL_LEG_KM, then the geodesic on to l2
+static double path_via_azimuth(const location *l1, const location *l2, double azimuth);
+
+// Returns the geodesic distance of a nearly antipodal pair: every such
+// path is at least as long, so the shortest over the azimuth is it
+static double antipodal_km(const location *l1, const location *l2);
+
+#ifdef __SSE2__
+// Returns the lanes of a where mask is set and of b elsewhere
+static __m128d select_pd(__m128d mask, __m128d a, __m128d b);
+
+// Finds the sine and cosine of angles from -pi/2 to pi/2
+static void sincos_pd(__m128d x, __m128d *s, __m128d *c);
+
+// Returns the arctangent of any value, infinities included
+static __m128d atan_pd(__m128d x);
+
+// Returns half the difference between longitudes in degrees, as an angle
+// from 0 to pi/2
+static __m128d half_dlon_pd(__m128d lon1, __m128d lon2);
+
+// The two-lane versions of geo_spherical_km and geo_andoyer_km, with
+// latitudes and longitudes in degrees
+static __m128d spherical_pd(__m128d lat1, __m128d lon1, __m128d lat2, __m128d lon2);
+static __m128d andoyer_pd(__m128d lat1, __m128d lon1, __m128d lat2, __m128d lon2);
+#endif
+
+double geo_spherical_km(const location *l1, const location *l2)
+{
+    double sd = sin((l2->lat - l1->lat) * RADIANS / 2);
+    double cd = cos((l2->lat - l1->lat) * RADIANS / 2);
+    double ss = sin((l1->lat + l2->lat) * RADIANS / 2);
+    double cs = cos((l1->lat + l2->lat) * RADIANS / 2);
+    double sl = sin((l2->lon - l1->lon) * RADIANS / 2);
+    double cl = cos((l2->lon - l1->lon) * RADIANS / 2);
+
+    // The haversine a = sin^2(sigma / 2) and 1 - a, each a sum of squares
+    // so that neither loses digits near 0 or near antipodes
+    double a = sd * sd * cl * cl + cs * cs * sl * sl;
+    double b = cd * cd * cl * cl + ss * ss * sl * sl;
+    return 2 * GEO_MEAN_RADIUS_KM * atan2(sqrt(a), sqrt(b));
+}
+
+double geo_andoyer_km(const location *l1, const location *l2)
+{
+    const double f = GEO_WGS84_F;
+
+    // Central angle between the reduced latitudes
+    double b1 = atan((1 - f) * tan(l1->lat * RADIANS));
+    double b2 = atan((1 - f) * tan(l2->lat * RADIANS));
+    double sp = sin((b1 + b2) / 2);
+    double cp = cos((b1 + b2) / 2);
+    double sq = sin((b2 - b1) / 2);
+    double cq = cos((b2 - b1) / 2);
+    double sl = sin((l2->lon - l1->lon) * RADIANS / 2);
+    double cl = cos((l2->lon - l1->lon) * RADIANS / 2);
+
+    // h = sin^2(sigma / 2) and k = cos^2(sigma / 2), as in
+    // geo_spherical_km
+    double h = sq * sq * cl * cl + cp * cp * sl * sl;
+    double k = cq * cq * cl * cl + sp * sp * sl * sl;
+    double sigma = 2 * atan2(sqrt(h), sqrt(k));
+    if (sigma == 0)
+    {
+        return 0;
+    }
+
+    // The first-order correction for the flattening; at exact antipodes
+    // b1 = -b2, so sp and with it x go to 0
+    double x = k == 0 ? 0 : (sigma - sin(sigma)) * sp * sp * cq * cq / k;
+    double y = (sigma + sin(sigma)) * cp * cp * sq * sq / h;
+    return GEO_WGS84_A_KM * (sigma - f / 2 * (x + y));
+}
+
+double geo_geodesic_km(const location *l1, const location *l2)
+{
+    double km;
+    return vincenty_inverse(l1, l2, &km) ? km : antipodal_km(l1, l2);
+}
+
+double geo_distance(const location *l1, const location *l2, geo_mode mode)
+{
+    switch (mode)
+    {
+        case GEO_ANDOYER:
+            return geo_andoyer_km(l1, l2);
+        case GEO_GEODESIC:
+            return geo_geodesic_km(l1, l2);
+        default:
+            return geo_spherical_km(l1, l2);
+    }
+}
+
+void geo_distance_batch(int n, const location *from, const location *to, double *out, geo_mode mode)
+{
+    int i = 0;
+#ifdef __SSE2__
+    // Two pairs at a time, with the trig functions inlined as polynomials
+    if (mode == GEO_SPHERICAL || mode == GEO_ANDOYER)
+    {
+        for (; i + 2 <= n; i += 2)
+        {
+            __m128d lat1 = _mm_set_pd(from[i + 1].lat, from[i].lat);
+            __m128d lon1 = _mm_set_pd(from[i + 1].lon, from[i].lon);
+            __m128d lat2 = _mm_set_pd(to[i + 1].lat, to[i].lat);
+            __m128d lon2 = _mm_set_pd(to[i + 1].lon, to[i].lon);
+            __m128d d = mode == GEO_ANDOYER ? andoyer_pd(lat1, lon1, lat2, lon2) : spherical_pd(lat1, lon1, lat2, lon2);
+            _mm_storeu_pd(out + i, d);
+        }
+    }
+#endif
+    for (; i < n; i++)
+    {
+        out[i] = geo_distance(&from[i], &to[i], mode);
+    }
+}
+
+double city_distance(const char *code1, const char *code2, geo_mode mode)
+{
+    location l1;
+    location l2;
+    if (!find_city(code1, &l1) || !find_city(code2, &l2))
+    {
+        return -1;
+    }
+    return geo_distance(&l1, &l2, mode);
+}
+
+static bool vincenty_inverse(const location *l1, const location *l2, double *km)
+{
+    const double a = GEO_WGS84_A_KM;
+    const double f = GEO_WGS84_F;
+    const double b = a * (1 - f);
+
+    double u1 = atan((1 - f) * tan(l1->lat * RADIANS));
+    double u2 = atan((1 - f) * tan(l2->lat * RADIANS));
+    double sin_u1 = sin(u1), cos_u1 = cos(u1);
+    double sin_u2 = sin(u2), cos_u2 = cos(u2);
+    double l = remainder(l2->lon - l1->lon, 360.0) * RADIANS;
+
+    double lambda = l;
+    double sin_sigma, cos_sigma, sigma, cos_sq_alpha, cos_2sigma_m;
+    int i;
+    for (i = 0; i < GEODESIC_MAX_ITERATIONS; i++)
+    {
+        double sin_lambda = sin(lambda);
+        double cos_lambda = cos(lambda);
+        double t1 = cos_u2 * sin_lambda;
+        double t2 = cos_u1 * sin_u2 - sin_u1 * cos_u2 * cos_lambda;
+        sin_sigma = sqrt(t1 * t1 + t2 * t2);
+        if (sin_sigma == 0)
+        {
+            // Coincident points
+            *km = 0;
+            return true;
+        }
+        cos_sigma = sin_u1 * sin_u2 + cos_u1 * cos_u2 * cos_lambda;
+        sigma = atan2(sin_sigma, cos_sigma);
+        double sin_alpha = cos_u1 * cos_u2 * sin_lambda / sin_sigma;
+        cos_sq_alpha = 1 - sin_alpha * sin_alpha;
+
+        // On the equator cos_sq_alpha is 0 and the term drops out
+        cos_2sigma_m = cos_sq_alpha != 0 ? cos_sigma - 2 * sin_u1 * sin_u2 / cos_sq_alpha : 0;
+        double c = f / 16 * cos_sq_alpha * (4 + f * (4 - 3 * cos_sq_alpha));
+        double previous = lambda;
+        lambda = l + (1 - c) * f * sin_alpha
+                 * (sigma + c * sin_sigma * (cos_2sigma_m + c * cos_sigma * (-1 + 2 * cos_2sigma_m * cos_2sigma_m)));
+        if (fabs(lambda - previous) < GEODESIC_TOLERANCE)
+        {
+            break;
+        }
+    }
+    if (i == GEODESIC_MAX_ITERATIONS || fabs(lambda) > PI)
+    {
+        return false;
+    }
+
+    double u_sq = cos_sq_alpha * (a * a - b * b) / (b * b);
+    double big_a = 1 + u_sq / 16384 * (4096 + u_sq * (-768 + u_sq * (320 - 175 * u_sq)));
+    double big_b = u_sq / 1024 * (256 + u_sq * (-128 + u_sq * (74 - 47 * u_sq)));
+    double delta_sigma = big_b * sin_sigma
+        * (cos_2sigma_m + big_b / 4
+           * (cos_sigma * (-1 + 2 * cos_2sigma_m * cos_2sigma_m)
+              - big_b / 6 * cos_2sigma_m * (-3 + 4 * sin_sigma * sin_sigma) * (-3 + 4 * cos_2sigma_m * cos_2sigma_m)));
+    *km = b * big_a * (sigma - delta_sigma);
+    return true;
+}
+
+static location vincenty_direct(const location *from, double azimuth, double km)
+{
+    const double a = GEO_WGS84_A_KM;
+    const double f = GEO_WGS84_F;
+    const double b = a * (1 - f);
+
+    double u1 = atan((1 - f) * tan(from->lat * RADIANS));
+    double sin_u1 = sin(u1), cos_u1 = cos(u1);
+    double sin_alpha1 = sin(azimuth), cos_alpha1 = cos(azimuth);
+    double sigma1 = atan2(sin_u1, cos_u1 * cos_alpha1);
+    double sin_alpha = cos_u1 * sin_alpha1;
+    double cos_sq_alpha = 1 - sin_alpha * sin_alpha;
+    double u_sq = cos_sq_alpha * (a * a - b * b) / (b * b);
+    double big_a = 1 + u_sq / 16384 * (4096 + u_sq * (-768 + u_sq * (320 - 175 * u_sq)));
+    double big_b = u_sq / 1024 * (256 + u_sq * (-128 + u_sq * (74 - 47 * u_sq)));
+
+    // Unlike the inverse, this iteration always converges
+    double sigma = km / (b * big_a);
+    double sin_sigma, cos_sigma, cos_2sigma_m;
+    for (int i = 0; i < GEODESIC_MAX_ITERATIONS; i++)
+    {
+        cos_2sigma_m = cos(2 * sigma1 + sigma);
+        sin_sigma = sin(sigma);
+        cos_sigma = cos(sigma);
+        double delta_sigma = big_b * sin_sigma
+            * (cos_2sigma_m + big_b / 4
+               * (cos_sigma * (-1 + 2 * cos_2sigma_m * cos_2sigma_m)
+                  - big_b / 6 * cos_2sigma_m * (-3 + 4 * sin_sigma * sin_sigma) * (-3 + 4 * cos_2sigma_m * cos_2sigma_m)));
+        double previous = sigma;
+        sigma = km / (b * big_a) + delta_sigma;
+        if (fabs(sigma - previous) < GEODESIC_TOLERANCE)
+        {
+            break;
+        }
+    }
+    cos_2sigma_m = cos(2 * sigma1 + sigma);
+    sin_sigma = sin(sigma);
+    cos_sigma = cos(sigma);
+
+    double t = sin_u1 * sin_sigma - cos_u1 * cos_sigma * cos_alpha1;
+    double lat = atan2(sin_u1 * cos_sigma + cos_u1 * sin_sigma * cos_alpha1,
+                       (1 - f) * sqrt(sin_alpha * sin_alpha + t * t));
+    double lambda = atan2(sin_sigma * sin_alpha1, cos_u1 * cos_sigma - sin_u1 * sin_sigma * cos_alpha1);
+    double c = f / 16 * cos_sq_alpha * (4 + f * (4 - 3 * cos_sq_alpha));
+    double l = lambda - (1 - c) * f * sin_alpha
+               * (sigma + c * sin_sigma * (cos_2sigma_m + c * cos_sigma * (-1 + 2 * cos_2sigma_m * cos_2sigma_m)));
+
+    location to;
+    to.lat = lat / RADIANS;
+    to.lon = remainder(from->lon + l / RADIANS, 360.0);
+    return to;
+}
+
+static double path_via_azimuth(const location *l1, const location *l2, double azimuth)
+{
+    // The second leg is about a quarter of the way around, where the
+    // inverse iteration converges
+    location middle = vincenty_direct(l1, azimuth, ANTIPODAL_LEG_KM);
+    double km;
+    if (!vincenty_inverse(&middle, l2, &km))
+    {
+        km = geo_andoyer_km(&middle, l2);
+    }
+    return ANTIPODAL_LEG_KM + km;
+}
+
+static double antipodal_km(const location *l1, const location *l2)
+{
+    // A coarse scan of the azimuth finds the neighborhood of the shortest
+    // path; a golden-section search then narrows it down
+    const double step = 2 * PI / ANTIPODAL_AZIMUTHS;
+    double best = HUGE_VAL;
+    double best_azimuth = 0;
+    for (int i = 0; i < ANTIPODAL_AZIMUTHS; i++)
+    {
+        double km = path_via_azimuth(l1, l2, i * step);
+        if (km < best)
+        {
+            best = km;
+            best_azimuth = i * step;
+        }
+    }
+
+    const double ratio = 0.61803398874989484820;
+    double lo = best_azimuth - step;
+    double hi = best_azimuth + step;
+    double x1 = hi - ratio * (hi - lo);
+    double x2 = lo + ratio * (hi - lo);
+    double f1 = path_via_azimuth(l1, l2, x1);
+    double f2 = path_via_azimuth(l1, l2, x2);
+    while (hi - lo > ANTIPODAL_TOLERANCE)
+    {
+        if (f1 < f2)
+        {
+            hi = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = hi - ratio * (hi - lo);
+            f1 = path_via_azimuth(l1, l2, x1);
+        }
+        else
+        {
+            lo = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = lo + ratio * (hi - lo);
+            f2 = path_via_azimuth(l1, l2, x2);
+        }
+    }
+    return fmin(best, fmin(f1, f2));
+}
+
+#ifdef __SSE2__
+static __m128d select_pd(__m128d mask, __m128d a, __m128d b)
+{
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+static void sincos_pd(__m128d x, __m128d *s, __m128d *c)
+{
+    // The Cephes polynomials for sine and cosine from 0 to pi/4; above
+    // that, sin(x) = cos(pi/2 - x) and cos(x) = sin(pi/2 - x)
+    const __m128d sign_bit = _mm_set1_pd(-0.0);
+    __m128d sign = _mm_and_pd(x, sign_bit);
+    __m128d ax = _mm_andnot_pd(sign_bit, x);
+    __m128d high = _mm_cmpgt_pd(ax, _mm_set1_pd(PI / 4));
+    __m128d folded = _mm_add_pd(_mm_sub_pd(_mm_set1_pd(1.57079632679489655800), ax),
+                                _mm_set1_pd(6.12323399573676603587e-17));
+    __m128d r = select_pd(high, folded, ax);
+    __m128d z = _mm_mul_pd(r, r);
+
+    __m128d ps = _mm_set1_pd(1.58962301576546568060e-10);
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(-2.50507477628578072866e-8));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(2.75573136213857245213e-6));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(-1.98412698295895385996e-4));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(8.33333333332211858878e-3));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(-1.66666666666666307295e-1));
+    __m128d sin_r = _mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(r, z), ps));
+
+    __m128d pc = _mm_set1_pd(-1.13585365213876817300e-11);
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(2.08757008419747316778e-9));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(-2.75573141792967388112e-7));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(2.48015872888517045348e-5));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(-1.38888888888730564116e-3));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(4.16666666666665929218e-2));
+    __m128d cos_r = _mm_add_pd(_mm_sub_pd(_mm_set1_pd(1.0), _mm_mul_pd(_mm_set1_pd(0.5), z)),
+                               _mm_mul_pd(_mm_mul_pd(z, z), pc));
+
+    *s = _mm_or_pd(select_pd(high, cos_r, sin_r), sign);
+    *c = select_pd(high, sin_r, cos_r);
+}
+
+static __m128d atan_pd(__m128d x)
+{
+    // The Cephes rational approximation from 0 to 0.66, with larger values
+    // brought into range by atan(x) = pi/4 + atan((x - 1) / (x + 1)) up to
+    // tan(3pi/8) and atan(x) = pi/2 - atan(1 / x) beyond
+    const __m128d sign_bit = _mm_set1_pd(-0.0);
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d more_bits = _mm_set1_pd(6.123233995736765886130e-17);
+    __m128d sign = _mm_and_pd(x, sign_bit);
+    __m128d ax = _mm_andnot_pd(sign_bit, x);
+    __m128d high = _mm_cmpgt_pd(ax, _mm_set1_pd(2.41421356237309504880));
+    __m128d middle = _mm_andnot_pd(high, _mm_cmpgt_pd(ax, _mm_set1_pd(0.66)));
+    __m128d r = select_pd(high, _mm_div_pd(_mm_set1_pd(-1.0), ax),
+                          select_pd(middle, _mm_div_pd(_mm_sub_pd(ax, one), _mm_add_pd(ax, one)), ax));
+    __m128d base = _mm_or_pd(_mm_and_pd(high, _mm_add_pd(_mm_set1_pd(PI / 2), more_bits)),
+                             _mm_and_pd(middle, _mm_add_pd(_mm_set1_pd(PI / 4), _mm_mul_pd(_mm_set1_pd(0.5), more_bits))));
+    __m128d z = _mm_mul_pd(r, r);
+
+    __m128d p = _mm_set1_pd(-8.750608600031904122785e-1);
+    p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-1.615753718733365076637e1));
+    p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-7.500855792314704667340e1));
+    p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-1.228866684490136173410e2));
+    p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-6.485021904942025371773e1));
+    __m128d q = _mm_add_pd(z, _mm_set1_pd(2.485846490142306297962e1));
+    q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(1.650270098316988542046e2));
+    q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(4.328810604912902668951e2));
+    q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(4.853903996359136964868e2));
+    q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(1.945506571482613964425e2));
+    __m128d y = _mm_add_pd(r, _mm_mul_pd(r, _mm_div_pd(_mm_mul_pd(z, p), q)));
+    return _mm_or_pd(_mm_add_pd(base, y), sign);
+}
+
+static __m128d half_dlon_pd(__m128d lon1, __m128d lon2)
+{
+    // Brings the difference into [0, 360), then to at most 180 by symmetry
+    const __m128d full = _mm_set1_pd(360.0);
+    __m128d d = _mm_andnot_pd(_mm_set1_pd(-0.0), _mm_sub_pd(lon2, lon1));
+    __m128d turns = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_div_pd(d, full)));
+    d = _mm_sub_pd(d, _mm_mul_pd(turns, full));
+    d = _mm_min_pd(d, _mm_sub_pd(full, d));
+    return _mm_mul_pd(d, _mm_set1_pd(RADIANS / 2));
+}
+
+static __m128d spherical_pd(__m128d lat1, __m128d lon1, __m128d lat2, __m128d lon2)
+{
+    const __m128d half_radians = _mm_set1_pd(RADIANS / 2);
+    __m128d sd, cd, ss, cs, sl, cl;
+    sincos_pd(_mm_mul_pd(_mm_sub_pd(lat2, lat1), half_radians), &sd, &cd);
+    sincos_pd(_mm_mul_pd(_mm_add_pd(lat1, lat2), half_radians), &ss, &cs);
+    sincos_pd(half_dlon_pd(lon1, lon2), &sl, &cl);
+
+    // sigma / 2 = atan(sqrt(a) / sqrt(1 - a)), with a and 1 - a found as in
+    // geo_spherical_km
+    __m128d cl2 = _mm_mul_pd(cl, cl);
+    __m128d sl2 = _mm_mul_pd(sl, sl);
+    __m128d a = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(sd, sd), cl2), _mm_mul_pd(_mm_mul_pd(cs, cs), sl2));
+    __m128d b = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(cd, cd), cl2), _mm_mul_pd(_mm_mul_pd(ss, ss), sl2));
+    __m128d half_sigma = atan_pd(_mm_div_pd(_mm_sqrt_pd(a), _mm_sqrt_pd(b)));
+    return _mm_mul_pd(_mm_set1_pd(2 * GEO_MEAN_RADIUS_KM), half_sigma);
+}
+
+static __m128d andoyer_pd(__m128d lat1, __m128d lon1, __m128d lat2, __m128d lon2)
+{
+    const double f = GEO_WGS84_F;
+    const __m128d radians = _mm_set1_pd(RADIANS);
+    const __m128d half = _mm_set1_pd(0.5);
+
+    // Reduced latitudes, with atan((1 - f) tan(lat)) going to +-pi/2 at
+    // the poles where cos(lat) is 0
+    __m128d s1, c1, s2, c2;
+    sincos_pd(_mm_mul_pd(lat1, radians), &s1, &c1);
+    sincos_pd(_mm_mul_pd(lat2, radians), &s2, &c2);
+    __m128d b1 = atan_pd(_mm_div_pd(_mm_mul_pd(_mm_set1_pd(1 - f), s1), c1));
+    __m128d b2 = atan_pd(_mm_div_pd(_mm_mul_pd(_mm_set1_pd(1 - f), s2), c2));
+
+    // Central angle between them, with h and k found as in geo_andoyer_km
+    __m128d sp, cp, sq, cq, sl, cl;
+    sincos_pd(_mm_mul_pd(_mm_add_pd(b1, b2), half), &sp, &cp);
+    sincos_pd(_mm_mul_pd(_mm_sub_pd(b2, b1), half), &sq, &cq);
+    sincos_pd(half_dlon_pd(lon1, lon2), &sl, &cl);
+    __m128d sp2 = _mm_mul_pd(sp, sp);
+    __m128d cp2 = _mm_mul_pd(cp, cp);
+    __m128d sq2 = _mm_mul_pd(sq, sq);
+    __m128d cq2 = _mm_mul_pd(cq, cq);
+    __m128d sl2 = _mm_mul_pd(sl, sl);
+    __m128d cl2 = _mm_mul_pd(cl, cl);
+    __m128d h = _mm_add_pd(_mm_mul_pd(sq2, cl2), _mm_mul_pd(cp2, sl2));
+    __m128d k = _mm_add_pd(_mm_mul_pd(cq2, cl2), _mm_mul_pd(sp2, sl2));
+    __m128d sh = _mm_sqrt_pd(h);
+    __m128d ch = _mm_sqrt_pd(k);
+    __m128d sigma = _mm_mul_pd(_mm_set1_pd(2.0), atan_pd(_mm_div_pd(sh, ch)));
+
+    // The first-order correction for the flattening, with sin(sigma) =
+    // 2 sh ch / (h + k).  Instead of branching, the lanes of x at exact
+    // antipodes and of the result at coincident points, which divide by 0,
+    // are set to 0
+    __m128d ss = _mm_div_pd(_mm_mul_pd(_mm_set1_pd(2.0), _mm_mul_pd(sh, ch)), _mm_add_pd(h, k));
+    __m128d x = _mm_div_pd(_mm_mul_pd(_mm_sub_pd(sigma, ss), _mm_mul_pd(sp2, cq2)), k);
+    __m128d y = _mm_div_pd(_mm_mul_pd(_mm_add_pd(sigma, ss), _mm_mul_pd(cp2, sq2)), h);
+    x = _mm_andnot_pd(_mm_cmpeq_pd(k, _mm_setzero_pd()), x);
+    __m128d d = _mm_mul_pd(_mm_set1_pd(GEO_WGS84_A_KM),
+                           _mm_sub_pd(sigma, _mm_mul_pd(_mm_set1_pd(f / 2), _mm_add_pd(x, y))));
+    return _mm_andnot_pd(_mm_cmpeq_pd(h, _mm_setzero_pd()), d);
+}
+#endif
@@ -0,0 +1,94 @@
+#ifndef __GEO_H__
+#define __GEO_H__
+
+#include "location.h"
+
+// How to measure the distance between two locations
+typedef enum
+{
+    GEO_SPHERICAL,  // haversine on a sphere of the mean earth radius;
+                    // off by up to about 0.5% from the ellipsoid
+    GEO_ANDOYER,    // Andoyer-Lambert first-order flattening correction on
+                    // the WGS-84 ellipsoid; within 15 m of the geodesic up
+                    // to 10,000 km, 60 m up to 15,000 km and 5 km up to
+                    // 19,900 km, but up to 34 km off for nearly antipodal
+                    // pairs
+    GEO_GEODESIC    // Vincenty's inverse solution on the WGS-84 ellipsoid;
+                    // within a millimeter everywhere, but iterative and
+                    // slower, and much slower for nearly antipodal pairs
+} geo_mode;
+
+// The mean earth radius, and the WGS-84 ellipsoid, in kilometers
+#define GEO_MEAN_RADIUS_KM 6371.0088
+#define GEO_WGS84_A_KM 6378.137
+#define GEO_WGS84_F (1 / 298.257223563)
+
+/**
+ * Returns the great-circle distance between two locations, in kilometers.
+ *
+ * @param l1 a location
+ * @param l2 a location
+ */
+double geo_spherical_km(const location *l1, const location *l2);
+
+/**
+ * Returns the Andoyer-Lambert approximation of the geodesic distance
+ * between two locations on the WGS-84 ellipsoid, in kilometers.  It costs
+ * about as much as geo_spherical_km and has no loops.
+ *
+ * @param l1 a location
+ * @param l2 a location
+ */
+double geo_andoyer_km(const location *l1, const location *l2);
+
+/**
+ * Returns the geodesic distance between two locations on the WGS-84
+ * ellipsoid, in kilometers, by Vincenty's method.  For the nearly
+ * antipodal pairs where the iteration does not converge, the distance is
+ * instead the shortest path that follows a geodesic from l1 for 10,000 km
+ * and then one on to l2, minimized over the starting azimuth; this takes
+ * a few hundred times as long.
+ *
+ * @param l1 a location
+ * @param l2 a location
+ */
+double geo_geodesic_km(const location *l1, const location *l2);
+
+/**
+ * Returns the distance between two locations in the given mode, in
+ * kilometers.
+ *
+ * @param l1 a location
+ * @param l2 a location
+ * @param mode GEO_SPHERICAL, GEO_ANDOYER or GEO_GEODESIC
+ */
+double geo_distance(const location *l1, const location *l2, geo_mode mode);
+
+/**
+ * Fills in out[i] with the distance from from[i] to to[i] for every i.
+ * With SSE2, spherical and Andoyer-Lambert distances are found two pairs
+ * at a time, with polynomial sine, cosine and arctangent in place of the
+ * math library; they agree with geo_spherical_km and geo_andoyer_km to
+ * within a few micrometers, antipodal and coincident points included.
+ * Geodesic distances are found one at a time.
+ *
+ * @param n a nonnegative integer
+ * @param from an array of n locations
+ * @param to an array of n locations
+ * @param out an array that can hold n distances
+ * @param mode GEO_SPHERICAL, GEO_ANDOYER or GEO_GEODESIC
+ */
+void geo_distance_batch(int n, const location *from, const location *to, double *out, geo_mode mode);
+
+/**
+ * Returns the distance between the cities with the given codes, in
+ * kilometers, looked up with find_city.
+ *
+ * @param code1 a code
+ * @param code2 a code
+ * @param mode GEO_SPHERICAL, GEO_ANDOYER or GEO_GEODESIC
+ * @return the distance, or -1 if either code is not found
+ */
+double city_distance(const char *code1, const char *code2, geo_mode mode);
+
+#endif
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "cities.h"
+#include "geo.h"
+
+// The batch may differ from the scalar functions by at most this, in km
+#define GEO_BENCH_TOLERANCE 1e-6
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+int main(int argc, char **argv)
+{
+    // Usage: geo_bench [rounds]
+    int rounds = argc > 1 ? atoi(argv[1]) : 100;
+    if (rounds < 1)
+    {
+        fprintf(stderr, "%s: rounds must be positive\n", argv[0]);
+        return 1;
+    }
+
+    // Each entry of cities[] is paired with a scattered other entry, with
+    // its own antipode and with itself, the last two being where the
+    // formulas divide by 0
+    int n = 3 * city_count;
+    location *from = malloc(sizeof(location) * n);
+    location *to = malloc(sizeof(location) * n);
+    double *scalar = malloc(sizeof(double) * n);
+    double *batch = malloc(sizeof(double) * n);
+    if (!from || !to || !scalar || !batch)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+    for (int i = 0; i < city_count; i++)
+    {
+        location here = cities[i].coord;
+        from[3 * i] = here;
+        from[3 * i + 1] = here;
+        from[3 * i + 2] = here;
+        to[3 * i] = cities[(int)(((long)i * 7919 + 1) % city_count)].coord;
+        to[3 * i + 1].lat = -here.lat;
+        to[3 * i + 1].lon = here.lon > 0 ? here.lon - 180 : here.lon + 180;
+        to[3 * i + 2] = here;
+    }
+
+    const geo_mode modes[] = {GEO_SPHERICAL, GEO_ANDOYER};
+    const char *names[] = {"spherical", "andoyer"};
+    int mismatches = 0;
+    printf("%d pairs x %d rounds\n", n, rounds);
+    for (int m = 0; m < 2; m++)
+    {
+        double start = now();
+        for (int r = 0; r < rounds; r++)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                scalar[i] = geo_distance(&from[i], &to[i], modes[m]);
+            }
+        }
+        double scalar_time = now() - start;
+
+        start = now();
+        for (int r = 0; r < rounds; r++)
+        {
+            geo_distance_batch(n, from, to, batch, modes[m]);
+        }
+        double batch_time = now() - start;
+
+        // NaN fails the comparison too
+        double worst = 0;
+        for (int i = 0; i < n; i++)
+        {
+            double error = fabs(batch[i] - scalar[i]);
+            if (!(error <= GEO_BENCH_TOLERANCE))
+            {
+                mismatches++;
+            }
+            else if (error > worst)
+            {
+                worst = error;
+            }
+        }
+
+        double pairs = (double)n * rounds;
+        printf("%-9s  scalar: %.1f M pairs/s  batch: %.1f M pairs/s (%.1fx)  largest difference %.3g km\n",
+               names[m], pairs / scalar_time / 1e6, pairs / batch_time / 1e6, scalar_time / batch_time, worst);
+    }
+    printf("mismatches: %d\n", mismatches);
+
+    free(batch);
+    free(scalar);
+    free(to);
+    free(from);
+    return mismatches == 0 ? 0 : 1;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,225 @@
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "geohash.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define GEOHASH_HAVE_BMI2 1
+#endif
+
+// The geohash alphabet
+static const char base32[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+// Maps a value in [lo, lo + range] onto [0, 2^32), saturating at the top
+static uint32_t quantize(double value, double lo, double range);
+
+// Spreads the 32 bits of x over the even bits of the result, and back
+static uint64_t spread_bits(uint32_t x);
+static uint32_t compact_bits(uint64_t x);
+
+// Writes the top 5 * precision bits of a cell id as base32
+static void write_hash(uint64_t id, int precision, char *hash);
+
+// The two ways of encoding a batch; ids and hashes as in geohash_encode_batch
+typedef void (*batch_fn)(int n, const location *points, size_t stride, int precision, char *hashes, uint64_t *ids);
+static void encode_batch_portable(int n, const location *points, size_t stride, int precision, char *hashes, uint64_t *ids);
+#ifdef GEOHASH_HAVE_BMI2
+static void encode_batch_bmi2(int n, const location *points, size_t stride, int precision, char *hashes, uint64_t *ids);
+#endif
+
+// The implementation batches use, picked once by pick_impl through
+// impl_once, since concurrent first calls would otherwise race on it
+static batch_fn impl = NULL;
+static pthread_once_t impl_once = PTHREAD_ONCE_INIT;
+static void pick_impl();
+
+uint64_t geohash_cell_id(const location *loc)
+{
+    uint32_t lon = quantize(loc->lon, -180.0, 360.0);
+    uint32_t lat = quantize(loc->lat, -90.0, 180.0);
+    return (spread_bits(lon) << 1) | spread_bits(lat);
+}
+
+void geohash_cell_decode(uint64_t id, location *loc)
+{
+    loc->lon = -180.0 + compact_bits(id >> 1) * (360.0 / 4294967296.0);
+    loc->lat = -90.0 + compact_bits(id) * (180.0 / 4294967296.0);
+}
+
+void geohash_encode_batch(int n, const location *points, size_t stride, int precision, char *hashes, uint64_t *ids)
+{
+    pthread_once(&impl_once, pick_impl);
+    impl(n, points, stride, precision, hashes, ids);
+}
+
+static void pick_impl()
+{
+    impl = encode_batch_portable;
+#ifdef GEOHASH_HAVE_BMI2
+    if (__builtin_cpu_supports("bmi2"))
+    {
+        impl = encode_batch_bmi2;
+    }
+#endif
+}
+
+void geohash_encode_reference(const location *loc, int precision, char *hash)
+{
+    double lat_lo = -90.0, lat_hi = 90.0;
+    double lon_lo = -180.0, lon_hi = 180.0;
+    bool even = true;
+
+    for (int c = 0; c < precision; c++)
+    {
+        int value = 0;
+        for (int b = 0; b < 5; b++)
+        {
+            // Even bits halve the longitude range, odd bits the latitude
+            double *lo = even ? &lon_lo : &lat_lo;
+            double *hi = even ? &lon_hi : &lat_hi;
+            double v = even ? loc->lon : loc->lat;
+            double mid = (*lo + *hi) / 2;
+
+            value <<= 1;
+            if (v >= mid)
+            {
+                value |= 1;
+                *lo = mid;
+            }
+            else
+            {
+                *hi = mid;
+            }
+            even = !even;
+        }
+        hash[c] = base32[value];
+    }
+    hash[precision] = '\0';
+}
+
+bool geohash_decode(const char *hash, location *center, location *error)
+{
+    size_t len = strlen(hash);
+    if (len < 1 || len > GEOHASH_MAX_PRECISION)
+    {
+        return false;
+    }
+
+    // Rebuild the top 5 * len bits of the cell id
+    uint64_t id = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        const char *digit = strchr(base32, hash[i]);
+        if (!digit)
+        {
+            return false;
+        }
+        id = (id << 5) | (uint64_t)(digit - base32);
+    }
+    int bits = 5 * (int)len;
+    id <<= 64 - bits;
+
+    location corner;
+    geohash_cell_decode(id, &corner);
+
+    // Longitude gets the extra bit when the count is odd
+    int lon_bits = (bits + 1) / 2;
+    int lat_bits = bits / 2;
+    double width = 360.0 / ((uint64_t)1 << lon_bits);
+    double height = 180.0 / ((uint64_t)1 << lat_bits);
+
+    center->lat = corner.lat + height / 2;
+    center->lon = corner.lon + width / 2;
+    if (error)
+    {
+        error->lat = height / 2;
+        error->lon = width / 2;
+    }
+    return true;
+}
+
+static void encode_batch_portable(int n, const location *points, size_t stride, int precision, char *hashes, uint64_t *ids)
+{
+    for (int i = 0; i < n; i++)
+    {
+        const location *loc = (const location *)((const char *)points + stride * i);
+        uint64_t id = geohash_cell_id(loc);
+        if (ids)
+        {
+            ids[i] = id >> (64 - 5 * precision);
+        }
+        if (hashes)
+        {
+            write_hash(id, precision, hashes + (size_t)i * (precision + 1));
+        }
+    }
+}
+
+#ifdef GEOHASH_HAVE_BMI2
+__attribute__((target("bmi2")))
+static void encode_batch_bmi2(int n, const location *points, size_t stride, int precision, char *hashes, uint64_t *ids)
+{
+    for (int i = 0; i < n; i++)
+    {
+        const location *loc = (const location *)((const char *)points + stride * i);
+        uint32_t lon = quantize(loc->lon, -180.0, 360.0);
+        uint32_t lat = quantize(loc->lat, -90.0, 180.0);
+        uint64_t id = _pdep_u64(lon, 0xAAAAAAAAAAAAAAAAull) | _pdep_u64(lat, 0x5555555555555555ull);
+        if (ids)
+        {
+            ids[i] = id >> (64 - 5 * precision);
+        }
+        if (hashes)
+        {
+            write_hash(id, precision, hashes + (size_t)i * (precision + 1));
+        }
+    }
+}
+#endif
+
+static void write_hash(uint64_t id, int precision, char *hash)
+{
+    for (int c = 0; c < precision; c++)
+    {
+        hash[c] = base32[(id >> (59 - 5 * c)) & 31];
+    }
+    hash[precision] = '\0';
+}
+
+static uint32_t quantize(double value, double lo, double range)
+{
+    double scaled = floor((value - lo) / range * 4294967296.0);
+    if (scaled <= 0)
+    {
+        return 0;
+    }
+    if (scaled >= 4294967295.0)
+    {
+        return 0xFFFFFFFFu;
+    }
+    return (uint32_t)scaled;
+}
+
+static uint64_t spread_bits(uint32_t x)
+{
+    uint64_t v = x;
+    v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+    v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+    v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    v = (v | (v << 2)) & 0x3333333333333333ull;
+    v = (v | (v << 1)) & 0x5555555555555555ull;
+    return v;
+}
+
+static uint32_t compact_bits(uint64_t x)
+{
+    uint64_t v = x & 0x5555555555555555ull;
+    v = (v | (v >> 1)) & 0x3333333333333333ull;
+    v = (v | (v >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+    v = (v | (v >> 4)) & 0x00FF00FF00FF00FFull;
+    v = (v | (v >> 8)) & 0x0000FFFF0000FFFFull;
+    v = (v | (v >> 16)) & 0x00000000FFFFFFFFull;
+    return (uint32_t)v;
+}
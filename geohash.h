@@ -0,0 +1,69 @@
+#ifndef __GEOHASH_H__
+#define __GEOHASH_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "location.h"
+
+// The longest geohash string (60 bits) that a 64-bit cell id can hold
+#define GEOHASH_MAX_PRECISION 12
+
+/**
+ * Returns the 64-bit cell id of the given location: longitude and latitude
+ * quantized to 32 bits each and interleaved, longitude first, so that the
+ * top 5k bits are the geohash of precision k and nearby locations share
+ * prefixes.
+ *
+ * @param loc a location
+ */
+uint64_t geohash_cell_id(const location *loc);
+
+/**
+ * Returns the location of the southwest corner of the given cell.
+ *
+ * @param id a cell id returned by geohash_cell_id
+ * @param loc set to the corner
+ */
+void geohash_cell_decode(uint64_t id, location *loc);
+
+/**
+ * Encodes n locations at once.  The locations are read at points + i * stride
+ * bytes so that the coord field of cities[] can be encoded in place.  On
+ * processors with BMI2 the bits are interleaved with PDEP, otherwise with
+ * shifts and masks; the results are the same either way.
+ *
+ * @param n a nonnegative integer
+ * @param points the location of point 0
+ * @param stride the distance in bytes between consecutive points
+ * @param precision the number of characters per geohash, 1 to 12
+ * @param hashes an array of n * (precision + 1) chars to hold the
+ *        '\0'-terminated geohashes, or NULL
+ * @param ids an array of n cell ids cut to 5 * precision bits (the
+ *        geohash as an integer), or NULL
+ */
+void geohash_encode_batch(int n, const location *points, size_t stride, int precision, char *hashes, uint64_t *ids);
+
+/**
+ * Encodes one location the textbook way, one bisection per bit, for
+ * checking and timing geohash_encode_batch against.
+ *
+ * @param loc a location
+ * @param precision the number of characters, 1 to 12
+ * @param hash an array of precision + 1 chars
+ */
+void geohash_encode_reference(const location *loc, int precision, char *hash);
+
+/**
+ * Decodes a geohash into the center of its cell and the half-size of the
+ * cell in each direction.
+ *
+ * @param hash a geohash of 1 to 12 characters
+ * @param center set to the center of the cell
+ * @param error set to the half-height and half-width of the cell, or NULL
+ * @return true if successful, false if hash has an invalid character or length
+ */
+bool geohash_decode(const char *hash, location *center, location *error);
+
+#endif
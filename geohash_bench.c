@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cities.h"
+#include "geohash.h"
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+int main(int argc, char **argv)
+{
+    // Usage: geohash_bench [precision [rounds]]
+    int precision = argc > 1 ? atoi(argv[1]) : 9;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    if (precision < 1 || precision > GEOHASH_MAX_PRECISION || rounds < 1)
+    {
+        fprintf(stderr, "%s: precision must be 1 to %d and rounds positive\n", argv[0], GEOHASH_MAX_PRECISION);
+        return 1;
+    }
+
+    size_t width = precision + 1;
+    char *reference = malloc(city_count * width);
+    char *batch = malloc(city_count * width);
+    uint64_t *ids = malloc(sizeof(uint64_t) * city_count);
+    if (!reference || !batch || !ids)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    double start = now();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < city_count; i++)
+        {
+            geohash_encode_reference(&cities[i].coord, precision, reference + i * width);
+        }
+    }
+    double scalar_time = now() - start;
+
+    start = now();
+    for (int r = 0; r < rounds; r++)
+    {
+        geohash_encode_batch(city_count, &cities[0].coord, sizeof(city), precision, batch, ids);
+    }
+    double batch_time = now() - start;
+
+    // The two must agree on every entry
+    int mismatches = 0;
+    for (int i = 0; i < city_count; i++)
+    {
+        if (strcmp(reference + i * width, batch + i * width) != 0)
+        {
+            mismatches++;
+        }
+    }
+
+    double encodes = (double)city_count * rounds;
+    printf("precision %d, %d entries x %d rounds\n", precision, city_count, rounds);
+    printf("reference: %.1f M encodes/s\n", encodes / scalar_time / 1e6);
+    printf("batch:     %.1f M encodes/s (%.1fx)\n", encodes / batch_time / 1e6, scalar_time / batch_time);
+    printf("mismatches: %d\n", mismatches);
+
+    free(ids);
+    free(batch);
+    free(reference);
+    return mismatches == 0 ? 0 : 1;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
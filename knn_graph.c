@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cities.h"
+#include "city_knn.h"
+
+/**
+ * Reads "lat,lon" lines from the given file into a growing array.
+ *
+ * @param input a file to read from
+ * @param n set to the number of points read
+ * @return a new array of the points, or NULL if memory could not be allocated
+ */
+location *read_points(FILE *input, int *n);
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+int main(int argc, char **argv)
+{
+    // Usage: knn_graph [-k k] [-t threads] [-i points_file] -o graph_file
+    //        knn_graph -m graph_file code...
+    // Without -i the points are the entries of cities[], in sorted order
+    const char *input_path = NULL;
+    const char *output_path = NULL;
+    const char *map_path = NULL;
+    int k = 8;
+    int threads = 0;
+    int first_code = argc;
+    for (int i = 1; i < argc; i++)
+    {
+        if (map_path)
+        {
+            first_code = i;
+            break;
+        }
+        if (strcmp(argv[i], "-k") != 0 && strcmp(argv[i], "-t") != 0 && strcmp(argv[i], "-i") != 0
+            && strcmp(argv[i], "-o") != 0 && strcmp(argv[i], "-m") != 0)
+        {
+            fprintf(stderr, "%s: unknown option %s\n", argv[0], argv[i]);
+            return 1;
+        }
+        if (i == argc - 1)
+        {
+            fprintf(stderr, "%s: must specify a value after \"%s\"\n", argv[0], argv[i]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "-k") == 0)
+        {
+            k = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-t") == 0)
+        {
+            threads = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-i") == 0)
+        {
+            input_path = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            output_path = argv[i + 1];
+        }
+        else
+        {
+            map_path = argv[i + 1];
+        }
+        i++;
+    }
+
+    initialize_city_database();
+    city_knn graph;
+
+    if (map_path)
+    {
+        // Print the neighbours of the given codes from a graph of cities[]
+        if (!city_knn_map(&graph, map_path))
+        {
+            fprintf(stderr, "%s: %s is not a graph file\n", argv[0], map_path);
+            return 1;
+        }
+        if (graph.n != city_count)
+        {
+            fprintf(stderr, "%s: %s is not a graph of cities[]\n", argv[0], map_path);
+            city_knn_destroy(&graph);
+            return 1;
+        }
+        for (int i = first_code; i < argc; i++)
+        {
+            int c = 0;
+            while (c < city_count && strcmp(cities[c].name, argv[i]) != 0)
+            {
+                c++;
+            }
+            if (c == city_count)
+            {
+                printf("%s: not found\n", argv[i]);
+                continue;
+            }
+            printf("%s:", argv[i]);
+            for (uint64_t e = graph.offsets[c]; e < graph.offsets[c + 1]; e++)
+            {
+                printf(" %s %.1f", cities[graph.neighbours[e]].name, graph.distances[e]);
+            }
+            printf("\n");
+        }
+        city_knn_destroy(&graph);
+        return 0;
+    }
+
+    if (!output_path)
+    {
+        fprintf(stderr, "%s: usage: %s [-k k] [-t threads] [-i points_file] -o graph_file\n", argv[0], argv[0]);
+        fprintf(stderr, "       %s -m graph_file code...\n", argv[0]);
+        return 1;
+    }
+    if (k < 1 || k > KNN_MAX_K)
+    {
+        fprintf(stderr, "%s: k must be from 1 to %d\n", argv[0], KNN_MAX_K);
+        return 1;
+    }
+
+    int n = city_count;
+    location *points = NULL;
+    if (input_path)
+    {
+        FILE *input = fopen(input_path, "r");
+        if (!input)
+        {
+            fprintf(stderr, "%s: could not open %s\n", argv[0], input_path);
+            return 1;
+        }
+        points = read_points(input, &n);
+        fclose(input);
+        if (!points)
+        {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+            return 1;
+        }
+    }
+
+    double start = now();
+    bool ok = points ? city_knn_build(&graph, n, points, sizeof(location), k, threads)
+                     : city_knn_build(&graph, n, &cities[0].coord, sizeof(city), k, threads);
+    double elapsed = now() - start;
+    free(points);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+    if (!city_knn_write(&graph, output_path))
+    {
+        fprintf(stderr, "%s: could not write %s\n", argv[0], output_path);
+        city_knn_destroy(&graph);
+        return 1;
+    }
+
+    fprintf(stderr, "%d points, %d neighbours each, %.3f s\n", n, graph.k, elapsed);
+    city_knn_destroy(&graph);
+    return 0;
+}
+
+location *read_points(FILE *input, int *n)
+{
+    int capacity = 1024;
+    int count = 0;
+    location *points = malloc(sizeof(location) * capacity);
+
+    location loc;
+    while (points && fscanf(input, "%lf,%lf", &loc.lat, &loc.lon) == 2)
+    {
+        // Double the array when it's full
+        if (count == capacity)
+        {
+            capacity *= 2;
+            location *more = realloc(points, sizeof(location) * capacity);
+            if (!more)
+            {
+                free(points);
+                return NULL;
+            }
+            points = more;
+        }
+        points[count++] = loc;
+    }
+
+    *n = count;
+    return points;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cities.h"
+#include "city_init.h"
+#include "city_phash.h"
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+/**
+ * Builds a perfect hash over the given table and prints the build time,
+ * the bits per key and the time per lookup of every code in it.
+ *
+ * @param label what to call the table
+ * @param n the number of entries
+ * @param table an array of n cities sorted by code
+ * @return true if successful, false if the hash could not be built
+ */
+bool measure(const char *label, int n, const city *table);
+
+int main(int argc, char **argv)
+{
+    // Usage: phash_bench [synthetic_size...]; defaults to 100k and 10M
+    use_city_perfect_hash(false);
+    initialize_city_database();
+    bool ok = measure("cities[]", city_count, cities);
+
+    int default_sizes[] = {100000, 10000000};
+    int size_count = argc > 1 ? argc - 1 : 2;
+    for (int k = 0; k < size_count; k++)
+    {
+        int n = argc > 1 ? atoi(argv[k + 1]) : default_sizes[k];
+        if (n < 1)
+        {
+            continue;
+        }
+
+        // Fixed-width codes generated in order are already sorted
+        char *names = malloc((size_t)n * 9);
+        city *table = malloc(sizeof(city) * n);
+        if (!names || !table)
+        {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+            return 1;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            sprintf(names + (size_t)i * 9, "K%07d", i);
+            table[i].name = names + (size_t)i * 9;
+            table[i].coord.lat = (i % 180) - 90.0;
+            table[i].coord.lon = (i % 360) - 180.0;
+        }
+
+        char label[32];
+        sprintf(label, "synthetic %d", n);
+        ok = measure(label, n, table) && ok;
+        free(table);
+        free(names);
+    }
+    return ok ? 0 : 1;
+}
+
+bool measure(const char *label, int n, const city *table)
+{
+    double start = now();
+    city_phash *ph = city_phash_build(n, table);
+    double build = now() - start;
+    if (!ph)
+    {
+        printf("%s: could not build\n", label);
+        return false;
+    }
+
+    // Look the codes up in a scattered order so the caches don't help
+    long found = 0;
+    location loc;
+    start = now();
+    for (int i = 0; i < n; i++)
+    {
+        found += city_phash_find(ph, table[(int)((long)i * 7919 % n)].name, &loc);
+    }
+    double lookups = now() - start;
+
+    printf("%s: %d keys, build %.1f ms (%.0f ns/key), %.2f bits/key, lookup %.1f ns, %ld found\n",
+           label, city_phash_size(ph), build * 1e3, build / n * 1e9,
+           city_phash_bytes(ph) * 8.0 / city_phash_size(ph), lookups / n * 1e9, found);
+    bool ok = found == city_phash_size(ph);
+    city_phash_destroy(ph);
+    return ok;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cities.h"
+#include "region_index.h"
+
+// The longest line and region name read from a region file
+#define MAX_LINE 256
+
+/**
+ * Reads regions from the given file: a "region NAME" line starts a region,
+ * a "ring" line starts another ring of the current one, any other line is
+ * a "lat,lon" vertex, and lines starting with '#' are ignored.
+ *
+ * @param input a file to read from
+ * @param count set to the number of regions read
+ * @param names set to a new array of their names
+ * @return a new array of the regions, whose arrays are also new, or NULL
+ *         if the file is malformed or memory could not be allocated
+ */
+region_shape *read_regions(FILE *input, int *count, char ***names);
+
+int main(int argc, char **argv)
+{
+    // Usage: region_filter [-t threads] [-c cell_deg] region_file [name...]
+    // Prints "code,region" for the airports in the named regions, or in
+    // any region if none are named
+    int threads = 0;
+    double cell_deg = 0.25;
+    int i = 1;
+    while (i < argc - 1 && (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "-c") == 0))
+    {
+        if (strcmp(argv[i], "-t") == 0)
+        {
+            threads = atoi(argv[i + 1]);
+        }
+        else
+        {
+            cell_deg = atof(argv[i + 1]);
+        }
+        i += 2;
+    }
+    if (i >= argc || cell_deg <= 0)
+    {
+        fprintf(stderr, "%s: usage: %s [-t threads] [-c cell_deg] region_file [name...]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    FILE *input = fopen(argv[i], "r");
+    if (!input)
+    {
+        fprintf(stderr, "%s: could not open %s\n", argv[0], argv[i]);
+        return 1;
+    }
+    int count;
+    char **names;
+    region_shape *regions = read_regions(input, &count, &names);
+    fclose(input);
+    if (!regions)
+    {
+        fprintf(stderr, "%s: could not read %s\n", argv[0], argv[i]);
+        return 1;
+    }
+
+    initialize_city_database();
+    region_index *index = region_index_create(count, regions, cell_deg);
+    const int *found = index ? region_index_cities(index, threads) : NULL;
+    if (!found)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    for (int c = 0; c < city_count; c++)
+    {
+        if (found[c] == REGION_NONE)
+        {
+            continue;
+        }
+        bool wanted = i == argc - 1;
+        for (int k = i + 1; k < argc && !wanted; k++)
+        {
+            wanted = strcmp(argv[k], names[found[c]]) == 0;
+        }
+        if (wanted)
+        {
+            printf("%s,%s\n", cities[c].name, names[found[c]]);
+        }
+    }
+
+    region_index_destroy(index);
+    for (int r = 0; r < count; r++)
+    {
+        free((void *)regions[r].vertices);
+        free((void *)regions[r].ring_ends);
+        free(names[r]);
+    }
+    free(regions);
+    free(names);
+    return 0;
+}
+
+region_shape *read_regions(FILE *input, int *count, char ***names)
+{
+    int capacity = 16;
+    int n = 0;
+    region_shape *regions = malloc(sizeof(region_shape) * capacity);
+    char **region_names = malloc(sizeof(char *) * capacity);
+    int vertex_capacity = 0;
+    int ring_capacity = 0;
+    bool new_ring = true;
+    bool ok = regions && region_names;
+
+    char line[MAX_LINE];
+    while (ok && fgets(line, sizeof(line), input))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0')
+        {
+            continue;
+        }
+
+        if (strncmp(line, "region ", 7) == 0)
+        {
+            // Double the arrays when they're full
+            if (n == capacity)
+            {
+                capacity *= 2;
+                region_shape *more = realloc(regions, sizeof(region_shape) * capacity);
+                char **more_names = realloc(region_names, sizeof(char *) * capacity);
+                regions = more ? more : regions;
+                region_names = more_names ? more_names : region_names;
+                if (!more || !more_names)
+                {
+                    ok = false;
+                    break;
+                }
+            }
+            region_names[n] = strdup(line + 7);
+            regions[n].vertex_count = 0;
+            regions[n].vertices = NULL;
+            regions[n].ring_count = 0;
+            regions[n].ring_ends = NULL;
+            vertex_capacity = 0;
+            ring_capacity = 0;
+            new_ring = true;
+            ok = region_names[n] != NULL;
+            n++;
+            continue;
+        }
+        if (n == 0)
+        {
+            ok = false;
+            break;
+        }
+
+        // A ring starts with the first vertex after "region" or "ring"
+        region_shape *shape = &regions[n - 1];
+        if (strcmp(line, "ring") == 0)
+        {
+            new_ring = true;
+            continue;
+        }
+
+        location loc;
+        if (sscanf(line, "%lf,%lf", &loc.lat, &loc.lon) != 2)
+        {
+            ok = false;
+            break;
+        }
+        if (new_ring)
+        {
+            if (shape->ring_count == ring_capacity)
+            {
+                ring_capacity = ring_capacity ? ring_capacity * 2 : 4;
+                int *more = realloc((void *)shape->ring_ends, sizeof(int) * ring_capacity);
+                if (!more)
+                {
+                    ok = false;
+                    break;
+                }
+                shape->ring_ends = more;
+            }
+            shape->ring_count++;
+            new_ring = false;
+        }
+        if (shape->vertex_count == vertex_capacity)
+        {
+            vertex_capacity = vertex_capacity ? vertex_capacity * 2 : 64;
+            location *more = realloc((void *)shape->vertices, sizeof(location) * vertex_capacity);
+            if (!more)
+            {
+                ok = false;
+                break;
+            }
+            shape->vertices = more;
+        }
+        ((location *)shape->vertices)[shape->vertex_count++] = loc;
+        ((int *)shape->ring_ends)[shape->ring_count - 1] = shape->vertex_count;
+    }
+
+    if (!ok)
+    {
+        for (int r = 0; r < n; r++)
+        {
+            free((void *)regions[r].vertices);
+            free((void *)regions[r].ring_ends);
+            free(region_names[r]);
+        }
+        free(regions);
+        free(region_names);
+        return NULL;
+    }
+    *count = n;
+    *names = region_names;
+    return regions;
+}
@@ -0,0 +1,474 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "cities.h"
+#include "city_init.h"
+#include "region_index.h"
+#include "work_pool.h"
+
+// Points are handed to the pool in chunks of this many
+#define REGION_CHUNK 1024
+
+// How far past an edge's extent its cells reach, so that rounding never
+// leaves an edge out of a cell it touches
+#define REGION_SLACK_DEG 1e-9
+
+// The edges of one region that touch one cell
+typedef struct
+{
+    int region;
+    int edge_start;  // into edges
+    int edge_end;
+    bool centre_inside;
+} cell_group;
+
+// An edge of a region that touches a cell, before grouping by cell
+typedef struct
+{
+    int cell;
+    int region;
+    int edge;
+} cell_edge;
+
+struct region_index
+{
+    double cell_deg;
+    int rows;
+    int cols;
+    location *vertices;
+    int *next;           // edge e runs from vertices[e] to vertices[next[e]]
+    int *interior;       // per cell, the first region covering all of it
+    int *group_start;    // cell c has groups[group_start[c]] onwards
+    cell_group *groups;  // by cell, then by region
+    int *edges;
+
+    // The regions of cities[] as of city_database_version() cache_version
+    pthread_mutex_t cache_lock;
+    int *cache;
+    int cache_count;
+    unsigned long cache_version;
+};
+
+typedef struct
+{
+    const region_index *index;
+    const location *points;
+    size_t stride;
+    int n;
+    int *regions;
+} find_state;
+
+// Adds the cells an edge touches to the given list, growing it as needed
+static bool add_edge_cells(const region_index *index, int region, int edge, cell_edge **list, int *count, int *capacity);
+
+// Marks the cells of one region as interior or notes whether their
+// centres are inside, by crossing each row's centre line with its edges
+static bool classify_region(region_index *index, int region, int first, int last);
+
+// Returns the row or column of a latitude or longitude, clamped to the grid
+static int row_of(const region_index *index, double lat);
+static int col_of(const region_index *index, double lon);
+
+// Returns the cross product of b - a and c - a: positive if c is to the
+// left of the line from a to b
+static double orient(const location *a, const location *b, const location *c);
+
+// Finds the regions of one chunk of points
+static void find_chunk(int task, int worker, void *arg);
+
+// Orders doubles ascending, for qsort
+static int compare_doubles(const void *a, const void *b);
+
+region_index *region_index_create(int region_count, const region_shape *regions, double cell_deg)
+{
+    region_index *index = calloc(1, sizeof(region_index));
+    if (!index)
+    {
+        return NULL;
+    }
+    index->cell_deg = cell_deg;
+    index->rows = (int)ceil(180.0 / cell_deg);
+    index->cols = (int)ceil(360.0 / cell_deg);
+    int cell_count = index->rows * index->cols;
+    pthread_mutex_init(&index->cache_lock, NULL);
+
+    // Copy every ring into one array of vertices, linked around each ring
+    int total = 0;
+    for (int r = 0; r < region_count; r++)
+    {
+        total += regions[r].vertex_count;
+    }
+    int *region_start = malloc(sizeof(int) * (region_count + 1));
+    index->vertices = malloc(sizeof(location) * (total > 0 ? total : 1));
+    index->next = malloc(sizeof(int) * (total > 0 ? total : 1));
+    index->interior = malloc(sizeof(int) * cell_count);
+    index->group_start = calloc(cell_count + 1, sizeof(int));
+    if (!region_start || !index->vertices || !index->next || !index->interior || !index->group_start)
+    {
+        free(region_start);
+        region_index_destroy(index);
+        return NULL;
+    }
+    for (int c = 0; c < cell_count; c++)
+    {
+        index->interior[c] = REGION_NONE;
+    }
+
+    int at = 0;
+    for (int r = 0; r < region_count; r++)
+    {
+        const region_shape *shape = &regions[r];
+        region_start[r] = at;
+        memcpy(index->vertices + at, shape->vertices, sizeof(location) * shape->vertex_count);
+        int ring_start = 0;
+        int rings = shape->ring_ends ? shape->ring_count : 1;
+        for (int k = 0; k < rings; k++)
+        {
+            int ring_end = shape->ring_ends ? shape->ring_ends[k] : shape->vertex_count;
+            for (int v = ring_start; v < ring_end; v++)
+            {
+                index->next[at + v] = at + (v + 1 < ring_end ? v + 1 : ring_start);
+            }
+            ring_start = ring_end;
+        }
+        at += shape->vertex_count;
+    }
+    region_start[region_count] = at;
+
+    // List the cells every edge touches; they come out by region
+    int count = 0;
+    int capacity = 1024;
+    cell_edge *list = malloc(sizeof(cell_edge) * capacity);
+    bool ok = list != NULL;
+    for (int r = 0; ok && r < region_count; r++)
+    {
+        for (int e = region_start[r]; ok && e < region_start[r + 1]; e++)
+        {
+            ok = add_edge_cells(index, r, e, &list, &count, &capacity);
+        }
+    }
+
+    // Counting sort by cell, which keeps them by region within a cell,
+    // then one group for each run of the same region in a cell
+    int *fill = malloc(sizeof(int) * cell_count);
+    index->edges = malloc(sizeof(int) * (count > 0 ? count : 1));
+    index->groups = malloc(sizeof(cell_group) * (count > 0 ? count : 1));
+    ok = ok && fill && index->edges && index->groups;
+    if (ok)
+    {
+        int *start = calloc(cell_count + 1, sizeof(int));
+        ok = start != NULL;
+        for (int i = 0; ok && i < count; i++)
+        {
+            start[list[i].cell + 1]++;
+        }
+        for (int c = 0; ok && c < cell_count; c++)
+        {
+            start[c + 1] += start[c];
+        }
+        if (ok)
+        {
+            memcpy(fill, start, sizeof(int) * cell_count);
+            cell_edge *sorted = malloc(sizeof(cell_edge) * (count > 0 ? count : 1));
+            ok = sorted != NULL;
+            for (int i = 0; ok && i < count; i++)
+            {
+                sorted[fill[list[i].cell]++] = list[i];
+            }
+            free(list);
+            list = sorted;
+        }
+
+        int groups = 0;
+        for (int c = 0; ok && c < cell_count; c++)
+        {
+            index->group_start[c] = groups;
+            for (int i = start[c]; i < start[c + 1]; i++)
+            {
+                if (i == start[c] || list[i].region != list[i - 1].region)
+                {
+                    index->groups[groups].region = list[i].region;
+                    index->groups[groups].edge_start = i;
+                    index->groups[groups].centre_inside = false;
+                    groups++;
+                }
+                index->groups[groups - 1].edge_end = i + 1;
+                index->edges[i] = list[i].edge;
+            }
+        }
+        index->group_start[cell_count] = groups;
+        free(start);
+    }
+    free(fill);
+    free(list);
+
+    for (int r = 0; ok && r < region_count; r++)
+    {
+        ok = classify_region(index, r, region_start[r], region_start[r + 1]);
+    }
+    free(region_start);
+    if (!ok)
+    {
+        region_index_destroy(index);
+        return NULL;
+    }
+    return index;
+}
+
+void region_index_destroy(region_index *index)
+{
+    if (index)
+    {
+        free(index->vertices);
+        free(index->next);
+        free(index->interior);
+        free(index->group_start);
+        free(index->groups);
+        free(index->edges);
+        free(index->cache);
+        pthread_mutex_destroy(&index->cache_lock);
+        free(index);
+    }
+}
+
+static bool add_edge_cells(const region_index *index, int region, int edge, cell_edge **list, int *count, int *capacity)
+{
+    const location *a = &index->vertices[edge];
+    const location *b = &index->vertices[index->next[edge]];
+    int first_row = row_of(index, fmin(a->lat, b->lat) - REGION_SLACK_DEG);
+    int last_row = row_of(index, fmax(a->lat, b->lat) + REGION_SLACK_DEG);
+
+    for (int row = first_row; row <= last_row; row++)
+    {
+        // The part of the edge within this row's band of latitude
+        double lon_min = fmin(a->lon, b->lon);
+        double lon_max = fmax(a->lon, b->lon);
+        if (a->lat != b->lat)
+        {
+            double south = -90.0 + row * index->cell_deg;
+            double north = south + index->cell_deg;
+            double t1 = (south - a->lat) / (b->lat - a->lat);
+            double t2 = (north - a->lat) / (b->lat - a->lat);
+            double t_min = fmax(0.0, fmin(t1, t2));
+            double t_max = fmin(1.0, fmax(t1, t2));
+            double lon1 = a->lon + t_min * (b->lon - a->lon);
+            double lon2 = a->lon + t_max * (b->lon - a->lon);
+            lon_min = fmax(lon_min, fmin(lon1, lon2));
+            lon_max = fmin(lon_max, fmax(lon1, lon2));
+        }
+        int first_col = col_of(index, lon_min - REGION_SLACK_DEG);
+        int last_col = col_of(index, lon_max + REGION_SLACK_DEG);
+
+        for (int col = first_col; col <= last_col; col++)
+        {
+            // Double the list when it's full
+            if (*count == *capacity)
+            {
+                cell_edge *more = realloc(*list, sizeof(cell_edge) * *capacity * 2);
+                if (!more)
+                {
+                    return false;
+                }
+                *list = more;
+                *capacity *= 2;
+            }
+            (*list)[*count].cell = row * index->cols + col;
+            (*list)[*count].region = region;
+            (*list)[*count].edge = edge;
+            (*count)++;
+        }
+    }
+    return true;
+}
+
+static bool classify_region(region_index *index, int region, int first, int last)
+{
+    if (first == last)
+    {
+        return true;
+    }
+
+    double lat_min = index->vertices[first].lat;
+    double lat_max = lat_min;
+    double lon_min = index->vertices[first].lon;
+    double lon_max = lon_min;
+    for (int v = first; v < last; v++)
+    {
+        lat_min = fmin(lat_min, index->vertices[v].lat);
+        lat_max = fmax(lat_max, index->vertices[v].lat);
+        lon_min = fmin(lon_min, index->vertices[v].lon);
+        lon_max = fmax(lon_max, index->vertices[v].lon);
+    }
+    int first_col = col_of(index, lon_min);
+    int last_col = col_of(index, lon_max);
+
+    double *crossings = malloc(sizeof(double) * (last - first));
+    if (!crossings)
+    {
+        return false;
+    }
+
+    for (int row = row_of(index, lat_min); row <= row_of(index, lat_max); row++)
+    {
+        // Where the centre line of the row crosses the outline, in order
+        double y = -90.0 + (row + 0.5) * index->cell_deg;
+        int count = 0;
+        for (int e = first; e < last; e++)
+        {
+            const location *a = &index->vertices[e];
+            const location *b = &index->vertices[index->next[e]];
+            if ((a->lat > y) != (b->lat > y))
+            {
+                crossings[count++] = a->lon + (y - a->lat) * (b->lon - a->lon) / (b->lat - a->lat);
+            }
+        }
+        qsort(crossings, count, sizeof(double), compare_doubles);
+
+        // A centre is inside if an odd number of crossings are west of it
+        int west = 0;
+        for (int col = first_col; col <= last_col; col++)
+        {
+            double x = -180.0 + (col + 0.5) * index->cell_deg;
+            while (west < count && crossings[west] < x)
+            {
+                west++;
+            }
+            bool inside = west % 2 == 1;
+
+            int cell = row * index->cols + col;
+            bool boundary = false;
+            for (int g = index->group_start[cell]; g < index->group_start[cell + 1]; g++)
+            {
+                if (index->groups[g].region == region)
+                {
+                    index->groups[g].centre_inside = inside;
+                    boundary = true;
+                    break;
+                }
+            }
+
+            // Regions are classified in order, so the first one sticks
+            if (!boundary && inside && index->interior[cell] == REGION_NONE)
+            {
+                index->interior[cell] = region;
+            }
+        }
+    }
+
+    free(crossings);
+    return true;
+}
+
+int region_index_find(const region_index *index, const location *loc)
+{
+    int row = row_of(index, loc->lat);
+    int col = col_of(index, loc->lon);
+    int cell = row * index->cols + col;
+    location centre;
+    centre.lat = -90.0 + (row + 0.5) * index->cell_deg;
+    centre.lon = -180.0 + (col + 0.5) * index->cell_deg;
+
+    // Regions whose outlines cross the cell, in order, up to the first
+    // region that covers all of it
+    int covering = index->interior[cell];
+    for (int g = index->group_start[cell]; g < index->group_start[cell + 1]; g++)
+    {
+        const cell_group *group = &index->groups[g];
+        if (covering != REGION_NONE && group->region > covering)
+        {
+            break;
+        }
+
+        // Each edge that crosses the segment to the centre flips the
+        // answer there; a vertex on the segment's line is taken to be on
+        // its right, so of the two edges meeting there only one counts
+        bool inside = group->centre_inside;
+        for (int i = group->edge_start; i < group->edge_end; i++)
+        {
+            const location *a = &index->vertices[index->edges[i]];
+            const location *b = &index->vertices[index->next[index->edges[i]]];
+            bool a_left = orient(loc, &centre, a) > 0;
+            bool b_left = orient(loc, &centre, b) > 0;
+            if (a_left != b_left && (orient(a, b, loc) > 0) != (orient(a, b, &centre) > 0))
+            {
+                inside = !inside;
+            }
+        }
+        if (inside)
+        {
+            return group->region;
+        }
+    }
+    return covering;
+}
+
+void region_index_find_all(const region_index *index, int n, const location *points, size_t stride, int threads, int *regions)
+{
+    find_state s;
+    s.index = index;
+    s.points = points;
+    s.stride = stride;
+    s.n = n;
+    s.regions = regions;
+    work_pool_run((n + REGION_CHUNK - 1) / REGION_CHUNK, threads, find_chunk, &s);
+}
+
+const int *region_index_cities(region_index *index, int threads)
+{
+    pthread_mutex_lock(&index->cache_lock);
+    unsigned long version = city_database_version();
+    if (!index->cache || index->cache_version != version || index->cache_count != city_count)
+    {
+        int *regions = realloc(index->cache, sizeof(int) * (city_count > 0 ? city_count : 1));
+        if (!regions)
+        {
+            pthread_mutex_unlock(&index->cache_lock);
+            return NULL;
+        }
+        region_index_find_all(index, city_count, &cities[0].coord, sizeof(city), threads, regions);
+        index->cache = regions;
+        index->cache_count = city_count;
+        index->cache_version = version;
+    }
+    const int *result = index->cache;
+    pthread_mutex_unlock(&index->cache_lock);
+    return result;
+}
+
+static void find_chunk(int task, int worker, void *arg)
+{
+    (void)worker;
+    find_state *s = arg;
+    int end = (task + 1) * REGION_CHUNK < s->n ? (task + 1) * REGION_CHUNK : s->n;
+    for (int i = task * REGION_CHUNK; i < end; i++)
+    {
+        const location *p = (const location *)((const char *)s->points + s->stride * i);
+        s->regions[i] = region_index_find(s->index, p);
+    }
+}
+
+static int row_of(const region_index *index, double lat)
+{
+    int row = (int)floor((lat + 90.0) / index->cell_deg);
+    return row < 0 ? 0 : (row >= index->rows ? index->rows - 1 : row);
+}
+
+static int col_of(const region_index *index, double lon)
+{
+    int col = (int)floor((lon + 180.0) / index->cell_deg);
+    return col < 0 ? 0 : (col >= index->cols ? index->cols - 1 : col);
+}
+
+static double orient(const location *a, const location *b, const location *c)
+{
+    return (b->lon - a->lon) * (c->lat - a->lat) - (b->lat - a->lat) * (c->lon - a->lon);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
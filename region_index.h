@@ -0,0 +1,93 @@
+#ifndef __REGION_INDEX_H__
+#define __REGION_INDEX_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "location.h"
+
+// A region's outline as one or more rings of vertices; a point is in the
+// region if it is inside an odd number of rings, so holes and islands are
+// just more rings.  Edges are straight in latitude and longitude, and a
+// region that crosses the antimeridian has to be given as two pieces.
+typedef struct
+{
+    int vertex_count;
+    const location *vertices;  // every ring back to back, each one closed
+                               // implicitly from its last vertex to its first
+    int ring_count;
+    const int *ring_ends;      // ring r ends before vertex ring_ends[r]; NULL
+                               // for a single ring of all the vertices
+} region_shape;
+
+// The region a point is in when it is in none of them
+#define REGION_NONE -1
+
+// The regions rasterized onto a latitude and longitude grid.  A cell that
+// no outline crosses is entirely inside or outside each region, so all it
+// keeps is the first region covering it.  A cell that outlines cross also
+// keeps, for each of those regions, the edges that touch the cell and
+// whether its centre is inside; a point in the cell is then inside if that
+// answer flips an even number of times along the segment to the centre,
+// which only takes the few edges in the cell.
+typedef struct region_index region_index;
+
+/**
+ * Builds an index over the given regions.  The shapes are copied, so they
+ * need not outlive the index.
+ *
+ * @param region_count a nonnegative integer
+ * @param regions an array of region_count shapes
+ * @param cell_deg the cell size in degrees, positive; cells should hold a
+ *        handful of edges of the most detailed outlines
+ * @return a new index, or NULL if memory could not be allocated
+ */
+region_index *region_index_create(int region_count, const region_shape *regions, double cell_deg);
+
+/**
+ * Frees the given index.
+ *
+ * @param index an index returned by region_index_create, or NULL
+ */
+void region_index_destroy(region_index *index);
+
+/**
+ * Returns the region a point is in.  Where regions overlap the one given
+ * first wins.
+ *
+ * @param index an index
+ * @param loc a location
+ * @return the index of the region in the array given to
+ *         region_index_create, or REGION_NONE
+ */
+int region_index_find(const region_index *index, const location *loc);
+
+/**
+ * Finds the region of each of n points in one pass on a work-stealing
+ * pool.  Points are read as in city_grid_build.
+ *
+ * @param index an index
+ * @param n a nonnegative integer
+ * @param points the location of point 0
+ * @param stride the distance in bytes between consecutive points
+ * @param threads the number of threads to use; 0 for one per processor
+ * @param regions an array that can hold n ints, filled in with what
+ *        region_index_find returns for each point
+ */
+void region_index_find_all(const region_index *index, int n, const location *points, size_t stride, int threads, int *regions);
+
+/**
+ * Returns the region of every entry of cities[], in the order of
+ * cities[].  The result is computed with region_index_find_all the first
+ * time and kept until city_database_version() changes, so repeated
+ * filters over the same table are free.  Safe to call from many threads.
+ *
+ * @param index an index
+ * @param threads the number of threads to use; 0 for one per processor
+ * @return an array of city_count regions owned by the index and valid
+ *         until the next call that finds the table changed, or NULL if
+ *         memory could not be allocated
+ */
+const int *region_index_cities(region_index *index, int threads);
+
+#endif
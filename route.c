@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "geo.h"
+#include "route.h"
+#include "work_pool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Lines are handed out in chunks of about this many bytes
+#define ROUTE_CHUNK_SIZE (1 << 20)
+
+typedef struct
+{
+    const char *data;
+    size_t size;
+    const city_code_index *index;
+    bool want_lines;
+    route_totals *totals;  // one per chunk
+    char **lines;          // one output buffer per chunk, if wanted
+    size_t *line_sizes;
+} route_state;
+
+// Where route_chunk collects one chunk's itineraries
+typedef struct
+{
+    route_totals *t;
+    char *out;
+    size_t out_used;
+    size_t out_size;
+} chunk_output;
+
+// The itinerary being measured by scan_lines
+typedef struct
+{
+    const city_code_index *index;
+    const char *token;  // start of the current code
+    location prev;
+    int codes;
+    int legs;
+    double km;
+    bool unknown;
+    void (*finish)(double, int, void *);
+    void *arg;
+} line_scan;
+
+// Measures the lines that begin in one chunk
+static void route_chunk(int task, int worker, void *arg);
+
+// Splits [p, end) into lines and codes in one pass and calls finish with
+// the length (or -1) and leg count of each nonblank line
+static void scan_lines(const city_code_index *index, const char *p, const char *end,
+                       void (*finish)(double, int, void *), void *arg);
+
+// Handles the separator at sep, which ends the current code, and the
+// itinerary too if it's a newline (or the end of the input)
+static void on_separator(line_scan *scan, const char *sep, bool end_of_line);
+
+// Adds the code in [scan->token, end) to the current itinerary
+static void add_code(line_scan *scan, const char *end);
+
+// Records a single itinerary for route_distance
+static void finish_single(double km, int legs, void *arg);
+
+// Records one itinerary of a chunk for route_chunk
+static void finish_chunk_line(double km, int legs, void *arg);
+
+double route_distance(const city_code_index *index, const char *itinerary, size_t length, int *legs)
+{
+    double result[2] = {0, 0};
+    scan_lines(index, itinerary, itinerary + length, finish_single, result);
+    *legs = (int)result[1];
+    return result[0];
+}
+
+bool route_file(const char *path, const city_code_index *index, int threads, FILE *per_line, route_totals *totals)
+{
+    memset(totals, 0, sizeof(route_totals));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+    route_state s;
+    s.data = data;
+    s.size = st.st_size;
+    s.index = index;
+    s.want_lines = per_line != NULL;
+
+    int chunks = (int)((s.size + ROUTE_CHUNK_SIZE - 1) / ROUTE_CHUNK_SIZE);
+    s.totals = calloc(chunks, sizeof(route_totals));
+    s.lines = calloc(chunks, sizeof(char *));
+    s.line_sizes = calloc(chunks, sizeof(size_t));
+    bool ok = s.totals && s.lines && s.line_sizes;
+
+    if (ok)
+    {
+        work_pool_run(chunks, threads, route_chunk, &s);
+
+        // Add the chunks up, and write their lines out in order
+        for (int i = 0; i < chunks; i++)
+        {
+            totals->itineraries += s.totals[i].itineraries;
+            totals->legs += s.totals[i].legs;
+            totals->unknown += s.totals[i].unknown;
+            totals->total_km += s.totals[i].total_km;
+            if (per_line && s.line_sizes[i] > 0)
+            {
+                fwrite(s.lines[i], 1, s.line_sizes[i], per_line);
+            }
+            else if (per_line && !s.lines[i] && s.totals[i].itineraries > 0)
+            {
+                // The chunk's output buffer could not be allocated
+                ok = false;
+            }
+        }
+    }
+
+    for (int i = 0; s.lines && i < chunks; i++)
+    {
+        free(s.lines[i]);
+    }
+    free(s.line_sizes);
+    free(s.lines);
+    free(s.totals);
+    munmap((void *)data, st.st_size);
+    return ok;
+}
+
+static void route_chunk(int task, int worker, void *arg)
+{
+    (void)worker;
+    route_state *s = arg;
+    size_t begin = work_pool_line_start(s->data, s->size, (size_t)task * ROUTE_CHUNK_SIZE);
+    size_t limit = work_pool_line_start(s->data, s->size, (size_t)(task + 1) * ROUTE_CHUNK_SIZE);
+
+    // Output is at most ~24 bytes per line, and a line at least 2 bytes
+    chunk_output c;
+    c.t = &s->totals[task];
+    c.out = NULL;
+    c.out_used = 0;
+    c.out_size = 0;
+    if (s->want_lines && limit > begin)
+    {
+        c.out_size = (limit - begin) * 12 + 64;
+        c.out = malloc(c.out_size);
+    }
+
+    scan_lines(s->index, s->data + begin, s->data + limit, finish_chunk_line, &c);
+
+    if (s->want_lines)
+    {
+        s->lines[task] = c.out;
+        s->line_sizes[task] = c.out_used;
+    }
+}
+
+static void finish_chunk_line(double km, int legs, void *arg)
+{
+    chunk_output *c = arg;
+    c->t->itineraries++;
+    if (km < 0)
+    {
+        c->t->unknown++;
+    }
+    else
+    {
+        c->t->legs += legs;
+        c->t->total_km += km;
+    }
+
+    if (c->out)
+    {
+        if (km < 0)
+        {
+            memcpy(c->out + c->out_used, "unknown\n", 8);
+            c->out_used += 8;
+        }
+        else
+        {
+            c->out_used += snprintf(c->out + c->out_used, c->out_size - c->out_used, "%.3f\n", km);
+        }
+    }
+}
+
+static void finish_single(double km, int legs, void *arg)
+{
+    double *result = arg;
+    result[0] = km;
+    result[1] = legs;
+}
+
+static void scan_lines(const city_code_index *index, const char *p, const char *end,
+                       void (*finish)(double, int, void *), void *arg)
+{
+    line_scan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.index = index;
+    scan.token = p;
+    scan.finish = finish;
+    scan.arg = arg;
+
+    const char *block = p;
+#ifdef __SSE2__
+    // Find every '-' and '\n' of 16 bytes with two compares, then walk the
+    // bits of the mask
+    const __m128i dash = _mm_set1_epi8('-');
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; end - block >= 16; block += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)block);
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, dash), _mm_cmpeq_epi8(v, newline)));
+        while (mask)
+        {
+            const char *sep = block + __builtin_ctz(mask);
+            on_separator(&scan, sep, *sep == '\n');
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; block < end; block++)
+    {
+        if (*block == '-' || *block == '\n')
+        {
+            on_separator(&scan, block, *block == '\n');
+        }
+    }
+
+    // The last line may not end in a newline
+    if (scan.token < end || scan.codes > 0)
+    {
+        on_separator(&scan, end, true);
+    }
+}
+
+static void on_separator(line_scan *scan, const char *sep, bool end_of_line)
+{
+    const char *token_end = sep;
+    if (end_of_line)
+    {
+        if (token_end > scan->token && token_end[-1] == '\r')
+        {
+            token_end--;
+        }
+
+        // Blank lines don't count as itineraries
+        if (token_end == scan->token && scan->codes == 0)
+        {
+            scan->token = sep + 1;
+            return;
+        }
+    }
+
+    add_code(scan, token_end);
+    scan->token = sep + 1;
+
+    if (end_of_line)
+    {
+        scan->finish(scan->unknown ? -1 : scan->km, scan->legs, scan->arg);
+        scan->codes = 0;
+        scan->legs = 0;
+        scan->km = 0;
+        scan->unknown = false;
+    }
+}
+
+static void add_code(line_scan *scan, const char *end)
+{
+    location here;
+    if (!scan->unknown && city_code_index_find(scan->index, scan->token, end - scan->token, &here))
+    {
+        if (scan->codes > 0)
+        {
+            scan->km += geo_spherical_km(&scan->prev, &here);
+            scan->legs++;
+        }
+        scan->prev = here;
+    }
+    else
+    {
+        scan->unknown = true;
+    }
+    scan->codes++;
+}
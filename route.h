@@ -0,0 +1,50 @@
+#ifndef __ROUTE_H__
+#define __ROUTE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "city_code_index.h"
+
+// An itinerary is a line of codes separated by '-', e.g. "JFK-LHR-DXB-SIN";
+// a trailing '\r' is ignored
+
+// What route_file found in one file
+typedef struct
+{
+    long itineraries;
+    long legs;
+    long unknown;     // itineraries skipped because a code wasn't found
+    double total_km;  // over the itineraries that were not skipped
+} route_totals;
+
+/**
+ * Returns the great-circle length of one itinerary in kilometers.
+ *
+ * @param index an index filled in by city_code_index_build
+ * @param itinerary the characters of the itinerary, without the newline
+ * @param length the number of characters
+ * @param legs set to the number of legs
+ * @return the length, or -1 if one of the codes was not found
+ */
+double route_distance(const city_code_index *index, const char *itinerary, size_t length, int *legs);
+
+/**
+ * Measures every itinerary in the given file.  The file is mapped into
+ * memory and cut into chunks at line boundaries which are run on a
+ * work-stealing pool; separators are found 16 bytes at a time with SSE2
+ * where available.
+ *
+ * @param path the file to read
+ * @param index an index filled in by city_code_index_build
+ * @param threads the number of threads to use; 0 for one per processor
+ * @param per_line a file to write each itinerary's length into, one per
+ *        line in input order ("unknown" if a code wasn't found), or NULL
+ * @param totals set to the totals over the file
+ * @return true if successful, false if the file could not be read or
+ *         memory could not be allocated
+ */
+bool route_file(const char *path, const city_code_index *index, int threads, FILE *per_line, route_totals *totals);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cities.h"
+#include "route.h"
+
+/**
+ * Returns the current time in seconds from a monotonic clock.
+ */
+double now();
+
+int main(int argc, char **argv)
+{
+    // Usage: route_distance [-t threads] [-p] file...
+    // -p prints the length of every itinerary, in order
+    int threads = 0;
+    bool print_lines = false;
+    int first_file = 1;
+    while (first_file < argc && argv[first_file][0] == '-')
+    {
+        if (strcmp(argv[first_file], "-p") == 0)
+        {
+            print_lines = true;
+            first_file++;
+        }
+        else if (strcmp(argv[first_file], "-t") == 0 && first_file < argc - 1)
+        {
+            threads = atoi(argv[first_file + 1]);
+            first_file += 2;
+        }
+        else
+        {
+            fprintf(stderr, "%s: usage: %s [-t threads] [-p] file...\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if (first_file == argc)
+    {
+        fprintf(stderr, "%s: usage: %s [-t threads] [-p] file...\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    initialize_city_database();
+    city_code_index index;
+    if (!city_code_index_build(&index))
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    route_totals all;
+    memset(&all, 0, sizeof(all));
+    double start = now();
+    for (int i = first_file; i < argc; i++)
+    {
+        route_totals t;
+        if (!route_file(argv[i], &index, threads, print_lines ? stdout : NULL, &t))
+        {
+            fprintf(stderr, "%s: could not read %s\n", argv[0], argv[i]);
+            city_code_index_destroy(&index);
+            return 1;
+        }
+        all.itineraries += t.itineraries;
+        all.legs += t.legs;
+        all.unknown += t.unknown;
+        all.total_km += t.total_km;
+    }
+    double elapsed = now() - start;
+
+    fprintf(stderr, "%ld itineraries, %ld legs, %ld with unknown codes\n", all.itineraries, all.legs, all.unknown);
+    fprintf(stderr, "total %.3f km\n", all.total_km);
+    fprintf(stderr, "%.1f M legs/s\n", all.legs / elapsed / 1e6);
+
+    city_code_index_destroy(&index);
+    return 0;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "cities.h"
+#include "city_join.h"
+#include "geo.h"
+
+/**
+ * Reads "station_id,lat,lon" lines from the given file into growing arrays.
+ *
+ * @param input a file to read from
+ * @param n set to the number of stations read
+ * @param stations set to a new array of their locations
+ * @param ids set to a new array of their ids
+ * @return true if successful, false if memory could not be allocated
+ */
+bool read_stations(FILE *input, int *n, location **stations, int64_t **ids);
+
+/**
+ * Counts the (station, airport) pairs within radius_km of each other by
+ * trying every pair, to check the grid against.
+ *
+ * @param n the number of stations
+ * @param stations an array of n locations
+ * @param radius_km a nonnegative distance in kilometers
+ * @return the number of pairs
+ */
+long count_matches_brute(int n, const location *stations, double radius_km);
+
+int main(int argc, char **argv)
+{
+    FILE *input = stdin;
+    FILE *output = stdout;
+    double radius_km = 50.0;
+    int threads = 0;
+    join_format format = JOIN_CSV;
+    bool check = false;
+
+    // Options are "-i file", "-o file", "-r radius_km", "-t threads", "-b"
+    // for binary join_records instead of CSV and "-c" to check the number
+    // of matches against trying every pair, e.g. for stations along the
+    // antimeridian where the grid wraps around
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0)
+        {
+            format = JOIN_BINARY;
+            continue;
+        }
+        if (strcmp(argv[i], "-c") == 0)
+        {
+            check = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-i") != 0 && strcmp(argv[i], "-o") != 0
+            && strcmp(argv[i], "-r") != 0 && strcmp(argv[i], "-t") != 0)
+        {
+            fprintf(stderr, "%s: unknown option %s\n", argv[0], argv[i]);
+            return 1;
+        }
+        if (i == argc - 1)
+        {
+            fprintf(stderr, "%s: must specify a value after \"%s\"\n", argv[0], argv[i]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "-i") == 0)
+        {
+            input = fopen(argv[i + 1], "r");
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            output = fopen(argv[i + 1], format == JOIN_BINARY ? "wb" : "w");
+        }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            radius_km = atof(argv[i + 1]);
+        }
+        else
+        {
+            threads = atoi(argv[i + 1]);
+        }
+        if (!input || !output)
+        {
+            fprintf(stderr, "%s: could not open %s\n", argv[0], argv[i + 1]);
+            return 1;
+        }
+        i++;
+    }
+
+    int n;
+    location *stations;
+    int64_t *ids;
+    if (!read_stations(input, &n, &stations, &ids))
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    long matches = city_join(n, stations, ids, radius_km, threads, format, output);
+    long expected = check && matches >= 0 ? count_matches_brute(n, stations, radius_km) : matches;
+    free(stations);
+    free(ids);
+    if (matches < 0)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    fprintf(stderr, "%d stations, %ld matches\n", n, matches);
+    if (expected != matches)
+    {
+        fprintf(stderr, "%s: trying every pair gives %ld matches\n", argv[0], expected);
+        return 1;
+    }
+    return 0;
+}
+
+long count_matches_brute(int n, const location *stations, double radius_km)
+{
+    long matches = 0;
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < city_count; j++)
+        {
+            matches += geo_spherical_km(&stations[i], &cities[j].coord) <= radius_km;
+        }
+    }
+    return matches;
+}
+
+bool read_stations(FILE *input, int *n, location **stations, int64_t **ids)
+{
+    int capacity = 1024;
+    int count = 0;
+    bool ok = true;
+    location *locs = malloc(sizeof(location) * capacity);
+    int64_t *keys = malloc(sizeof(int64_t) * capacity);
+
+    int64_t id;
+    location loc;
+    while (locs && keys && fscanf(input, "%" SCNd64 ",%lf,%lf", &id, &loc.lat, &loc.lon) == 3)
+    {
+        // Double the arrays when they're full
+        if (count == capacity)
+        {
+            capacity *= 2;
+            location *more_locs = realloc(locs, sizeof(location) * capacity);
+            int64_t *more_keys = realloc(keys, sizeof(int64_t) * capacity);
+            locs = more_locs ? more_locs : locs;
+            keys = more_keys ? more_keys : keys;
+            if (!more_locs || !more_keys)
+            {
+                ok = false;
+                break;
+            }
+        }
+        locs[count] = loc;
+        keys[count] = id;
+        count++;
+    }
+
+    if (!locs || !keys || !ok)
+    {
+        free(locs);
+        free(keys);
+        return false;
+    }
+
+    *n = count;
+    *stations = locs;
+    *ids = keys;
+    return true;
+}
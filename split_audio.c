@@ -0,0 +1,107 @@
+#include "split_audio.h"
+#include "split_scan.h"
+
+int split_default_gap(int threshold)
+{
+    return threshold > 3 ? threshold - 1 : 2;
+}
+
+void split_init(split_state *s, const split_config *config, track_fn on_track, void *arg)
+{
+    s->phase = GAP;
+    s->count = 0;
+    s->start = 0;
+    s->end = 0;
+    s->zeros = 0;
+    s->config = *config;
+    s->on_track = on_track;
+    s->arg = arg;
+}
+
+// The state machine of the original SplitAudio, but jumping straight to
+// the next sample that changes the state instead of looking at every
+// one; the samples in between would leave it as it is.  It is written
+// once and compiled for each sample type with that type's scans.
+#define SPLIT_FEED(name, type, scan_loud, scan_quiet)                           \
+    void name(split_state *s, const type *samples, size_t n)                    \
+    {                                                                           \
+        int64_t base = s->count;                                                \
+        int threshold = s->config.threshold;                                    \
+        size_t i = 0;                                                           \
+        while (i < n)                                                           \
+        {                                                                       \
+            size_t j;                                                           \
+            switch (s->phase)                                                   \
+            {                                                                   \
+                case GAP:                                                       \
+                    j = i + scan_loud(samples + i, n - i, threshold);           \
+                    if (j < n)                                                  \
+                    {                                                           \
+                        s->start = base + j;                                    \
+                        s->phase = TRACK;                                       \
+                    }                                                           \
+                    i = j + 1;                                                  \
+                    break;                                                      \
+                                                                                \
+                case TRACK:                                                     \
+                    j = i + scan_quiet(samples + i, n - i, threshold);          \
+                    if (j < n)                                                  \
+                    {                                                           \
+                        s->end = base + j - 1;                                  \
+                        s->zeros = 1;                                           \
+                        s->phase = ZEROS;                                       \
+                        end_track_if_gap(s);                                    \
+                    }                                                           \
+                    i = j + 1;                                                  \
+                    break;                                                      \
+                                                                                \
+                case ZEROS:                                                     \
+                {                                                               \
+                    /* Only the quiet samples that could end it matter */       \
+                    size_t need = s->config.min_gap - s->zeros;                 \
+                    size_t window = need < n - i ? need : n - i;                \
+                    j = scan_loud(samples + i, window, threshold);              \
+                    if (j < window)                                             \
+                    {                                                           \
+                        s->phase = TRACK;                                       \
+                        i += j + 1;                                             \
+                        break;                                                  \
+                    }                                                           \
+                    s->zeros += window;                                         \
+                    i += window;                                                \
+                    end_track_if_gap(s);                                        \
+                    break;                                                      \
+                }                                                               \
+            }                                                                   \
+        }                                                                       \
+        s->count = base + n;                                                    \
+    }
+
+// Ends the track once the quiet run is long enough
+static void end_track_if_gap(split_state *s);
+
+SPLIT_FEED(split_feed, int32_t, scan_loud, scan_quiet)
+SPLIT_FEED(split_feed16, int16_t, scan_loud16, scan_quiet16)
+
+static void end_track_if_gap(split_state *s)
+{
+    if (s->zeros >= s->config.min_gap)
+    {
+        s->on_track(s->start, s->end, s->arg);
+        s->zeros = 0;
+        s->phase = GAP;
+    }
+}
+
+void split_finish(split_state *s)
+{
+    if (s->phase == TRACK)
+    {
+        s->on_track(s->start, s->count - 1, s->arg);
+    }
+    else if (s->phase == ZEROS)
+    {
+        s->on_track(s->start, s->end, s->arg);
+    }
+    s->phase = GAP;
+}
@@ -0,0 +1,87 @@
+#ifndef __SPLIT_AUDIO_H__
+#define __SPLIT_AUDIO_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The states of SplitAudio's track detector: between tracks, in a track,
+// or in a track but in a run of quiet samples that may end it
+typedef enum {GAP, TRACK, ZEROS} split_phase;
+
+/**
+ * Called for each track found, with its first and last sample.
+ *
+ * @param start the index of the first loud sample of the track
+ * @param end the index of the last loud sample of the track
+ * @param arg the pointer that was passed to split_init
+ */
+typedef void (*track_fn)(int64_t start, int64_t end, void *arg);
+
+// What the detector listens for.  A sample is loud if its absolute value
+// is above the threshold.  A track starts at a loud sample and ends at
+// the last loud one before a run of min_gap quiet samples, or at the end
+// of the input.
+typedef struct
+{
+    int threshold;
+    int min_gap;    // at least 1
+} split_config;
+
+// The track detector of SplitAudio, fed a block of samples at a time
+typedef struct
+{
+    split_phase phase;
+    int64_t count;  // samples seen so far
+    int64_t start;
+    int64_t end;
+    int zeros;
+    split_config config;
+    track_fn on_track;
+    void *arg;
+} split_state;
+
+/**
+ * Returns the gap the original SplitAudio used with a threshold, which
+ * is threshold - 1 quiet samples, but at least 2.
+ *
+ * @param threshold the largest absolute value of a quiet sample
+ */
+int split_default_gap(int threshold);
+
+/**
+ * Starts a detector in the GAP state.
+ *
+ * @param s the detector
+ * @param config the threshold and gap; copied
+ * @param on_track called for each track
+ * @param arg passed through to on_track
+ */
+void split_init(split_state *s, const split_config *config, track_fn on_track, void *arg);
+
+/**
+ * Runs the detector over the next samples of the input.
+ *
+ * @param s the detector
+ * @param samples an array of n samples
+ * @param n a nonnegative integer
+ */
+void split_feed(split_state *s, const int32_t *samples, size_t n);
+
+/**
+ * Runs the detector over the next samples of 16-bit input, without
+ * widening them first.
+ *
+ * @param s the detector
+ * @param samples an array of n samples
+ * @param n a nonnegative integer
+ */
+void split_feed16(split_state *s, const int16_t *samples, size_t n);
+
+/**
+ * Ends the input, reporting the track in progress if there is one.
+ *
+ * @param s the detector
+ */
+void split_finish(split_state *s);
+
+#endif
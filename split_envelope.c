@@ -0,0 +1,286 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "split_envelope.h"
+
+// Levels are worked out for this many samples at a time
+#define ENVELOPE_BLOCK 65536
+
+// Sorts the levels of the block of n samples after the window of history
+// into bands
+static void rms_bands(envelope_state *s, size_t n);
+static void peak_bands(envelope_state *s, size_t n);
+
+// Runs the state machine over the bands of a block of n samples
+static void run_bands(envelope_state *s, size_t n);
+
+// Returns the index of the first band above off, or n if there is none
+static size_t first_above_off(const uint8_t *bands, size_t n);
+
+// Ends the track once the run of low levels is long enough
+static void end_track_if_gap(envelope_state *s);
+
+// Returns the absolute value of a sample, without overflow for INT32_MIN
+static uint32_t magnitude(int32_t value);
+
+bool envelope_init(envelope_state *s, const envelope_config *config, track_fn on_track, void *arg)
+{
+    size_t window = config->window;
+    s->config = *config;
+    s->phase = GAP;
+    s->count = 0;
+    s->start = 0;
+    s->end = 0;
+    s->zeros = 0;
+    s->energy = 0;
+    s->on_energy = (unsigned __int128)((uint64_t)config->on * config->on) * window;
+    s->off_energy = (unsigned __int128)((uint64_t)config->off * config->off) * window;
+    s->on_track = on_track;
+    s->arg = arg;
+
+    // The history starts out as silence
+    s->magnitudes = calloc(window + ENVELOPE_BLOCK, sizeof(uint32_t));
+    s->prefix = NULL;
+    s->suffix = NULL;
+    if (config->kind == ENVELOPE_PEAK)
+    {
+        s->prefix = malloc(sizeof(uint32_t) * (window + ENVELOPE_BLOCK));
+        s->suffix = malloc(sizeof(uint32_t) * (window + ENVELOPE_BLOCK));
+    }
+    s->bands = malloc(ENVELOPE_BLOCK);
+    if (!s->magnitudes || !s->bands || (config->kind == ENVELOPE_PEAK && (!s->prefix || !s->suffix)))
+    {
+        envelope_destroy(s);
+        return false;
+    }
+    return true;
+}
+
+void envelope_feed(envelope_state *s, const int32_t *samples, size_t n)
+{
+    size_t window = s->config.window;
+    uint32_t *magnitudes = s->magnitudes;
+    for (size_t done = 0; done < n;)
+    {
+        size_t m = n - done < ENVELOPE_BLOCK ? n - done : ENVELOPE_BLOCK;
+        for (size_t j = 0; j < m; j++)
+        {
+            magnitudes[window + j] = magnitude(samples[done + j]);
+        }
+        if (s->config.kind == ENVELOPE_RMS)
+        {
+            rms_bands(s, m);
+        }
+        else
+        {
+            peak_bands(s, m);
+        }
+        run_bands(s, m);
+
+        // The last window samples are the history of the next block
+        memmove(magnitudes, magnitudes + m, sizeof(uint32_t) * window);
+        done += m;
+    }
+}
+
+void envelope_finish(envelope_state *s)
+{
+    if (s->phase == TRACK)
+    {
+        s->on_track(s->start, s->count - 1, s->arg);
+    }
+    else if (s->phase == ZEROS)
+    {
+        s->on_track(s->start, s->end, s->arg);
+    }
+    s->phase = GAP;
+}
+
+void envelope_destroy(envelope_state *s)
+{
+    free(s->magnitudes);
+    free(s->prefix);
+    free(s->suffix);
+    free(s->bands);
+    s->magnitudes = NULL;
+    s->prefix = NULL;
+    s->suffix = NULL;
+    s->bands = NULL;
+}
+
+static void rms_bands(envelope_state *s, size_t n)
+{
+    // The window of sample j is magnitudes[j + 1 .. j + window], so each
+    // step adds one square and takes away the one that fell out; the
+    // level is above a threshold exactly when the sum is above the
+    // threshold squared times the window, with no rounding
+    size_t window = s->config.window;
+    const uint32_t *magnitudes = s->magnitudes;
+    uint8_t *bands = s->bands;
+    unsigned __int128 energy = s->energy;
+    unsigned __int128 on = s->on_energy;
+    unsigned __int128 off = s->off_energy;
+
+    // Usually every sum of the block fits in 64 bits, which is quicker
+    uint32_t loudest = 0;
+    for (size_t j = 0; j < window + n; j++)
+    {
+        loudest = magnitudes[j] > loudest ? magnitudes[j] : loudest;
+    }
+    if ((unsigned __int128)((uint64_t)loudest * loudest) * window <= UINT64_MAX)
+    {
+        uint64_t sum = (uint64_t)energy;
+        uint64_t on64 = on < UINT64_MAX ? (uint64_t)on : UINT64_MAX;
+        uint64_t off64 = off < UINT64_MAX ? (uint64_t)off : UINT64_MAX;
+        for (size_t j = 0; j < n; j++)
+        {
+            uint64_t in = magnitudes[j + window];
+            uint64_t out = magnitudes[j];
+            sum += in * in - out * out;
+            bands[j] = (uint8_t)((sum > off64) + (sum > on64));
+        }
+        s->energy = sum;
+        return;
+    }
+
+    for (size_t j = 0; j < n; j++)
+    {
+        uint64_t in = magnitudes[j + window];
+        uint64_t out = magnitudes[j];
+        energy += in * in;
+        energy -= out * out;
+        bands[j] = (uint8_t)((energy > off) + (energy > on));
+    }
+    s->energy = energy;
+}
+
+static void peak_bands(envelope_state *s, size_t n)
+{
+    // Cut the samples into segments of a window each and take running
+    // maxima forwards and backwards through each one; any window is the
+    // end of one segment and the start of the next, so its maximum is
+    // the larger of two of them (van Herk and Gil-Werman)
+    size_t window = s->config.window;
+    const uint32_t *levels = s->magnitudes + 1;
+    size_t length = window - 1 + n;
+    uint32_t *prefix = s->prefix;
+    uint32_t *suffix = s->suffix;
+    for (size_t segment = 0; segment < length; segment += window)
+    {
+        size_t end = segment + window < length ? segment + window : length;
+        uint32_t run = 0;
+        for (size_t k = segment; k < end; k++)
+        {
+            run = levels[k] > run ? levels[k] : run;
+            prefix[k] = run;
+        }
+        run = 0;
+        for (size_t k = end; k-- > segment;)
+        {
+            run = levels[k] > run ? levels[k] : run;
+            suffix[k] = run;
+        }
+    }
+
+    uint32_t on = s->config.on;
+    uint32_t off = s->config.off;
+    uint8_t *bands = s->bands;
+    for (size_t j = 0; j < n; j++)
+    {
+        uint32_t level = suffix[j] > prefix[j + window - 1] ? suffix[j] : prefix[j + window - 1];
+        bands[j] = (uint8_t)((level > off) + (level > on));
+    }
+}
+
+static void run_bands(envelope_state *s, size_t n)
+{
+    // The same states as the amplitude detector, but only a level above
+    // on starts a track, and any level above off keeps it going
+    const uint8_t *bands = s->bands;
+    int64_t base = s->count;
+    size_t i = 0;
+    while (i < n)
+    {
+        const uint8_t *found;
+        size_t j;
+        switch (s->phase)
+        {
+            case GAP:
+                found = memchr(bands + i, 2, n - i);
+                j = found ? (size_t)(found - bands) : n;
+                if (j < n)
+                {
+                    s->start = base + j;
+                    s->phase = TRACK;
+                }
+                i = j + 1;
+                break;
+
+            case TRACK:
+                found = memchr(bands + i, 0, n - i);
+                j = found ? (size_t)(found - bands) : n;
+                if (j < n)
+                {
+                    s->end = base + j - 1;
+                    s->zeros = 1;
+                    s->phase = ZEROS;
+                    end_track_if_gap(s);
+                }
+                i = j + 1;
+                break;
+
+            case ZEROS:
+            {
+                size_t need = s->config.min_gap - s->zeros;
+                size_t window = need < n - i ? need : n - i;
+                j = first_above_off(bands + i, window);
+                if (j < window)
+                {
+                    s->phase = TRACK;
+                    i += j + 1;
+                    break;
+                }
+                s->zeros += window;
+                i += window;
+                end_track_if_gap(s);
+                break;
+            }
+        }
+    }
+    s->count = base + n;
+}
+
+static size_t first_above_off(const uint8_t *bands, size_t n)
+{
+    // Skip whole words of zeros, then find the byte
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bands + j, 8);
+        if (word)
+        {
+            break;
+        }
+    }
+    while (j < n && bands[j] == 0)
+    {
+        j++;
+    }
+    return j;
+}
+
+static void end_track_if_gap(envelope_state *s)
+{
+    if (s->zeros >= s->config.min_gap)
+    {
+        s->on_track(s->start, s->end, s->arg);
+        s->zeros = 0;
+        s->phase = GAP;
+    }
+}
+
+static uint32_t magnitude(int32_t value)
+{
+    return value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+}
@@ -0,0 +1,84 @@
+#ifndef __SPLIT_ENVELOPE_H__
+#define __SPLIT_ENVELOPE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "split_audio.h"
+
+// What the level of a sample is taken from: the root mean square or the
+// largest absolute value of the window of samples ending at it
+typedef enum {ENVELOPE_RMS, ENVELOPE_PEAK} envelope_kind;
+
+// An envelope detector with hysteresis.  A track starts where the level
+// goes above on, and ends at the last sample above off before a run of
+// min_gap samples at most off, or at the end of the input.  Samples
+// before the start of the input count as silence, and since the level
+// looks back a window, a track ends up to a window after its sound does.
+typedef struct
+{
+    envelope_kind kind;
+    int window;     // at least 1
+    int on;
+    int off;        // at most on
+    int min_gap;    // at least 1
+} envelope_config;
+
+typedef struct
+{
+    envelope_config config;
+    split_phase phase;
+    int64_t count;          // samples seen so far
+    int64_t start;
+    int64_t end;
+    int64_t zeros;
+    unsigned __int128 energy;           // sum of squares over the window
+    unsigned __int128 on_energy;        // the levels, as sums of squares
+    unsigned __int128 off_energy;
+    uint32_t *magnitudes;   // the last window samples, then a block
+    uint32_t *prefix;       // running maxima for the peak level
+    uint32_t *suffix;
+    uint8_t *bands;         // 0 at most off, 1 above off, 2 above on
+    track_fn on_track;
+    void *arg;
+} envelope_state;
+
+/**
+ * Starts an envelope detector in the GAP state.
+ *
+ * @param s the detector
+ * @param config the kind of level, window and thresholds; copied
+ * @param on_track called for each track
+ * @param arg passed through to on_track
+ * @return true if successful, false if memory could not be allocated
+ */
+bool envelope_init(envelope_state *s, const envelope_config *config, track_fn on_track, void *arg);
+
+/**
+ * Runs the detector over the next samples of the input, a block at a
+ * time: the levels of a block are computed with running sums (or running
+ * maxima), sorted into bands, and the bands searched for the next change
+ * of state.
+ *
+ * @param s the detector
+ * @param samples an array of n samples
+ * @param n a nonnegative integer
+ */
+void envelope_feed(envelope_state *s, const int32_t *samples, size_t n);
+
+/**
+ * Ends the input, reporting the track in progress if there is one.
+ *
+ * @param s the detector
+ */
+void envelope_finish(envelope_state *s);
+
+/**
+ * Frees the memory of a detector.
+ *
+ * @param s a detector started by envelope_init
+ */
+void envelope_destroy(envelope_state *s);
+
+#endif
@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "split_index.h"
+#include "split_scan.h"
+
+#define INDEX_MAGIC "SAINDEX1"
+
+// The start of an index file, followed by the blocks of each level from
+// level 0 up; everything is in the byte order of the machine that wrote
+// it, since an index is only a cache next to its input
+typedef struct
+{
+    char magic[8];
+    uint64_t frames;
+    uint32_t block;
+    uint32_t fanout;
+    uint32_t levels;
+    uint32_t bytes_per_sample;  // the layout the index was made from
+    uint32_t channels;
+    uint32_t reduction;
+    uint32_t channel;
+    uint32_t unused;
+} index_header;
+
+// The state of one index_split
+typedef struct
+{
+    split_index *index;
+    const audio_reader *reader;
+    const unsigned char *bytes;
+    size_t frame;           // bytes per frame
+    split_config config;
+    bool whole_runs;        // a track can only end between runs
+    uint64_t span[32];      // level 0 blocks under a block of each level
+    int32_t *samples;       // one block of every channel
+    bool in_run;            // consecutive level 0 blocks that each have
+    uint64_t run_first;     // a loud sample
+    uint64_t run_last;
+    bool first_full;        // every sample of the run's first block is loud
+    bool last_full;         // and of its last block
+    bool have;              // the track so far
+    int64_t start;
+    int64_t end;
+    track_fn on_track;
+    void *arg;
+} index_query;
+
+// Adds a finished block to the builder
+static void add_block(index_builder *builder);
+
+// Returns the number of blocks of each level for the given frames, and
+// the number of levels
+static int level_counts(uint64_t frames, size_t *counts);
+
+// Returns an entry covering nothing yet
+static index_entry empty_entry();
+
+// Visits block i of a level, going down into it unless it's all quiet
+// or all loud
+static void visit(index_query *q, int level, size_t i);
+
+// Adds level 0 blocks first to last, each with a loud sample, to the run
+static void add_span(index_query *q, uint64_t first, uint64_t last, bool full);
+
+// Finds the tracks of the run of blocks so far
+static void end_run(index_query *q);
+
+// Decodes level 0 block i and returns its number of samples
+static size_t decode_block(index_query *q, uint64_t i);
+
+// Adds a track found in one run, joining it to the one before if the gap
+// between them is too short
+static void add_track(int64_t start, int64_t end, void *arg);
+
+// Returns the magnitude of a sample
+static uint32_t magnitude(int32_t value);
+
+void index_builder_init(index_builder *builder)
+{
+    memset(builder, 0, sizeof(index_builder));
+    builder->current = empty_entry();
+}
+
+void index_builder_feed(index_builder *builder, const int32_t *samples, size_t n)
+{
+    size_t i = 0;
+    while (i < n)
+    {
+        size_t take = INDEX_BLOCK - builder->filled;
+        if (take > n - i)
+        {
+            take = n - i;
+        }
+
+        // Only the extremes are needed; the peak is the larger of their
+        // magnitudes
+        int32_t lo = builder->current.min;
+        int32_t hi = builder->current.max;
+        for (size_t j = i; j < i + take; j++)
+        {
+            lo = samples[j] < lo ? samples[j] : lo;
+            hi = samples[j] > hi ? samples[j] : hi;
+        }
+        builder->current.min = lo;
+        builder->current.max = hi;
+        builder->filled += take;
+        builder->frames += take;
+        i += take;
+        if (builder->filled == INDEX_BLOCK)
+        {
+            add_block(builder);
+        }
+    }
+}
+
+bool index_builder_write(index_builder *builder, const audio_reader *reader, const char *path)
+{
+    if (builder->filled > 0)
+    {
+        add_block(builder);
+    }
+    size_t counts[32];
+    int levels = level_counts(builder->frames, counts);
+    size_t total = 0;
+    for (int l = 0; l < levels; l++)
+    {
+        total += counts[l];
+    }
+    if (builder->failed || builder->count != counts[0])
+    {
+        return false;
+    }
+
+    // Each level after the first combines the blocks below it
+    index_entry *entries = realloc(builder->entries, sizeof(index_entry) * (total > 0 ? total : 1));
+    if (!entries)
+    {
+        return false;
+    }
+    builder->entries = entries;
+    builder->capacity = total;
+    index_entry *below = entries;
+    for (int l = 1; l < levels; l++)
+    {
+        index_entry *above = below + counts[l - 1];
+        for (size_t i = 0; i < counts[l]; i++)
+        {
+            index_entry e = empty_entry();
+            size_t last = (i + 1) * INDEX_FANOUT < counts[l - 1] ? (i + 1) * INDEX_FANOUT : counts[l - 1];
+            for (size_t j = i * INDEX_FANOUT; j < last; j++)
+            {
+                e.min = below[j].min < e.min ? below[j].min : e.min;
+                e.max = below[j].max > e.max ? below[j].max : e.max;
+                e.peak = below[j].peak > e.peak ? below[j].peak : e.peak;
+            }
+            above[i] = e;
+        }
+        below = above;
+    }
+
+    index_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, 8);
+    header.frames = builder->frames;
+    header.block = INDEX_BLOCK;
+    header.fanout = INDEX_FANOUT;
+    header.levels = levels;
+    header.bytes_per_sample = reader->bytes_per_sample;
+    header.channels = reader->channels;
+    header.reduction = reader->reduction;
+    header.channel = reader->channel;
+
+    FILE *out = fopen(path, "wb");
+    if (!out)
+    {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+              && fwrite(entries, sizeof(index_entry), total, out) == total;
+    return fclose(out) == 0 && ok;
+}
+
+void index_builder_destroy(index_builder *builder)
+{
+    free(builder->entries);
+    builder->entries = NULL;
+}
+
+bool index_open(split_index *index, const char *path, const audio_reader *reader, uint64_t count)
+{
+    memset(index, 0, sizeof(split_index));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    void *map = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(index_header)
+                ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+    index->map = map;
+    index->map_size = st.st_size;
+
+    // The index has to be of this input, read the same way
+    const index_header *header = (const index_header *)map;
+    size_t counts[32];
+    int levels = level_counts(count, counts);
+    size_t total = 0;
+    for (int l = 0; l < levels; l++)
+    {
+        total += counts[l];
+    }
+    if (memcmp(header->magic, INDEX_MAGIC, 8) != 0 || header->frames != count || header->block != INDEX_BLOCK
+        || header->fanout != INDEX_FANOUT || header->levels != (uint32_t)levels
+        || header->bytes_per_sample != (uint32_t)reader->bytes_per_sample
+        || header->channels != (uint32_t)reader->channels || header->reduction != (uint32_t)reader->reduction
+        || header->channel != (uint32_t)reader->channel
+        || index->map_size != sizeof(index_header) + sizeof(index_entry) * total)
+    {
+        index_close(index);
+        return false;
+    }
+
+    index->frames = count;
+    index->levels = levels;
+    const index_entry *entries = (const index_entry *)(header + 1);
+    for (int l = 0; l < levels; l++)
+    {
+        index->level[l] = entries;
+        index->level_count[l] = counts[l];
+        entries += counts[l];
+    }
+    return true;
+}
+
+bool index_split(split_index *index, const audio_reader *reader, const unsigned char *bytes,
+                 const split_config *config, track_fn on_track, void *arg)
+{
+    index_query q;
+    memset(&q, 0, sizeof(q));
+    q.index = index;
+    q.reader = reader;
+    q.bytes = bytes;
+    q.frame = (size_t)reader->bytes_per_sample * reader->channels;
+    q.config = *config;
+    q.whole_runs = 2 * INDEX_BLOCK - 2 < config->min_gap;
+    q.on_track = on_track;
+    q.arg = arg;
+    q.samples = malloc(sizeof(int32_t) * INDEX_BLOCK * reader->channels);
+    if (!q.samples)
+    {
+        return false;
+    }
+    q.span[0] = 1;
+    for (int l = 1; l < index->levels; l++)
+    {
+        q.span[l] = q.span[l - 1] * INDEX_FANOUT;
+    }
+
+    int top = index->levels - 1;
+    for (size_t i = 0; i < index->level_count[top]; i++)
+    {
+        visit(&q, top, i);
+    }
+    if (q.in_run)
+    {
+        end_run(&q);
+    }
+    if (q.have)
+    {
+        on_track(q.start, q.end, arg);
+    }
+    free(q.samples);
+    return true;
+}
+
+void index_close(split_index *index)
+{
+    if (index->map)
+    {
+        munmap(index->map, index->map_size);
+        index->map = NULL;
+    }
+}
+
+static void add_block(index_builder *builder)
+{
+    if (builder->count == builder->capacity)
+    {
+        size_t capacity = builder->capacity ? 2 * builder->capacity : 1024;
+        index_entry *entries = realloc(builder->entries, sizeof(index_entry) * capacity);
+        if (!entries)
+        {
+            builder->failed = true;
+            builder->current = empty_entry();
+            builder->filled = 0;
+            return;
+        }
+        builder->entries = entries;
+        builder->capacity = capacity;
+    }
+    index_entry *e = &builder->entries[builder->count++];
+    *e = builder->current;
+    uint32_t low = magnitude(e->min);
+    uint32_t high = magnitude(e->max);
+    e->peak = low > high ? low : high;
+    builder->current = empty_entry();
+    builder->filled = 0;
+}
+
+static int level_counts(uint64_t frames, size_t *counts)
+{
+    int levels = 1;
+    counts[0] = (frames + INDEX_BLOCK - 1) / INDEX_BLOCK;
+    while (counts[levels - 1] > 1 && levels < 32)
+    {
+        counts[levels] = (counts[levels - 1] + INDEX_FANOUT - 1) / INDEX_FANOUT;
+        levels++;
+    }
+    return levels;
+}
+
+static index_entry empty_entry()
+{
+    index_entry e = {INT32_MAX, INT32_MIN, 0};
+    return e;
+}
+
+static void visit(index_query *q, int level, size_t i)
+{
+    const index_entry *e = &q->index->level[level][i];
+    if (e->peak <= (uint32_t)q->config.threshold)
+    {
+        return;
+    }
+
+    // All of a block is loud when all of it is on one side of the
+    // threshold
+    bool full = e->min > q->config.threshold || (int64_t)e->max < -(int64_t)q->config.threshold;
+    if (level == 0 || full)
+    {
+        uint64_t last = (i + 1) * q->span[level];
+        if (last > q->index->level_count[0])
+        {
+            last = q->index->level_count[0];
+        }
+        add_span(q, i * q->span[level], last - 1, full);
+        return;
+    }
+    size_t last = (i + 1) * INDEX_FANOUT;
+    if (last > q->index->level_count[level - 1])
+    {
+        last = q->index->level_count[level - 1];
+    }
+    for (size_t j = i * INDEX_FANOUT; j < last; j++)
+    {
+        visit(q, level - 1, j);
+    }
+}
+
+static void add_span(index_query *q, uint64_t first, uint64_t last, bool full)
+{
+    if (q->in_run && first == q->run_last + 1)
+    {
+        q->run_last = last;
+        q->last_full = full;
+        return;
+    }
+    if (q->in_run)
+    {
+        end_run(q);
+    }
+    q->in_run = true;
+    q->run_first = first;
+    q->run_last = last;
+    q->first_full = full;
+    q->last_full = full;
+}
+
+static void end_run(index_query *q)
+{
+    q->in_run = false;
+    int threshold = q->config.threshold;
+    if (!q->whole_runs)
+    {
+        // A gap can hide in the run, so every sample of it goes through a
+        // detector, counting from the start of the run
+        split_state detector;
+        split_init(&detector, &q->config, add_track, q);
+        detector.count = q->run_first * INDEX_BLOCK;
+        for (uint64_t i = q->run_first; i <= q->run_last; i++)
+        {
+            split_feed(&detector, q->samples, decode_block(q, i));
+        }
+        split_finish(&detector);
+        return;
+    }
+
+    // Otherwise the run is one track, from its first loud sample to its
+    // last
+    int64_t start = q->run_first * INDEX_BLOCK;
+    if (!q->first_full)
+    {
+        size_t n = decode_block(q, q->run_first);
+        start += scan_loud(q->samples, n, threshold);
+    }
+    int64_t end = (q->run_last + 1) * INDEX_BLOCK;
+    end = (uint64_t)end < q->index->frames ? end - 1 : (int64_t)q->index->frames - 1;
+    if (!q->last_full)
+    {
+        size_t n = decode_block(q, q->run_last);
+        size_t j = n - 1;
+        while (j > 0 && magnitude(q->samples[j]) <= (uint32_t)threshold)
+        {
+            j--;
+        }
+        end = q->run_last * INDEX_BLOCK + j;
+    }
+    add_track(start, end, q);
+}
+
+static size_t decode_block(index_query *q, uint64_t i)
+{
+    uint64_t first = i * INDEX_BLOCK;
+    size_t n = q->index->frames - first < INDEX_BLOCK ? q->index->frames - first : INDEX_BLOCK;
+    int channels = q->reader->channels;
+    audio_decode(q->bytes + first * q->frame, n * channels, q->reader->bytes_per_sample, q->samples);
+    if (channels > 1)
+    {
+        audio_reduce(q->reader, q->samples, n, q->samples);
+    }
+    q->index->frames_read += n;
+    return n;
+}
+
+static void add_track(int64_t start, int64_t end, void *arg)
+{
+    index_query *q = (index_query *)arg;
+    if (q->have && start - q->end - 1 < q->config.min_gap)
+    {
+        q->end = end;
+        return;
+    }
+    if (q->have)
+    {
+        q->on_track(q->start, q->end, q->arg);
+    }
+    q->start = start;
+    q->end = end;
+    q->have = true;
+}
+
+static uint32_t magnitude(int32_t value)
+{
+    return value < 0 ? 0 - (uint32_t)value : (uint32_t)value;
+}
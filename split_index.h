@@ -0,0 +1,126 @@
+#ifndef __SPLIT_INDEX_H__
+#define __SPLIT_INDEX_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "audio_input.h"
+#include "split_audio.h"
+
+// Level 0 of an index has a block for every INDEX_BLOCK samples, and each
+// level above it a block for every INDEX_FANOUT blocks of the one below
+#define INDEX_BLOCK 256
+#define INDEX_FANOUT 8
+
+// The extremes of a block of samples, after each frame is reduced to one
+typedef struct
+{
+    int32_t min;
+    int32_t max;
+    uint32_t peak;  // the largest magnitude
+} index_entry;
+
+// Collects the extremes of every block of INDEX_BLOCK samples of an input
+// as it is read, for writing out as an index
+typedef struct
+{
+    index_entry *entries;
+    size_t count;
+    size_t capacity;
+    index_entry current;    // the block being filled
+    uint32_t filled;        // samples in it so far
+    uint64_t frames;        // samples seen so far
+    bool failed;
+} index_builder;
+
+// An index written by index_builder_write, mapped to answer queries: the
+// extremes of each block of samples at several resolutions, each level's
+// blocks covering INDEX_FANOUT of the level below
+typedef struct
+{
+    void *map;
+    size_t map_size;
+    uint64_t frames;
+    int levels;
+    const index_entry *level[32];   // level 0 is the finest
+    size_t level_count[32];
+    uint64_t frames_read;   // samples index_split had to decode
+} split_index;
+
+/**
+ * Starts collecting the extremes of an input.
+ *
+ * @param builder the builder to fill in
+ */
+void index_builder_init(index_builder *builder);
+
+/**
+ * Adds the next samples of the input.
+ *
+ * @param builder the builder
+ * @param samples an array of n samples, one per frame
+ * @param n a nonnegative integer
+ */
+void index_builder_feed(index_builder *builder, const int32_t *samples, size_t n);
+
+/**
+ * Writes the index of everything fed so far: a header naming the layout
+ * of the input, then the blocks of each level from the finest up.
+ *
+ * @param builder the builder
+ * @param reader the reader the samples came from
+ * @param path the file to write
+ * @return true if successful, false if memory ran out or the file could
+ *         not be written
+ */
+bool index_builder_write(index_builder *builder, const audio_reader *reader, const char *path);
+
+/**
+ * Frees the memory of a builder.
+ *
+ * @param builder a builder started by index_builder_init
+ */
+void index_builder_destroy(index_builder *builder);
+
+/**
+ * Maps an index for answering queries about the given input.
+ *
+ * @param index the index to fill in
+ * @param path the index file
+ * @param reader the reader of the input, set up as it was for the index
+ * @param count the number of frames of the input, from audio_map
+ * @return true if successful, false if the file could not be read, is
+ *         not an index, or was made from different input
+ */
+bool index_open(split_index *index, const char *path, const audio_reader *reader, uint64_t count);
+
+/**
+ * Finds the tracks for a threshold and gap from the index, reporting
+ * exactly what split_feed over every sample would.  Blocks whose peak is
+ * at most the threshold are skipped whole, coarsest level first, and
+ * blocks whose samples are all loud need no samples read.  When the gap
+ * is longer than two blocks of the finest level, no track can end inside
+ * a run of blocks that each have a loud sample, so only the first and
+ * last block of each run are decoded; shorter gaps decode every block of
+ * each run.
+ *
+ * @param index an open index
+ * @param reader the reader of the input
+ * @param bytes the input, as audio_map returns it
+ * @param config the threshold and gap
+ * @param on_track called for each track in order
+ * @param arg passed through to on_track
+ * @return true if successful, false if memory could not be allocated
+ */
+bool index_split(split_index *index, const audio_reader *reader, const unsigned char *bytes,
+                 const split_config *config, track_fn on_track, void *arg);
+
+/**
+ * Unmaps an index.
+ *
+ * @param index an index opened by index_open
+ */
+void index_close(split_index *index);
+
+#endif
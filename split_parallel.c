@@ -0,0 +1,193 @@
+#include <stdlib.h>
+
+#include "split_parallel.h"
+#include "work_pool.h"
+
+// Each thread decodes this many samples at a time, of every channel, and
+// feeds the frames they make up
+#define PARALLEL_BLOCK 65536
+
+// Chunks are at least this many frames, and there are up to this many
+// per thread so that threads that finish early can take over the rest
+#define MIN_CHUNK (1 << 22)
+#define CHUNKS_PER_THREAD 8
+
+typedef struct
+{
+    int64_t start;
+    int64_t end;
+} track_span;
+
+// The tracks one chunk found on its own
+typedef struct
+{
+    track_span *tracks;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} chunk_tracks;
+
+typedef struct
+{
+    const audio_reader *reader;
+    const unsigned char *bytes;
+    uint64_t count;
+    int width;
+    int channels;
+    split_config config;
+    int chunk_count;
+    chunk_tracks *chunks;
+} parallel_job;
+
+// Runs a detector over one chunk, from the GAP state
+static void run_chunk(int task, int worker, void *arg);
+
+// Adds a track to the list of a chunk
+static void add_track(int64_t start, int64_t end, void *arg);
+
+bool split_parallel(const audio_reader *reader, const unsigned char *bytes, uint64_t count, const split_config *config,
+                    int threads, track_fn on_track, void *arg)
+{
+    int thread_count = threads > 0 ? threads : work_pool_default_threads();
+    uint64_t chunk_count = count / MIN_CHUNK;
+    if (chunk_count > (uint64_t)thread_count * CHUNKS_PER_THREAD)
+    {
+        chunk_count = (uint64_t)thread_count * CHUNKS_PER_THREAD;
+    }
+    if (chunk_count < 1)
+    {
+        chunk_count = 1;
+    }
+
+    parallel_job job;
+    job.reader = reader;
+    job.bytes = bytes;
+    job.count = count;
+    job.width = reader->bytes_per_sample;
+    job.channels = reader->channels;
+    job.config = *config;
+    job.chunk_count = (int)chunk_count;
+    job.chunks = calloc(chunk_count, sizeof(chunk_tracks));
+    if (!job.chunks)
+    {
+        return false;
+    }
+    work_pool_run(job.chunk_count, thread_count, run_chunk, &job);
+
+    bool ok = true;
+    for (int i = 0; i < job.chunk_count; i++)
+    {
+        ok = ok && !job.chunks[i].failed;
+    }
+
+    // A track that goes on past the end of a chunk comes out as the last
+    // track of that chunk and the first of the next one.  They are one
+    // track exactly when the quiet samples between them are too few to
+    // end it
+    int64_t gap = config->min_gap;
+    track_span current = {0, 0};
+    bool have = false;
+    for (int i = 0; ok && i < job.chunk_count; i++)
+    {
+        const chunk_tracks *chunk = &job.chunks[i];
+        for (size_t j = 0; j < chunk->count; j++)
+        {
+            track_span next = chunk->tracks[j];
+            if (have && next.start - current.end - 1 < gap)
+            {
+                current.end = next.end;
+                continue;
+            }
+            if (have)
+            {
+                on_track(current.start, current.end, arg);
+            }
+            current = next;
+            have = true;
+        }
+    }
+    if (have)
+    {
+        on_track(current.start, current.end, arg);
+    }
+
+    for (int i = 0; i < job.chunk_count; i++)
+    {
+        free(job.chunks[i].tracks);
+    }
+    free(job.chunks);
+    return ok;
+}
+
+static void run_chunk(int task, int worker, void *arg)
+{
+    (void)worker;
+    parallel_job *job = (parallel_job *)arg;
+    chunk_tracks *chunk = &job->chunks[task];
+    uint64_t first = job->count * task / job->chunk_count;
+    uint64_t last = job->count * (task + 1) / job->chunk_count;
+
+    // Counting from the start of the chunk numbers the tracks from the
+    // start of the input
+    split_state detector;
+    split_init(&detector, &job->config, add_track, chunk);
+    detector.count = first;
+
+    // Single-channel 16 and 32-bit samples are scanned where they lie when
+    // they are in the processor's byte order and aligned; the rest are
+    // decoded, and reduced to one sample a frame, a block at a time
+    size_t frame = (size_t)job->width * job->channels;
+    const unsigned char *bytes = job->bytes + first * frame;
+    bool in_place = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && job->width != 3 && job->channels == 1
+                    && (uintptr_t)bytes % job->width == 0;
+    if (in_place && job->width == 2)
+    {
+        split_feed16(&detector, (const int16_t *)bytes, last - first);
+    }
+    else if (in_place)
+    {
+        split_feed(&detector, (const int32_t *)bytes, last - first);
+    }
+    else
+    {
+        int32_t *samples = malloc(sizeof(int32_t) * PARALLEL_BLOCK);
+        if (!samples)
+        {
+            chunk->failed = true;
+            return;
+        }
+        size_t block = PARALLEL_BLOCK / job->channels;
+        for (uint64_t i = first; i < last; i += block)
+        {
+            size_t n = last - i < block ? last - i : block;
+            audio_decode(job->bytes + i * frame, n * job->channels, job->width, samples);
+            if (job->channels > 1)
+            {
+                audio_reduce(job->reader, samples, n, samples);
+            }
+            split_feed(&detector, samples, n);
+        }
+        free(samples);
+    }
+    split_finish(&detector);
+}
+
+static void add_track(int64_t start, int64_t end, void *arg)
+{
+    chunk_tracks *chunk = (chunk_tracks *)arg;
+    if (chunk->count == chunk->capacity)
+    {
+        size_t capacity = chunk->capacity ? 2 * chunk->capacity : 64;
+        track_span *tracks = realloc(chunk->tracks, sizeof(track_span) * capacity);
+        if (!tracks)
+        {
+            chunk->failed = true;
+            return;
+        }
+        chunk->tracks = tracks;
+        chunk->capacity = capacity;
+    }
+    chunk->tracks[chunk->count].start = start;
+    chunk->tracks[chunk->count].end = end;
+    chunk->count++;
+}
@@ -0,0 +1,31 @@
+#ifndef __SPLIT_PARALLEL_H__
+#define __SPLIT_PARALLEL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "split_audio.h"
+#include "audio_input.h"
+
+/**
+ * Finds the tracks in samples that are already in memory, such as a
+ * mapped file.  The samples are cut into chunks, each run through its own
+ * detector on one of several threads, and the tracks that cross from one
+ * chunk into the next are joined back up, so on_track sees exactly what
+ * feeding every sample to one detector and finishing it would report.
+ * Frames of several channels are reduced as the reader is set to.
+ *
+ * @param reader the reader the samples were mapped from
+ * @param bytes count frames, as audio_map returns them
+ * @param count a nonnegative integer
+ * @param config the threshold and gap
+ * @param threads the number of threads to use; 0 for the default
+ * @param on_track called for each track in order, on the calling thread
+ * @param arg passed through to on_track
+ * @return true if successful, false if memory could not be allocated,
+ *         in which case no tracks are reported
+ */
+bool split_parallel(const audio_reader *reader, const unsigned char *bytes, uint64_t count, const split_config *config,
+                    int threads, track_fn on_track, void *arg);
+
+#endif
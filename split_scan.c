@@ -0,0 +1,341 @@
+#include <string.h>
+
+#include "split_scan.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SCAN_HAVE_X86 1
+#endif
+
+// Find the first sample that is loud (or quiet, if quiet is true); the
+// threshold is nonnegative here, and below 32768 for 16-bit samples
+typedef size_t (*scan_fn)(const int32_t *samples, size_t n, uint32_t threshold, bool quiet);
+typedef size_t (*scan16_fn)(const int16_t *samples, size_t n, uint32_t threshold, bool quiet);
+
+typedef struct
+{
+    const char *name;
+    scan_fn fn;
+    scan16_fn fn16;
+    const char *feature;  // what __builtin_cpu_supports must say, or NULL
+} scan_kernel;
+
+static size_t scan_scalar(const int32_t *samples, size_t n, uint32_t threshold, bool quiet);
+static size_t scan16_scalar(const int16_t *samples, size_t n, uint32_t threshold, bool quiet);
+#ifdef SCAN_HAVE_X86
+static size_t scan_sse2(const int32_t *samples, size_t n, uint32_t threshold, bool quiet);
+static size_t scan_avx2(const int32_t *samples, size_t n, uint32_t threshold, bool quiet);
+static size_t scan_avx512(const int32_t *samples, size_t n, uint32_t threshold, bool quiet);
+static size_t scan16_sse2(const int16_t *samples, size_t n, uint32_t threshold, bool quiet);
+static size_t scan16_avx2(const int16_t *samples, size_t n, uint32_t threshold, bool quiet);
+static size_t scan16_avx512(const int16_t *samples, size_t n, uint32_t threshold, bool quiet);
+#endif
+
+// Best last, so the first call can pick the last one that's supported
+static const scan_kernel kernels[] = {
+    {"scalar", scan_scalar, scan16_scalar, NULL},
+#ifdef SCAN_HAVE_X86
+    {"sse2", scan_sse2, scan16_sse2, "sse2"},
+    {"avx2", scan_avx2, scan16_avx2, "avx2"},
+    {"avx512", scan_avx512, scan16_avx512, "avx512bw"},
+#endif
+};
+
+static const scan_kernel *current = NULL;
+
+// Returns true if the processor can run the given kernel
+static bool supported(const scan_kernel *kernel);
+
+// Returns the kernel to use, picking it on the first call
+static const scan_kernel *kernel();
+
+// Returns the absolute value of a sample, without overflow for INT32_MIN
+static uint32_t magnitude(int32_t value);
+
+size_t scan_loud(const int32_t *samples, size_t n, int threshold)
+{
+    // A negative threshold makes every sample loud
+    if (threshold < 0)
+    {
+        return 0;
+    }
+    return kernel()->fn(samples, n, threshold, false);
+}
+
+size_t scan_quiet(const int32_t *samples, size_t n, int threshold)
+{
+    if (threshold < 0)
+    {
+        return n;
+    }
+    return kernel()->fn(samples, n, threshold, true);
+}
+
+size_t scan_loud16(const int16_t *samples, size_t n, int threshold)
+{
+    // Nothing is louder than 32768, the magnitude of INT16_MIN
+    if (threshold < 0)
+    {
+        return 0;
+    }
+    return threshold >= 32768 ? n : kernel()->fn16(samples, n, threshold, false);
+}
+
+size_t scan_quiet16(const int16_t *samples, size_t n, int threshold)
+{
+    if (threshold < 0)
+    {
+        return n;
+    }
+    return threshold >= 32768 ? 0 : kernel()->fn16(samples, n, threshold, true);
+}
+
+bool scan_use_kernel(const char *name)
+{
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        if (strcmp(kernels[k].name, name) == 0 && supported(&kernels[k]))
+        {
+            current = &kernels[k];
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *scan_kernel_name()
+{
+    return kernel()->name;
+}
+
+static const scan_kernel *kernel()
+{
+    // Pick the implementation once
+    if (!current)
+    {
+        const scan_kernel *best = &kernels[0];
+        for (size_t k = 1; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+        {
+            if (supported(&kernels[k]))
+            {
+                best = &kernels[k];
+            }
+        }
+        current = best;
+    }
+    return current;
+}
+
+static bool supported(const scan_kernel *kernel)
+{
+#ifdef SCAN_HAVE_X86
+    if (kernel->feature)
+    {
+        __builtin_cpu_init();
+        if (strcmp(kernel->feature, "sse2") == 0)
+        {
+            return __builtin_cpu_supports("sse2");
+        }
+        if (strcmp(kernel->feature, "avx2") == 0)
+        {
+            return __builtin_cpu_supports("avx2");
+        }
+        return __builtin_cpu_supports("avx512bw");
+    }
+#endif
+    return kernel->feature == NULL;
+}
+
+// The plain C kernels are the same for every sample type
+#define SCAN_SCALAR(name, type)                                                 \
+    static size_t name(const type *samples, size_t n, uint32_t threshold, bool quiet) \
+    {                                                                           \
+        for (size_t i = 0; i < n; i++)                                          \
+        {                                                                       \
+            if ((magnitude(samples[i]) > threshold) != quiet)                   \
+            {                                                                   \
+                return i;                                                       \
+            }                                                                   \
+        }                                                                       \
+        return n;                                                               \
+    }
+
+SCAN_SCALAR(scan_scalar, int32_t)
+SCAN_SCALAR(scan16_scalar, int16_t)
+
+#ifdef SCAN_HAVE_X86
+// Each kernel compares 4 vectors at a time, turns the comparisons into
+// one bit per sample and stops at the first set bit; what is left over
+// at the end goes through the scalar kernel
+
+__attribute__((target("sse2")))
+static size_t scan_sse2(const int32_t *samples, size_t n, uint32_t threshold, bool quiet)
+{
+    // SSE2 only compares signed integers, so flip the top bits of both
+    // sides to compare the magnitudes as unsigned
+    const __m128i bias = _mm_set1_epi32(INT32_MIN);
+    const __m128i limit = _mm_set1_epi32((int32_t)(threshold ^ 0x80000000u));
+    const unsigned flip = quiet ? 0xFFFF : 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        unsigned mask = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(samples + i + 4 * k));
+            __m128i sign = _mm_srai_epi32(v, 31);
+            __m128i level = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+            __m128i loud = _mm_cmpgt_epi32(_mm_xor_si128(level, bias), limit);
+            mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(loud)) << (4 * k);
+        }
+        mask ^= flip;
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_scalar(samples + i, n - i, threshold, quiet);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const int32_t *samples, size_t n, uint32_t threshold, bool quiet)
+{
+    // level > threshold exactly when max(level, threshold + 1) == level;
+    // the threshold is at most INT32_MAX, so threshold + 1 doesn't wrap
+    const __m256i above = _mm256_set1_epi32((int32_t)(threshold + 1));
+    const uint32_t flip = quiet ? 0xFFFFFFFFu : 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        uint32_t mask = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            __m256i level = _mm256_abs_epi32(_mm256_loadu_si256((const __m256i *)(samples + i + 8 * k)));
+            __m256i loud = _mm256_cmpeq_epi32(_mm256_max_epu32(level, above), level);
+            mask |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(loud)) << (8 * k);
+        }
+        mask ^= flip;
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_scalar(samples + i, n - i, threshold, quiet);
+}
+
+__attribute__((target("avx512f")))
+static size_t scan_avx512(const int32_t *samples, size_t n, uint32_t threshold, bool quiet)
+{
+    const __m512i limit = _mm512_set1_epi32((int32_t)threshold);
+    const uint64_t flip = quiet ? ~0ULL : 0;
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        uint64_t mask = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            __m512i level = _mm512_abs_epi32(_mm512_loadu_si512((const void *)(samples + i + 16 * k)));
+            mask |= (uint64_t)_mm512_cmpgt_epu32_mask(level, limit) << (16 * k);
+        }
+        mask ^= flip;
+        if (mask)
+        {
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    return i + scan_scalar(samples + i, n - i, threshold, quiet);
+}
+
+// 16-bit samples are compared against both -threshold and threshold,
+// which fit since the threshold is below 32768 here
+
+__attribute__((target("sse2")))
+static size_t scan16_sse2(const int16_t *samples, size_t n, uint32_t threshold, bool quiet)
+{
+    const __m128i high = _mm_set1_epi16((int16_t)threshold);
+    const __m128i low = _mm_set1_epi16((int16_t)-(int32_t)threshold);
+    const unsigned flip = quiet ? 0xFFFFFFFFu : 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m128i loud[4];
+        for (int k = 0; k < 4; k++)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(samples + i + 8 * k));
+            loud[k] = _mm_or_si128(_mm_cmpgt_epi16(v, high), _mm_cmplt_epi16(v, low));
+        }
+        // Packing keeps the sign of each comparison, one byte per sample
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_packs_epi16(loud[0], loud[1]))
+                        | (unsigned)_mm_movemask_epi8(_mm_packs_epi16(loud[2], loud[3])) << 16;
+        mask ^= flip;
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan16_scalar(samples + i, n - i, threshold, quiet);
+}
+
+__attribute__((target("avx2")))
+static size_t scan16_avx2(const int16_t *samples, size_t n, uint32_t threshold, bool quiet)
+{
+    const __m256i limit = _mm256_set1_epi16((int16_t)threshold);
+    const uint64_t flip = quiet ? ~0ULL : 0;
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        uint64_t mask = 0;
+        for (int k = 0; k < 2; k++)
+        {
+            // abs(INT16_MIN) stays negative, so check it by its sign
+            __m256i a = _mm256_loadu_si256((const __m256i *)(samples + i + 32 * k));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(samples + i + 32 * k + 16));
+            __m256i la = _mm256_abs_epi16(a);
+            __m256i lb = _mm256_abs_epi16(b);
+            __m256i loud_a = _mm256_or_si256(_mm256_cmpgt_epi16(la, limit), _mm256_srai_epi16(la, 15));
+            __m256i loud_b = _mm256_or_si256(_mm256_cmpgt_epi16(lb, limit), _mm256_srai_epi16(lb, 15));
+            // Packing works within 128-bit lanes, so put them back in order
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(loud_a, loud_b), 0xD8);
+            mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(packed) << (32 * k);
+        }
+        mask ^= flip;
+        if (mask)
+        {
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    return i + scan16_scalar(samples + i, n - i, threshold, quiet);
+}
+
+__attribute__((target("avx512bw")))
+static size_t scan16_avx512(const int16_t *samples, size_t n, uint32_t threshold, bool quiet)
+{
+    const __m512i limit = _mm512_set1_epi16((int16_t)threshold);
+    const uint64_t flip = quiet ? ~0ULL : 0;
+    size_t i = 0;
+    for (; i + 128 <= n; i += 128)
+    {
+        // abs(INT16_MIN) is 32768 as an unsigned number
+        __m512i a = _mm512_abs_epi16(_mm512_loadu_si512((const void *)(samples + i)));
+        __m512i b = _mm512_abs_epi16(_mm512_loadu_si512((const void *)(samples + i + 32)));
+        __m512i c = _mm512_abs_epi16(_mm512_loadu_si512((const void *)(samples + i + 64)));
+        __m512i d = _mm512_abs_epi16(_mm512_loadu_si512((const void *)(samples + i + 96)));
+        uint64_t first = ((uint64_t)_mm512_cmpgt_epu16_mask(a, limit) | (uint64_t)_mm512_cmpgt_epu16_mask(b, limit) << 32) ^ flip;
+        if (first)
+        {
+            return i + __builtin_ctzll(first);
+        }
+        uint64_t second = ((uint64_t)_mm512_cmpgt_epu16_mask(c, limit) | (uint64_t)_mm512_cmpgt_epu16_mask(d, limit) << 32) ^ flip;
+        if (second)
+        {
+            return i + 64 + __builtin_ctzll(second);
+        }
+    }
+    return i + scan16_scalar(samples + i, n - i, threshold, quiet);
+}
+#endif
+
+static uint32_t magnitude(int32_t value)
+{
+    return value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+}
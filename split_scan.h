@@ -0,0 +1,72 @@
+#ifndef __SPLIT_SCAN_H__
+#define __SPLIT_SCAN_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernels that find the next sample on the other side of the threshold,
+// which is all the detector needs in the GAP and TRACK states.  The best
+// kernel the processor supports (AVX-512, AVX2, SSE2 or plain C) is picked
+// the first time one is called; they all return the same answers.
+
+/**
+ * Returns the index of the first sample whose absolute value is above the
+ * threshold.
+ *
+ * @param samples an array of n samples
+ * @param n a nonnegative integer
+ * @param threshold the largest absolute value of a quiet sample
+ * @return the index, or n if every sample is quiet
+ */
+size_t scan_loud(const int32_t *samples, size_t n, int threshold);
+
+/**
+ * Returns the index of the first sample whose absolute value is at most
+ * the threshold.
+ *
+ * @param samples an array of n samples
+ * @param n a nonnegative integer
+ * @param threshold the largest absolute value of a quiet sample
+ * @return the index, or n if every sample is loud
+ */
+size_t scan_quiet(const int32_t *samples, size_t n, int threshold);
+
+/**
+ * Returns the index of the first 16-bit sample whose absolute value is
+ * above the threshold, for scanning 16-bit input where it lies.
+ *
+ * @param samples an array of n samples
+ * @param n a nonnegative integer
+ * @param threshold the largest absolute value of a quiet sample
+ * @return the index, or n if every sample is quiet
+ */
+size_t scan_loud16(const int16_t *samples, size_t n, int threshold);
+
+/**
+ * Returns the index of the first 16-bit sample whose absolute value is at
+ * most the threshold.
+ *
+ * @param samples an array of n samples
+ * @param n a nonnegative integer
+ * @param threshold the largest absolute value of a quiet sample
+ * @return the index, or n if every sample is loud
+ */
+size_t scan_quiet16(const int16_t *samples, size_t n, int threshold);
+
+/**
+ * Makes the scans use the named kernel ("scalar", "sse2", "avx2" or
+ * "avx512") from now on, e.g. to compare them.
+ *
+ * @param name a kernel name
+ * @return true if successful, false if there is no such kernel or the
+ *         processor doesn't support it
+ */
+bool scan_use_kernel(const char *name);
+
+/**
+ * Returns the name of the kernel the scans use.
+ */
+const char *scan_kernel_name();
+
+#endif
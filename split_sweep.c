@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "split_sweep.h"
+#include "split_scan.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Lanes of 32-bit sample numbers per vector
+#define SWEEP_LANES 4
+
+// Sample numbers in the lanes count from base, which moves on at least
+// this often so that they fit
+#define SWEEP_SPAN (1 << 30)
+
+// Moves base to the given sample, keeping what the lanes hold
+static void rebase(sweep_state *s, int64_t base);
+
+// Runs every detector over sample i (from base) of the given magnitude
+static void update(sweep_state *s, int32_t i, uint32_t size);
+
+// Starts a new track at sample i in each lane of a vector set in mask,
+// ending the one before
+static void start_tracks(sweep_state *s, int first, int mask, int32_t i);
+
+// Adds a track to the results of a lane
+static void add_track(sweep_state *s, int lane, int64_t start, int64_t end);
+
+// Returns the last loud sample of a lane
+static int64_t last_loud(const sweep_state *s, int lane);
+
+// Returns the magnitude of a sample
+static uint32_t magnitude(int32_t value);
+
+bool sweep_init(sweep_state *s, const split_config *configs, int count)
+{
+    memset(s, 0, sizeof(sweep_state));
+    s->count = count;
+    s->lanes = (count + SWEEP_LANES - 1) / SWEEP_LANES * SWEEP_LANES;
+    s->thresholds = malloc(sizeof(int32_t) * s->lanes);
+    s->gaps = malloc(sizeof(int32_t) * s->lanes);
+    s->last = malloc(sizeof(int32_t) * s->lanes);
+    s->last_before = malloc(sizeof(int64_t) * s->lanes);
+    s->start = malloc(sizeof(int64_t) * s->lanes);
+    s->started = calloc(s->lanes, sizeof(bool));
+    s->results = calloc(count, sizeof(sweep_result));
+    if (!s->thresholds || !s->gaps || !s->last || !s->last_before || !s->start || !s->started || !s->results)
+    {
+        sweep_destroy(s);
+        return false;
+    }
+
+    s->low = configs[0].threshold;
+    s->high = configs[0].threshold;
+    for (int k = 0; k < s->lanes; k++)
+    {
+        // No magnitude, capped at INT32_MAX, is above a padding lane
+        s->thresholds[k] = k < count ? configs[k].threshold : INT32_MAX;
+        s->gaps[k] = k < count ? configs[k].min_gap : 1;
+        s->last[k] = INT32_MIN;
+        s->last_before[k] = INT64_MIN;
+        if (k < count)
+        {
+            s->results[k].config = configs[k];
+            s->low = configs[k].threshold < s->low ? configs[k].threshold : s->low;
+            s->high = configs[k].threshold > s->high ? configs[k].threshold : s->high;
+        }
+    }
+    return true;
+}
+
+void sweep_feed(sweep_state *s, const int32_t *samples, size_t n)
+{
+    while (n > 0)
+    {
+        if (s->count_seen - s->base > SWEEP_SPAN)
+        {
+            rebase(s, s->count_seen);
+        }
+        int64_t offset = s->count_seen - s->base;
+        size_t take = n < (size_t)(2 * (int64_t)SWEEP_SPAN - offset) ? n : (size_t)(2 * (int64_t)SWEEP_SPAN - offset);
+
+        // A sample at most the smallest threshold is quiet to every
+        // detector and changes nothing; one above the largest is loud to
+        // all of them, and so are the ones after it until the next that
+        // isn't, which can't start a track since the one before is loud
+        size_t i = 0;
+        while (i < take)
+        {
+            if (magnitude(samples[i]) <= (uint32_t)s->low)
+            {
+                i += scan_loud(samples + i, take - i, s->low);
+                if (i == take)
+                {
+                    break;
+                }
+            }
+            uint32_t m = magnitude(samples[i]);
+            update(s, (int32_t)(offset + i), m);
+            if (m > (uint32_t)s->high)
+            {
+                size_t run = scan_quiet(samples + i + 1, take - i - 1, s->high);
+                int32_t last = (int32_t)(offset + i + run);
+                for (int k = 0; k < s->lanes; k++)
+                {
+                    s->last[k] = last;
+                }
+                i += run;
+            }
+            i++;
+        }
+
+        samples += take;
+        n -= take;
+        s->count_seen += take;
+    }
+}
+
+bool sweep_finish(sweep_state *s)
+{
+    for (int k = 0; k < s->count; k++)
+    {
+        if (s->started[k])
+        {
+            add_track(s, k, s->start[k], last_loud(s, k));
+            s->started[k] = false;
+        }
+    }
+    return !s->failed;
+}
+
+void sweep_destroy(sweep_state *s)
+{
+    if (s->results)
+    {
+        for (int k = 0; k < s->count; k++)
+        {
+            free(s->results[k].tracks);
+        }
+    }
+    free(s->results);
+    free(s->thresholds);
+    free(s->gaps);
+    free(s->last);
+    free(s->last_before);
+    free(s->start);
+    free(s->started);
+    s->results = NULL;
+    s->thresholds = NULL;
+    s->gaps = NULL;
+    s->last = NULL;
+    s->last_before = NULL;
+    s->start = NULL;
+    s->started = NULL;
+}
+
+static void rebase(sweep_state *s, int64_t base)
+{
+    for (int k = 0; k < s->lanes; k++)
+    {
+        int64_t last = last_loud(s, k);
+        s->last_before[k] = last;
+        s->last[k] = last != INT64_MIN && last - base > INT32_MIN ? (int32_t)(last - base) : INT32_MIN;
+    }
+    s->base = base;
+}
+
+static void update(sweep_state *s, int32_t i, uint32_t size)
+{
+    int32_t m = size > INT32_MAX ? INT32_MAX : (int32_t)size;
+    int k = 0;
+#ifdef __SSE2__
+    // A loud sample starts a track when last < i - gap, which can't
+    // overflow since i < 2^31 and gap > 0
+    const __m128i level = _mm_set1_epi32(m);
+    const __m128i at = _mm_set1_epi32(i);
+    for (; k < s->lanes; k += SWEEP_LANES)
+    {
+        __m128i last = _mm_loadu_si128((const __m128i *)(s->last + k));
+        __m128i loud = _mm_cmpgt_epi32(level, _mm_loadu_si128((const __m128i *)(s->thresholds + k)));
+        __m128i since = _mm_sub_epi32(at, _mm_loadu_si128((const __m128i *)(s->gaps + k)));
+        __m128i fresh = _mm_and_si128(loud, _mm_cmplt_epi32(last, since));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(fresh));
+        if (mask)
+        {
+            start_tracks(s, k, mask, i);
+        }
+        last = _mm_or_si128(_mm_and_si128(loud, at), _mm_andnot_si128(loud, last));
+        _mm_storeu_si128((__m128i *)(s->last + k), last);
+    }
+#endif
+    for (; k < s->lanes; k++)
+    {
+        if (m > s->thresholds[k])
+        {
+            if (s->last[k] < i - s->gaps[k])
+            {
+                start_tracks(s, k, 1, i);
+            }
+            s->last[k] = i;
+        }
+    }
+}
+
+static void start_tracks(sweep_state *s, int first, int mask, int32_t i)
+{
+    for (int b = 0; b < SWEEP_LANES; b++)
+    {
+        int k = first + b;
+        if (!(mask & (1 << b)))
+        {
+            continue;
+        }
+        if (s->started[k])
+        {
+            add_track(s, k, s->start[k], last_loud(s, k));
+        }
+        s->start[k] = s->base + i;
+        s->started[k] = true;
+    }
+}
+
+static void add_track(sweep_state *s, int lane, int64_t start, int64_t end)
+{
+    sweep_result *result = &s->results[lane];
+    if (result->count == result->capacity)
+    {
+        size_t capacity = result->capacity ? 2 * result->capacity : 64;
+        sweep_track *tracks = realloc(result->tracks, sizeof(sweep_track) * capacity);
+        if (!tracks)
+        {
+            s->failed = true;
+            return;
+        }
+        result->tracks = tracks;
+        result->capacity = capacity;
+    }
+    result->tracks[result->count].start = start;
+    result->tracks[result->count].end = end;
+    result->count++;
+    result->samples += end - start + 1;
+}
+
+static int64_t last_loud(const sweep_state *s, int lane)
+{
+    return s->last[lane] != INT32_MIN ? s->base + s->last[lane] : s->last_before[lane];
+}
+
+static uint32_t magnitude(int32_t value)
+{
+    return value < 0 ? 0 - (uint32_t)value : (uint32_t)value;
+}
@@ -0,0 +1,90 @@
+#ifndef __SPLIT_SWEEP_H__
+#define __SPLIT_SWEEP_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "split_audio.h"
+
+// The most thresholds and gaps one sweep can try
+#define SWEEP_MAX_CONFIGS 1024
+
+typedef struct
+{
+    int64_t start;
+    int64_t end;
+} sweep_track;
+
+// The tracks one threshold and gap found
+typedef struct
+{
+    split_config config;
+    sweep_track *tracks;
+    size_t count;
+    size_t capacity;
+    int64_t samples;        // in all of its tracks
+} sweep_result;
+
+// Many detectors run over the same samples at once, one per threshold
+// and gap.  Each keeps only the last loud sample it has seen, held in a
+// lane of a vector next to the others: a loud sample starts a new track
+// exactly when at least a gap of quiet samples lies between it and that
+// last loud sample.
+typedef struct
+{
+    int count;              // thresholds and gaps tried
+    int lanes;              // count rounded up to a whole vector
+    int32_t *thresholds;    // the lanes, padded with thresholds no
+    int32_t *gaps;          // sample is above
+    int32_t *last;          // the last loud sample, from base; INT32_MIN
+                            // if before base - 2^31 or none yet
+    int64_t *last_before;   // the last loud sample before base
+    int64_t *start;         // the start of the track in progress
+    bool *started;          // whether there is one
+    int low;                // the smallest and largest thresholds
+    int high;
+    int64_t base;           // the sample last is counted from
+    int64_t count_seen;     // samples seen so far
+    sweep_result *results;
+    bool failed;
+} sweep_state;
+
+/**
+ * Starts a sweep over the given thresholds and gaps.
+ *
+ * @param s the sweep
+ * @param configs count thresholds and gaps; copied
+ * @param count from 1 to SWEEP_MAX_CONFIGS
+ * @return true if successful, false if memory could not be allocated
+ */
+bool sweep_init(sweep_state *s, const split_config *configs, int count);
+
+/**
+ * Runs every detector over the next samples of the input.  Samples no
+ * threshold finds loud are skipped with scan_loud, runs of samples every
+ * threshold finds loud with scan_quiet, and the samples in between update
+ * all the detectors together, four lanes at a time with SSE2.
+ *
+ * @param s the sweep
+ * @param samples an array of n samples
+ * @param n a nonnegative integer
+ */
+void sweep_feed(sweep_state *s, const int32_t *samples, size_t n);
+
+/**
+ * Ends the input, adding the track in progress of each detector.
+ *
+ * @param s the sweep
+ * @return true if successful, false if memory ran out for the tracks
+ */
+bool sweep_finish(sweep_state *s);
+
+/**
+ * Frees the memory of a sweep, results included.
+ *
+ * @param s a sweep started by sweep_init
+ */
+void sweep_destroy(sweep_state *s);
+
+#endif
@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#include "track_writer.h"
+
+// Bytes copied at a time when the kernel can't copy between the files
+#define COPY_BUFFER_SIZE (1 << 16)
+
+// Writes a WAV header for the given number of bytes of samples, not
+// counting the pad byte after an odd number
+static bool write_wav_header(const track_writer *writer, int fd, uint64_t data_size);
+
+// Copies length bytes of one file from the given offset to the end of
+// another: with copy_file_range, or sendfile across file systems that
+// don't support it, or read and write if neither works
+static bool copy_range(int from, uint64_t offset, int to, uint64_t length);
+
+// Returns true if a copy call failed only because the files don't allow it
+static bool unsupported(int error);
+
+// Stores little-endian integers at the given bytes
+static void put_le32(unsigned char *p, uint32_t value);
+static void put_le16(unsigned char *p, uint16_t value);
+
+bool track_writer_init(track_writer *writer, const audio_reader *reader, const char *prefix)
+{
+    struct stat st;
+    if (reader->format == AUDIO_TEXT || fstat(reader->fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+    writer->source = reader->fd;
+    writer->wav = reader->format == AUDIO_WAV;
+    writer->bytes_per_sample = reader->bytes_per_sample;
+    writer->channels = reader->channels;
+    writer->sample_rate = reader->sample_rate;
+    writer->data_offset = reader->data_offset;
+    writer->prefix = prefix;
+    writer->count = 0;
+    writer->path[0] = '\0';
+    return true;
+}
+
+bool track_writer_write(track_writer *writer, int64_t start, int64_t end)
+{
+    writer->count++;
+    snprintf(writer->path, sizeof(writer->path), "%s%04d.%s", writer->prefix, writer->count,
+             writer->wav ? "wav" : "raw");
+    int fd = open(writer->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    uint64_t frame = (uint64_t)writer->bytes_per_sample * writer->channels;
+    uint64_t length = (uint64_t)(end - start + 1) * frame;
+    bool ok = (!writer->wav || write_wav_header(writer, fd, length))
+              && copy_range(writer->source, writer->data_offset + (uint64_t)start * frame, fd, length)
+              && (!writer->wav || length % 2 == 0 || write(fd, "", 1) == 1);
+    return close(fd) == 0 && ok;
+}
+
+static bool write_wav_header(const track_writer *writer, int fd, uint64_t data_size)
+{
+    // Too long for the size fields; readers take all ones as unknown.  A
+    // chunk of odd size is followed by a pad byte, which the RIFF size
+    // counts and the data size doesn't
+    uint32_t size = data_size > UINT32_MAX - 37 ? UINT32_MAX : (uint32_t)data_size;
+    unsigned char header[44];
+    memcpy(header, "RIFF", 4);
+    put_le32(header + 4, size == UINT32_MAX ? UINT32_MAX : size + 36 + size % 2);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le32(header + 16, 16);
+    put_le16(header + 20, 1);
+    put_le16(header + 22, writer->channels);
+    put_le32(header + 24, writer->sample_rate);
+    put_le32(header + 28, writer->sample_rate * writer->bytes_per_sample * writer->channels);
+    put_le16(header + 32, writer->bytes_per_sample * writer->channels);
+    put_le16(header + 34, 8 * writer->bytes_per_sample);
+    memcpy(header + 36, "data", 4);
+    put_le32(header + 40, size);
+    return write(fd, header, sizeof(header)) == (ssize_t)sizeof(header);
+}
+
+static bool copy_range(int from, uint64_t offset, int to, uint64_t length)
+{
+    loff_t in = offset;
+    while (length > 0)
+    {
+        ssize_t got = copy_file_range(from, &in, to, NULL, length, 0);
+        if (got < 0 && unsupported(errno))
+        {
+            break;
+        }
+        if (got <= 0)
+        {
+            return false;
+        }
+        length -= got;
+    }
+
+    off_t at = in;
+    while (length > 0)
+    {
+        ssize_t got = sendfile(to, from, &at, length < 0x7FFFF000 ? length : 0x7FFFF000);
+        if (got < 0 && unsupported(errno))
+        {
+            break;
+        }
+        if (got <= 0)
+        {
+            return false;
+        }
+        length -= got;
+    }
+
+    unsigned char buffer[COPY_BUFFER_SIZE];
+    while (length > 0)
+    {
+        ssize_t got = pread(from, buffer, length < sizeof(buffer) ? length : sizeof(buffer), at);
+        if (got <= 0 || write(to, buffer, got) != got)
+        {
+            return false;
+        }
+        at += got;
+        length -= got;
+    }
+    return true;
+}
+
+static bool unsupported(int error)
+{
+    return error == EXDEV || error == ENOSYS || error == EINVAL || error == EOPNOTSUPP;
+}
+
+static void put_le32(unsigned char *p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void put_le16(unsigned char *p, uint16_t value)
+{
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+}
@@ -0,0 +1,49 @@
+#ifndef __TRACK_WRITER_H__
+#define __TRACK_WRITER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_input.h"
+
+// Writes the tracks of a binary input file to files of their own,
+// numbered from 1: a WAV file for WAV input, headerless PCM like the
+// input otherwise, with all of the input's channels.  The samples go
+// straight from the input file to the output in the kernel, without
+// passing through this process.
+typedef struct
+{
+    int source;             // the input file
+    bool wav;
+    int bytes_per_sample;
+    int channels;           // every channel of a frame is written
+    uint32_t sample_rate;
+    uint64_t data_offset;   // where the samples start in the input
+    const char *prefix;
+    int count;              // tracks written so far
+    char path[4096];        // the last file written or tried
+} track_writer;
+
+/**
+ * Starts writing the tracks of an input.
+ *
+ * @param writer the writer to fill in
+ * @param reader an open reader of a binary format on a regular file
+ * @param prefix the start of the path of each file, followed by its
+ *        4-digit number and .wav or .raw
+ * @return true if successful, false if the input is text or not a
+ *         regular file
+ */
+bool track_writer_init(track_writer *writer, const audio_reader *reader, const char *prefix);
+
+/**
+ * Writes the next track to its own file, named in writer->path.
+ *
+ * @param writer the writer
+ * @param start the first frame of the track
+ * @param end the last frame of the track
+ * @return true if successful, false if the file could not be written
+ */
+bool track_writer_write(track_writer *writer, int64_t start, int64_t end);
+
+#endif
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "work_pool.h"
+
+// The tasks a thread still has to run are the range [next, end); the
+// owner takes from the front and thieves take from the back
+typedef struct
+{
+    pthread_mutex_t lock;
+    int next;
+    int end;
+} task_range;
+
+typedef struct
+{
+    task_range *ranges;
+    int thread_count;
+    work_fn fn;
+    void *arg;
+} pool;
+
+typedef struct
+{
+    pool *p;
+    int worker;
+} worker_arg;
+
+// Takes one task from the front of the given range; -1 if it is empty
+static int take_task(task_range *r);
+
+// Moves half of the tasks of some other thread into the range of the
+// given worker; returns false if every other range was empty
+static bool steal_tasks(pool *p, int worker);
+
+static void *worker_main(void *arg);
+
+int work_pool_default_threads()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (int)n;
+}
+
+int work_pool_run(int task_count, int thread_count, work_fn fn, void *arg)
+{
+    if (thread_count <= 0)
+    {
+        thread_count = work_pool_default_threads();
+    }
+    if (thread_count > task_count)
+    {
+        thread_count = task_count < 1 ? 1 : task_count;
+    }
+
+    pool p;
+    p.ranges = malloc(sizeof(task_range) * thread_count);
+    p.thread_count = thread_count;
+    p.fn = fn;
+    p.arg = arg;
+
+    // Hand out equal contiguous shares to start with
+    for (int i = 0; i < thread_count; i++)
+    {
+        pthread_mutex_init(&p.ranges[i].lock, NULL);
+        p.ranges[i].next = (int)((long)task_count * i / thread_count);
+        p.ranges[i].end = (int)((long)task_count * (i + 1) / thread_count);
+    }
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * thread_count);
+    worker_arg *args = malloc(sizeof(worker_arg) * thread_count);
+    int started = 1;
+    for (int i = 0; i < thread_count; i++)
+    {
+        args[i].p = &p;
+        args[i].worker = i;
+    }
+    for (int i = 1; i < thread_count; i++)
+    {
+        // If a thread can't be started its share is stolen by the others
+        if (pthread_create(&threads[i], NULL, worker_main, &args[i]) != 0)
+        {
+            break;
+        }
+        started++;
+    }
+
+    worker_main(&args[0]);
+
+    for (int i = 1; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        pthread_mutex_destroy(&p.ranges[i].lock);
+    }
+    free(args);
+    free(threads);
+    free(p.ranges);
+    return started;
+}
+
+size_t work_pool_line_start(const char *data, size_t size, size_t offset)
+{
+    if (offset == 0)
+    {
+        return 0;
+    }
+    if (offset >= size)
+    {
+        return size;
+    }
+
+    // The chunk owns the lines that begin in it
+    const char *newline = memchr(data + offset - 1, '\n', size - offset + 1);
+    return newline ? (size_t)(newline - data) + 1 : size;
+}
+
+static int take_task(task_range *r)
+{
+    int task = -1;
+    pthread_mutex_lock(&r->lock);
+    if (r->next < r->end)
+    {
+        task = r->next;
+        r->next++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return task;
+}
+
+static bool steal_tasks(pool *p, int worker)
+{
+    // Start with the neighbour so that thieves spread over the victims
+    for (int k = 1; k < p->thread_count; k++)
+    {
+        task_range *victim = &p->ranges[(worker + k) % p->thread_count];
+        int begin = 0;
+        int end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        int left = victim->end - victim->next;
+        if (left > 0)
+        {
+            // Take the back half, rounded up so that a single task moves too
+            end = victim->end;
+            begin = end - (left + 1) / 2;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (end > begin)
+        {
+            task_range *mine = &p->ranges[worker];
+            pthread_mutex_lock(&mine->lock);
+            mine->next = begin;
+            mine->end = end;
+            pthread_mutex_unlock(&mine->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *worker_main(void *arg)
+{
+    worker_arg *w = arg;
+    pool *p = w->p;
+
+    while (true)
+    {
+        int task = take_task(&p->ranges[w->worker]);
+        if (task >= 0)
+        {
+            p->fn(task, w->worker, p->arg);
+        }
+        else if (!steal_tasks(p, w->worker))
+        {
+            break;
+        }
+    }
+    return NULL;
+}
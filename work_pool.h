@@ -0,0 +1,49 @@
+#ifndef __WORK_POOL_H__
+#define __WORK_POOL_H__
+
+#include <stddef.h>
+
+/**
+ * A task body for work_pool_run.
+ *
+ * @param task the index of the task to run, in [0, task_count)
+ * @param worker the index of the thread running it, in [0, thread_count)
+ * @param arg the pointer that was passed to work_pool_run
+ */
+typedef void (*work_fn)(int task, int worker, void *arg);
+
+/**
+ * Returns the number of threads to use when the caller asks for 0,
+ * which is the number of online processors (at least 1).
+ */
+int work_pool_default_threads();
+
+/**
+ * Runs fn once for every task in [0, task_count) on thread_count threads
+ * and returns when all of them are done.  Each thread starts with an equal
+ * contiguous share of the tasks and, once its share is empty, steals half
+ * of the remaining tasks of some other thread, so uneven tasks still keep
+ * every core busy.  The calling thread is used as worker 0.
+ *
+ * @param task_count a nonnegative integer
+ * @param thread_count the number of threads to use; 0 for the default
+ * @param fn the function to call for each task
+ * @param arg passed through to fn
+ * @return the number of threads actually used
+ */
+int work_pool_run(int task_count, int thread_count, work_fn fn, void *arg);
+
+/**
+ * Returns the start of the first line that begins at or after offset, for
+ * cutting a buffer of lines into tasks: a task covering [a, b) owns the
+ * lines from work_pool_line_start(a) up to work_pool_line_start(b), so
+ * every line belongs to exactly one task.
+ *
+ * @param data the buffer
+ * @param size the size of the buffer in bytes
+ * @param offset a nonnegative offset, possibly past the end
+ * @return an offset from 0 to size
+ */
+size_t work_pool_line_start(const char *data, size_t size, size_t offset);
+
+#endif